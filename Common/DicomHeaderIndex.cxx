@@ -0,0 +1,264 @@
+#include "DicomHeaderIndex.h"
+#include "itksys/SystemTools.hxx"
+#include "itksys/MD5.h"
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+#ifdef WIN32
+#include <process.h>
+#define DicomHeaderIndexGetPID _getpid
+#else
+#include <unistd.h>
+#define DicomHeaderIndexGetPID getpid
+#endif
+
+std::string DicomHeaderIndex::m_IndexDirectory;
+
+// Identifies the format of the index files
+static const char *DicomHeaderIndexMagic = "ITKSNAP_DICOM_INDEX_1";
+
+void
+DicomHeaderIndex
+::SetIndexDirectory(const std::string &dir)
+{
+  m_IndexDirectory = dir;
+}
+
+DicomHeaderIndex
+::DicomHeaderIndex(const std::string &dir)
+  : m_Modified(false)
+{
+  if(m_IndexDirectory.length())
+    {
+    // The index file is named by the hash of the directory path
+    std::string path = itksys::SystemTools::CollapseFullPath(dir);
+    char hex[33];
+    itksysMD5 *md5 = itksysMD5_New();
+    itksysMD5_Initialize(md5);
+    itksysMD5_Append(md5, (const unsigned char *) path.c_str(), (int) path.length());
+    itksysMD5_FinalizeHex(md5, hex);
+    itksysMD5_Delete(md5);
+    hex[32] = 0;
+
+    m_IndexFile = m_IndexDirectory + "/" + hex + ".idx";
+    this->Load();
+    }
+}
+
+DicomHeaderIndex
+::~DicomHeaderIndex()
+{
+  // Failing to save the index is not an error
+  try { this->Save(); }
+  catch(...) {}
+}
+
+bool
+DicomHeaderIndex
+::GetFileStats(const std::string &file, unsigned long &size, long &mtime)
+{
+  itksys::SystemTools::Stat_t st;
+  if(itksys::SystemTools::Stat(file, &st) != 0)
+    return false;
+
+  size = (unsigned long) st.st_size;
+  mtime = (long) st.st_mtime;
+  return true;
+}
+
+bool
+DicomHeaderIndex
+::Lookup(const std::string &file, const TagList &tags,
+         bool &valid, ValueList &values) const
+{
+  EntryMap::const_iterator it = m_Entries.find(file);
+  if(it == m_Entries.end())
+    return false;
+
+  // Make sure the file has not changed
+  unsigned long size;
+  long mtime;
+  const Entry &e = it->second;
+  if(!GetFileStats(file, size, mtime) || size != e.Size || mtime != e.MTime)
+    return false;
+
+  valid = e.Valid;
+  values.resize(tags.size());
+  if(!valid)
+    return true;
+
+  for(size_t i = 0; i < tags.size(); i++)
+    {
+    std::map<unsigned int, std::string>::const_iterator itv =
+        e.Values.find(tags[i].GetElementTag());
+    if(itv == e.Values.end())
+      return false;
+    values[i] = itv->second;
+    }
+
+  return true;
+}
+
+void
+DicomHeaderIndex
+::Store(const std::string &file, const TagList &tags,
+        bool valid, const ValueList &values)
+{
+  unsigned long size;
+  long mtime;
+  if(!GetFileStats(file, size, mtime))
+    return;
+
+  // Values recorded previously for an unchanged file are kept, so that the
+  // tags read by different parts of the code accumulate in the index
+  Entry &e = m_Entries[file];
+  if(e.Size != size || e.MTime != mtime || e.Valid != valid)
+    e.Values.clear();
+
+  e.Size = size;
+  e.MTime = mtime;
+  e.Valid = valid;
+  if(valid)
+    for(size_t i = 0; i < tags.size(); i++)
+      e.Values[tags[i].GetElementTag()] = values[i];
+
+  m_Modified = true;
+}
+
+static void WriteIndexString(std::ostream &os, const std::string &s)
+{
+  unsigned int n = (unsigned int) s.length();
+  os.write((const char *) &n, sizeof(n));
+  os.write(s.data(), n);
+}
+
+static bool ReadIndexString(std::istream &is, std::string &s)
+{
+  unsigned int n;
+  if(!is.read((char *) &n, sizeof(n)) || n > 0x100000)
+    return false;
+  s.resize(n);
+  return n == 0 || (bool) is.read(&s[0], n);
+}
+
+template <class T>
+static void WriteIndexValue(std::ostream &os, const T &value)
+{
+  os.write((const char *) &value, sizeof(T));
+}
+
+template <class T>
+static bool ReadIndexValue(std::istream &is, T &value)
+{
+  return (bool) is.read((char *) &value, sizeof(T));
+}
+
+void
+DicomHeaderIndex
+::Load()
+{
+  std::ifstream is(m_IndexFile.c_str(), std::ios::binary);
+  if(!is.good())
+    return;
+
+  std::string magic;
+  unsigned int n_entries;
+  if(!ReadIndexString(is, magic) || magic != DicomHeaderIndexMagic
+     || !ReadIndexValue(is, n_entries))
+    return;
+
+  // A corrupt or truncated index is simply discarded
+  EntryMap entries;
+  for(unsigned int i = 0; i < n_entries; i++)
+    {
+    std::string file;
+    Entry e;
+    unsigned char valid;
+    unsigned int n_values;
+    if(!ReadIndexString(is, file) || !ReadIndexValue(is, e.Size)
+       || !ReadIndexValue(is, e.MTime) || !ReadIndexValue(is, valid)
+       || !ReadIndexValue(is, n_values))
+      return;
+
+    e.Valid = valid != 0;
+    for(unsigned int j = 0; j < n_values; j++)
+      {
+      unsigned int tag;
+      std::string value;
+      if(!ReadIndexValue(is, tag) || !ReadIndexString(is, value))
+        return;
+      e.Values[tag] = value;
+      }
+
+    entries[file] = e;
+    }
+
+  m_Entries.swap(entries);
+}
+
+void
+DicomHeaderIndex
+::Save()
+{
+  if(!m_Modified || m_IndexFile.empty())
+    return;
+
+  // Drop the entries for files that have been deleted or changed since they
+  // were indexed, so that the index does not keep growing
+  for(EntryMap::iterator it = m_Entries.begin(); it != m_Entries.end(); )
+    {
+    unsigned long size;
+    long mtime;
+    if(!GetFileStats(it->first, size, mtime) || size != it->second.Size || mtime != it->second.MTime)
+      m_Entries.erase(it++);
+    else
+      ++it;
+    }
+
+  // Write to a temporary file and then move it into place, so that other
+  // instances of ITK-SNAP never see a partially written index. The name of
+  // the temporary file is unique to this process and this save
+  static std::atomic<unsigned int> save_counter(0);
+  std::ostringstream oss;
+  oss << m_IndexFile << "." << DicomHeaderIndexGetPID() << "." << save_counter++ << ".tmp";
+  std::string tmp_file = oss.str();
+    {
+    std::ofstream os(tmp_file.c_str(), std::ios::binary);
+    if(!os.good())
+      return;
+
+    WriteIndexString(os, DicomHeaderIndexMagic);
+    WriteIndexValue(os, (unsigned int) m_Entries.size());
+    for(EntryMap::const_iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+      {
+      const Entry &e = it->second;
+      WriteIndexString(os, it->first);
+      WriteIndexValue(os, e.Size);
+      WriteIndexValue(os, e.MTime);
+      WriteIndexValue(os, (unsigned char) (e.Valid ? 1 : 0));
+      WriteIndexValue(os, (unsigned int) e.Values.size());
+      for(std::map<unsigned int, std::string>::const_iterator itv = e.Values.begin();
+          itv != e.Values.end(); ++itv)
+        {
+        WriteIndexValue(os, itv->first);
+        WriteIndexString(os, itv->second);
+        }
+      }
+
+    if(!os.good())
+      {
+      os.close();
+      itksys::SystemTools::RemoveFile(tmp_file);
+      return;
+      }
+    }
+
+  // If another instance saved the index at the same time, the last one wins
+  if(!itksys::SystemTools::RenameFile(tmp_file, m_IndexFile))
+    {
+    itksys::SystemTools::RemoveFile(tmp_file);
+    return;
+    }
+  m_Modified = false;
+}
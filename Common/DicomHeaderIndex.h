@@ -0,0 +1,91 @@
+#ifndef DICOMHEADERINDEX_H
+#define DICOMHEADERINDEX_H
+
+#include <map>
+#include <vector>
+#include <string>
+#include "gdcmTag.h"
+
+/**
+ * An on-disk index of DICOM header values for the files in one directory.
+ * Reading the headers of a large DICOM directory (particularly on network
+ * storage) is slow, so the values of the tags that ITK-SNAP uses to group
+ * and sort the files are recorded along with the size and modification time
+ * of each file. When the directory is opened again, files that have not
+ * changed are looked up in the index instead of being parsed.
+ *
+ * The index files are kept in the directory passed to SetIndexDirectory(),
+ * which is set up by SystemInterface. If no directory has been set, the
+ * index is not persistent.
+ *
+ * Lookup() may be called concurrently from several threads; Store() and
+ * Save() may not.
+ */
+class DicomHeaderIndex
+{
+public:
+
+  typedef std::vector<gdcm::Tag> TagList;
+  typedef std::vector<std::string> ValueList;
+
+  /** Load the index for a directory, if one exists */
+  DicomHeaderIndex(const std::string &dir);
+
+  /** Save the index if it has been modified */
+  ~DicomHeaderIndex();
+
+  /**
+   * Look up the values of a list of tags for a file. Returns false if the
+   * file is not in the index, has changed since it was indexed, or if some
+   * of the tags have not been recorded. If the file is in the index but is
+   * not a readable DICOM file, true is returned and valid is set to false.
+   */
+  bool Lookup(const std::string &file, const TagList &tags,
+              bool &valid, ValueList &values) const;
+
+  /** Record the tag values read from a file (or that the file is not valid) */
+  void Store(const std::string &file, const TagList &tags,
+             bool valid, const ValueList &values);
+
+  /**
+   * Write the index to disk. Entries for files that no longer exist or have
+   * changed since they were indexed are dropped.
+   */
+  void Save();
+
+  /** Set the directory where the index files are kept */
+  static void SetIndexDirectory(const std::string &dir);
+
+  static const std::string &GetIndexDirectory()
+    { return m_IndexDirectory; }
+
+protected:
+
+  // Information recorded for a single file
+  struct Entry
+  {
+    Entry() : Size(0), MTime(0), Valid(false) {}
+
+    unsigned long Size;
+    long MTime;
+    bool Valid;
+    std::map<unsigned int, std::string> Values;
+  };
+
+  typedef std::map<std::string, Entry> EntryMap;
+  EntryMap m_Entries;
+
+  // Path of the index file for this directory
+  std::string m_IndexFile;
+
+  // Whether there are changes that have not been saved
+  bool m_Modified;
+
+  static std::string m_IndexDirectory;
+
+  static bool GetFileStats(const std::string &file, unsigned long &size, long &mtime);
+
+  void Load();
+};
+
+#endif // DICOMHEADERINDEX_H
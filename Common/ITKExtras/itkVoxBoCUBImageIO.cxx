@@ -64,6 +64,7 @@ public:
   virtual unsigned char ReadByte() = 0;
   virtual void ReadData(void *data, unsigned long bytes) = 0;
   virtual void WriteData(const void *data, unsigned long bytes) = 0;
+  virtual long GetPosition() { return -1; }
 
   std::string ReadHeader()
     {
@@ -257,6 +258,11 @@ public:
       throw exception;
       }
     }
+
+  long GetPosition()
+    {
+    return m_File ? ::ftell(m_File) : -1;
+    }
 private:
   FILE *m_File;
 };
@@ -310,6 +316,7 @@ VoxBoCUBImageIO::VoxBoCUBImageIO()
   m_ByteOrder = BigEndian;
   m_Reader = NULL;
   m_Writer = NULL;
+  m_DataOffset = -1;
 }
 
 
@@ -452,6 +459,7 @@ void VoxBoCUBImageIO::ReadImageInformation()
 
   // Read the file header
   std::istringstream issHeader(m_Reader->ReadHeader());
+  m_DataOffset = m_Reader->GetPosition();
 
   // Read every string in the header. Parse the strings that are special
   while(issHeader.good())
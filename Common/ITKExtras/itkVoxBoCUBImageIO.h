@@ -85,6 +85,10 @@ public:
   /** Reads the data from disk into the memory buffer provided. */
   virtual void Read(void* buffer) ITK_OVERRIDE;
 
+  /** Offset of the image data in the file read by ReadImageInformation(),
+   * or -1 if the data can not be accessed directly (compressed file) */
+  long GetDataOffset() const { return m_DataOffset; }
+
   /*-------- This part of the interfaces deals with writing data. ----- */
 
   /** Determine the file type. Returns true if this ImageIO can write the
@@ -111,6 +115,7 @@ private:
   GenericCUBFileAdaptor *CreateReader(const char *filename);
   GenericCUBFileAdaptor *CreateWriter(const char *filename);
   GenericCUBFileAdaptor *m_Reader, *m_Writer;
+  long m_DataOffset;
 
   // Initialize the orientation map (from strings to ITK)
   void InitializeOrientationMap();
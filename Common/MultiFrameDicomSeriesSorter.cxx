@@ -10,6 +10,7 @@
 #include "gdcmIPPSorter.h"
 #include "itksys/SystemTools.hxx"
 #include "IRISException.h"
+#include "DicomHeaderIndex.h"
 
 using namespace MFDS;
 
@@ -23,32 +24,52 @@ const gdcm::Tag tagIOP(0x0020, 0x0037);
 //=========================================
 
 DicomFile
-::DicomFile(std::string &fn)
+::DicomFile(std::string &fn, DicomHeaderIndex *index)
 {
 	if (!itksys::SystemTools::FileExists(fn))
 		throw IRISException("File \"%s\" does not exist", fn.c_str());
 
 	this->m_Filename = fn;
-	std::set<gdcm::Tag> tags{tagInstanceNumber, tagSliceLocation, tagIPP};
-	gdcm::ImageReader reader;
-	reader.SetFileName(fn.c_str());
 
-	if (reader.ReadSelectedTags(tags))
+	// Tag values, in the order of the list below
+	DicomHeaderIndex::TagList tagList{tagIPP, tagSliceLocation, tagInstanceNumber};
+	DicomHeaderIndex::ValueList values;
+	bool valid = false;
+
+	// Use the header index if the file has not changed since it was indexed
+	if (!index || !index->Lookup(fn, tagList, valid, values))
+		{
+		std::set<gdcm::Tag> tags(tagList.begin(), tagList.end());
+		gdcm::ImageReader reader;
+		reader.SetFileName(fn.c_str());
+
+		valid = reader.ReadSelectedTags(tags);
+		values.resize(tagList.size());
+		if (valid)
+			{
+			gdcm::StringFilter strFilter;
+			strFilter.SetFile(reader.GetFile());
+			for (size_t i = 0; i < tagList.size(); ++i)
+				values[i] = strFilter.ToString(tagList[i]);
+			}
+
+		if (index)
+			index->Store(fn, tagList, valid, values);
+		}
+
+	if (valid)
 		{
-		gdcm::StringFilter strFilter;
-		strFilter.SetFile(reader.GetFile());
 		try
 			{
 			// parse IPP
-			std::string value = strFilter.ToString(tagIPP);
 			gdcm::Element<gdcm::VR::DS, gdcm::VM::VM3> eIPP;
-			std::stringstream ssipp (value);
+			std::stringstream ssipp (values[0]);
 			eIPP.Read(ssipp);
 			for (int i = 0; i < 3; ++i) m_IPP[i] = eIPP[i];
 
 			// parse other fields
-			this->m_SliceLocation = std::stod(strFilter.ToString(tagSliceLocation));
-			this->m_InstanceNumber = std::stoi(strFilter.ToString(tagInstanceNumber));
+			this->m_SliceLocation = std::stod(values[1]);
+			this->m_InstanceNumber = std::stoi(values[2]);
 			}
 		catch (std::exception &e)
 			{
@@ -166,9 +187,11 @@ MultiFrameDicomSeriesSorter
 	this->InvokeEvent(itk::StartEvent());
 	this->UpdateProgress(0.0);
 
-	// build dicom file list
+	// build dicom file list, using the header index of the series directory
+	DicomHeaderIndex index(itksys::SystemTools::GetParentDirectory(m_FilenamesList.front()));
 	for (auto &fn : m_FilenamesList)
-		m_DicomFilesList.push_back(DicomFile(fn));
+		m_DicomFilesList.push_back(DicomFile(fn, &index));
+	index.Save();
 
 	// apply grouping strat
 	m_GroupingStrat->SetInput(m_DicomFilesList);
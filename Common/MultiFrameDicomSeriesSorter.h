@@ -9,6 +9,8 @@
 #include "itkProcessObject.h"
 #include "itkObjectFactory.h"
 
+class DicomHeaderIndex;
+
 namespace MFDS //Multi-Frame Dicom Series
 {
 
@@ -17,7 +19,7 @@ struct DicomFile
   DicomFile()=delete; // default constructor should never be needed
   ~DicomFile() {}
 
-	DicomFile(std::string &fn); // only use this constructor
+	DicomFile(std::string &fn, DicomHeaderIndex *index = nullptr); // only use this constructor
   DicomFile(const DicomFile &other);
   DicomFile &operator=(const DicomFile &other);
 
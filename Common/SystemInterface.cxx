@@ -55,6 +55,7 @@
 #include "SNAPRegistryIO.h"
 #include "HistoryManager.h"
 #include "UIReporterDelegates.h"
+#include "DicomHeaderIndex.h"
 #include <itksys/Directory.hxx>
 #include <itksys/SystemTools.hxx>
 #include "itkVoxBoCUBImageIOFactory.h"
@@ -178,6 +179,11 @@ SystemInterface
 
   // Set the preferences file
   m_UserPreferenceFile = appdir + "/UserPreferences.xml";
+
+  // Keep the index of DICOM headers in the application data directory
+  std::string dicom_index_dir = appdir + "/DicomIndex";
+  if(itksys::SystemTools::MakeDirectory(dicom_index_dir.c_str()))
+    DicomHeaderIndex::SetIndexDirectory(dicom_index_dir);
 }
 
 SystemInterface
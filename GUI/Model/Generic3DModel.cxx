@@ -451,9 +451,9 @@ bool Generic3DModel::IntersectSegmentation(int vx, int vy, Vector3i &hit)
     RayCasterType caster;
     LabelImageHitTester tester(m_ParentUI->GetDriver()->GetColorLabelTable());
     caster.SetHitTester(tester);
-    result = caster.FindIntersection(
-          m_ParentUI->GetDriver()->GetSelectedSegmentationLayer()->GetImage(),
-          x_image, d_image, hit);
+    LabelImageWrapper *seg = m_ParentUI->GetDriver()->GetSelectedSegmentationLayer();
+    caster.SetOccupancyMap(seg->GetOccupancyMap());
+    result = caster.FindIntersection(seg->GetImage(), x_image, d_image, hit);
     }
 
   return (result == 1);
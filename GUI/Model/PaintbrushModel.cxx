@@ -11,9 +11,18 @@
 #include "itkGradientAnisotropicDiffusionImageFilter.h"
 #include "itkGradientMagnitudeImageFilter.h"
 #include "itkWatershedImageFilter.h"
+#include <map>
 
 
 // TODO: move this into a separate file!!!!
+/**
+ * Watershed segmentation of the image around the adaptive paintbrush. The
+ * watershed filter is run on a region somewhat larger than the brush, at the
+ * highest level, and the resulting basic segmentation and merge tree are
+ * kept. As long as the brush stays inside this region and the image does not
+ * change, the watersheds are reused. Changing the level only cuts the merge
+ * tree at a different saliency, without running the filter again.
+ */
 class BrushWatershedPipeline
 {
 public:
@@ -33,6 +42,13 @@ public:
     gmf->SetInput(adf->GetOutput());
     wf = WFType::New();
     wf->SetInput(gmf->GetOutput());
+
+    cachedGrey = NULL;
+    cachedMTime = 0;
+    cachedIter = 0;
+    cutValid = false;
+    cutLevel = 0.0;
+    centerRoot = 0;
     }
 
   void PrecomputeWatersheds(
@@ -44,14 +60,6 @@ public:
     {
     this->region = region;
 
-    // Get the offset of vcenter in the region
-    if(region.IsInside(vcenter))
-      for(size_t d = 0; d < 3; d++)
-        this->vcenter[d] = vcenter[d] - region.GetIndex()[d];
-    else
-      for(size_t d = 0; d < 3; d++)
-        this->vcenter[d] = region.GetSize()[d] / 2;
-
     // Create a backup of the label image
     LROIType::Pointer lroi = LROIType::New();
     lroi->SetInput(label);
@@ -60,29 +68,97 @@ public:
     lsrc = lroi->GetOutput();
     lsrc->DisconnectPipeline();
 
-    // Initialize the watershed pipeline
-    roi->SetInput(grey);
-    roi->SetRegionOfInterest(region);
-    adf->SetNumberOfIterations(smoothing_iter);
+    // Find out if the grey image has changed since the watersheds were computed
+    GreyImageType *grey_nc = const_cast<GreyImageType *>(grey);
+    grey_nc->UpdateOutputInformation();
+    itk::ModifiedTimeType mtime = std::max(grey->GetMTime(), grey->GetPipelineMTime());
+
+    if(grey != cachedGrey || mtime != cachedMTime || smoothing_iter != cachedIter
+       || !cachedRegion.IsInside(region))
+      {
+      // Pad the region in the directions in which the brush extends, so that
+      // the watersheds can be reused when the brush moves a little
+      itk::ImageRegion<3> padded = region;
+      for(size_t d = 0; d < 3; d++)
+        {
+        if(region.GetSize()[d] > 1)
+          {
+          long pad = std::max(2l, (long) region.GetSize()[d] / 4);
+          padded.SetIndex(d, region.GetIndex()[d] - pad);
+          padded.SetSize(d, region.GetSize()[d] + 2 * pad);
+          }
+        }
+      padded.Crop(grey->GetLargestPossibleRegion());
+
+      // Initialize the watershed pipeline
+      roi->SetInput(grey);
+      roi->SetRegionOfInterest(padded);
+      adf->SetNumberOfIterations(smoothing_iter);
+
+      // Set the level to highest possible - to get the whole merge tree
+      wf->SetLevel(1.0);
+      wf->Update();
+
+      cachedGrey = grey;
+      cachedMTime = mtime;
+      cachedIter = smoothing_iter;
+      cachedRegion = padded;
+      merged.clear();
+      cutValid = false;
+      }
 
-    // Set the initial level to lowest possible - to get all watersheds
-    wf->SetLevel(1.0);
-    wf->Update();
+    // Get the offset of vcenter in the region
+    itk::Index<3> vc;
+    if(region.IsInside(vcenter))
+      vc = vcenter;
+    else
+      for(size_t d = 0; d < 3; d++)
+        vc[d] = region.GetIndex()[d] + region.GetSize()[d] / 2;
+
+    for(size_t d = 0; d < 3; d++)
+      this->vcenter[d] = vc[d] - cachedRegion.GetIndex()[d];
+
+    if(cutValid)
+      centerRoot = this->FindRoot(wf->GetBasicSegmentation()->GetPixel(this->vcenter));
     }
 
   void RecomputeWatersheds(double level)
     {
-    // Reupdate the filter with new level
-    wf->SetLevel(level);
-    wf->Update();
+    if(cutValid && level == cutLevel)
+      return;
+
+    // Cut the merge tree: segments merged below the level are equivalent. As
+    // in itk::watershed::Relabeler, the level is relative to the saliency of
+    // the last merge in the tree
+    merged.clear();
+    WFType::SegmentTreeType *tree = wf->GetSegmentTree();
+    if(!tree->Empty())
+      {
+      double limit = level * tree->Back().saliency;
+      for(WFType::SegmentTreeType::Iterator it = tree->Begin(); it != tree->End(); ++it)
+        {
+        if(it->saliency > limit)
+          break;
+
+        itk::IdentifierType a = this->FindRoot(it->from), b = this->FindRoot(it->to);
+        if(a != b)
+          merged[a] = b;
+        }
+      }
+
+    cutValid = true;
+    cutLevel = level;
+    centerRoot = this->FindRoot(wf->GetBasicSegmentation()->GetPixel(vcenter));
     }
 
   bool IsPixelInSegmentation(IndexType idx)
     {
-    // Get the watershed ID at the center voxel
-    unsigned long wctr = wf->GetOutput()->GetPixel(vcenter);
-    unsigned long widx = wf->GetOutput()->GetPixel(idx);
-    return wctr == widx;
+    // The index is relative to the brush region
+    for(size_t d = 0; d < 3; d++)
+      idx[d] += region.GetIndex()[d] - cachedRegion.GetIndex()[d];
+
+    // Compare to the watershed at the center voxel
+    return this->FindRoot(wf->GetBasicSegmentation()->GetPixel(idx)) == centerRoot;
     }
 
 private:
@@ -92,6 +168,22 @@ private:
   typedef itk::GradientMagnitudeImageFilter<FloatImageType, FloatImageType> GMFType;
   typedef itk::WatershedImageFilter<FloatImageType> WFType;
 
+  // Follow the merges of a basic segment, compressing the path
+  itk::IdentifierType FindRoot(itk::IdentifierType id)
+    {
+    itk::IdentifierType root = id;
+    std::map<itk::IdentifierType, itk::IdentifierType>::iterator it;
+    while((it = merged.find(root)) != merged.end())
+      root = it->second;
+
+    while((it = merged.find(id)) != merged.end() && it->second != root)
+      {
+      id = it->second;
+      it->second = root;
+      }
+    return root;
+    }
+
   ROIType::Pointer roi;
   ADFType::Pointer adf;
   GMFType::Pointer gmf;
@@ -100,6 +192,18 @@ private:
   itk::ImageRegion<3> region;
   LabelImageType::Pointer lsrc;
   itk::Index<3> vcenter;
+
+  // Image and parameters for which the watersheds were computed
+  const GreyImageType *cachedGrey;
+  itk::ModifiedTimeType cachedMTime;
+  size_t cachedIter;
+  itk::ImageRegion<3> cachedRegion;
+
+  // Merges applied at the current level, and the segment of the center voxel
+  std::map<itk::IdentifierType, itk::IdentifierType> merged;
+  bool cutValid;
+  double cutLevel;
+  itk::IdentifierType centerRoot;
 };
 
 
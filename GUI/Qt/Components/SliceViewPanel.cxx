@@ -33,6 +33,7 @@
 #include <QCursor>
 #include <QBitmap>
 #include <QToolButton>
+#include <QTimer>
 #include "AnnotationEditDialog.h"
 #include <vtkRenderWindow.h>
 
@@ -200,6 +201,13 @@ SliceViewPanel::SliceViewPanel(QWidget *parent) :
   m_ContextToolButton->setMaximumSize(QSize(16,16));
   m_ContextToolButton->setPopupMode(QToolButton::InstantPopup);
   m_ContextToolButton->setStyleSheet("QToolButton::menu-indicator { image: none; }");
+
+  // Slices ahead of the cursor are prefetched one at a time, once the
+  // event queue is empty, so that prefetching never delays interaction
+  m_PrefetchTimer = new QTimer(this);
+  m_PrefetchTimer->setSingleShot(true);
+  m_PrefetchTimer->setInterval(0);
+  connect(m_PrefetchTimer, SIGNAL(timeout()), SLOT(onPrefetchTimeout()));
 }
 
 SliceViewPanel::~SliceViewPanel()
@@ -349,6 +357,27 @@ void SliceViewPanel::onModelUpdate(const EventBucket &eb)
   // this is causing crash on Linux
   // ui->sliceView->GetRenderWindow()->Render();
   ui->sliceView->update();
+
+  // Start prefetching slices in the direction the cursor is moving
+  if(eb.HasEvent(CursorUpdateEvent()))
+    m_PrefetchTimer->start();
+}
+
+void SliceViewPanel::onPrefetchTimeout()
+{
+  if(!m_GlobalUI || !m_GlobalUI->GetDriver()->IsMainImageLoaded())
+    return;
+
+  // Prefetch one slice for each layer, and come back if there are more
+  bool more = false;
+  for(LayerIterator it = m_GlobalUI->GetDriver()->GetCurrentImageData()->GetLayers();
+      !it.IsAtEnd(); ++it)
+    {
+    more |= it.GetLayer()->PrefetchDisplaySlice(m_Index);
+    }
+
+  if(more)
+    m_PrefetchTimer->start();
 }
 
 void SliceViewPanel::on_inSlicePosition_valueChanged(int value)
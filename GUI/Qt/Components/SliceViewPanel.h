@@ -13,6 +13,7 @@ class DeformationGridRenderer;
 class GenericSliceModel;
 class QCursor;
 class QToolButton;
+class QTimer;
 
 class CrosshairsInteractionMode;
 class ThumbnailInteractionMode;
@@ -86,6 +87,8 @@ private slots:
 
   void on_actionAnnotationPrevious_triggered();
 
+  void onPrefetchTimeout();
+
 private:
   Ui::SliceViewPanel *ui;
 
@@ -125,6 +128,9 @@ private:
   // Index of the panel
   unsigned int m_Index;
 
+  // Timer used to prefetch display slices while the application is idle
+  QTimer *m_PrefetchTimer;
+
   void SetActiveMode(QWidget *mode, bool clearChildren = true);
 
   /**
@@ -185,6 +185,7 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
   // Hook up the mesh options
   MeshOptions *mo = m_Model->GetMeshOptions();
 
+  makeCoupling(ui->chkDiscreteMarchingCubes, mo->GetUseDiscreteMarchingCubesModel());
   makeCoupling(ui->chkGaussianSmooth, mo->GetUseGaussianSmoothingModel());
   makeCoupling(ui->inGaussianSmoothDeviation, mo->GetGaussianStandardDeviationModel());
   makeCoupling(ui->inGaussianSmoothMaxError, mo->GetGaussianErrorModel());
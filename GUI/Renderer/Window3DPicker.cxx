@@ -84,6 +84,7 @@ double Window3DPicker::IntersectWithLine(
     Finder finder;
     LabelImageHitTester tester(app->GetColorLabelTable());
     finder.SetHitTester(tester);
+    finder.SetOccupancyMap(layer->GetOccupancyMap());
 
     result = finder.FindIntersection(layer->GetImage(), x0, x1 - x0, pos);
     }
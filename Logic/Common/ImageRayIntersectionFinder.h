@@ -38,17 +38,24 @@
 #include "SNAPCommon.h"
 #include <vnl/vnl_matrix_fixed.h>
 
+class LabelOccupancyMap;
+
 /**
  * \class ImageRayIntersectionFinder
  * \brief An algorithm for testing ray hits against arbitrary images.
  * This algorithm traverses a ray until it finds a pixel that satisfies the
  * hit tester (a functor with operator () which returns 0 for no-hit and
  * 1 for hit).
+ *
+ * When casting rays into a segmentation image, an occupancy map can be
+ * supplied. Bricks of the image that contain only the clear label are then
+ * passed over in one step, unless the hit tester accepts the clear label.
  */
 template <class TImage, class THitTester>
 class ImageRayIntersectionFinder
 {
 public:
+    ImageRayIntersectionFinder() : m_OccupancyMap(NULL) {}
     virtual ~ImageRayIntersectionFinder() {}
   /** Image type */
   typedef TImage ImageType;
@@ -56,6 +63,9 @@ public:
   /** Set the hit-test functor to evaluate for hits */
   irisSetMacro(HitTester,THitTester);
 
+  /** Set the occupancy map of the image (optional) */
+  irisSetMacro(OccupancyMap,const LabelOccupancyMap *);
+
   /**
    * Compute the intersection (index of the first pixel in the
    * image that the ray crosses and which satisfies the THitTester's
@@ -69,6 +79,9 @@ public:
 private:
   /** The hit tester used internally */
   THitTester m_HitTester;
+
+  /** Map used to pass over empty bricks, may be NULL */
+  const LabelOccupancyMap *m_OccupancyMap;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -34,6 +34,7 @@
 =========================================================================*/
 
 #include "itkImage.h"
+#include "LabelOccupancyMap.h"
 
 template <class TImage, class THitTester>
 int
@@ -45,9 +46,6 @@ ImageRayIntersectionFinder<TImage, THitTester>
   typename ImageType::SizeType size =
     image->GetLargestPossibleRegion().GetSize();
 
-  double delta[3][3] = {{0.,0.,0.},{0.,0.,0.},{0.,0.,0.}}, dratio[3]={0.,0.,0.};
-  int    signrx, signry, signrz;
-
   double rayLen = ray.two_norm();
   if(rayLen == 0)
     return -1;
@@ -55,13 +53,6 @@ ImageRayIntersectionFinder<TImage, THitTester>
 
   double rx = ray[0];double ry = ray[1];double rz = ray[2];
 
-  if (rx >=0) signrx = 1;
-  else signrx = -1;
-  if (ry >=0) signry = 1;
-  else signry = -1;
-  if (rz >=0) signrz = 1;
-  else signrz = -1;
-
   // offset everything by (.5, .5) [becuz samples are at center of voxels]
   // this offset will put borders of voxels at integer values
   // we will work with this offset grid and offset back to check samples
@@ -83,26 +74,29 @@ ImageRayIntersectionFinder<TImage, THitTester>
     }
   if (c >= 9999) return -1;
 
-  // walk along ray to find intersection with any voxel with val > 0
-  while ( (px >= 0 && px < size[0]&&
-           py >= 0 && py < size[1] &&
-           pz >= 0 && pz < size[2]) )
+  // Empty bricks can only be passed over if the clear label is not a hit
+  const LabelOccupancyMap *occupancy =
+      (m_OccupancyMap && !m_HitTester(0)) ? m_OccupancyMap : NULL;
+
+  // Walk along the ray through each voxel it crosses, to find the first
+  // voxel that is a hit
+  double start[3] = { px, py, pz }, dir[3] = { rx, ry, rz };
+  VoxelRayWalker walker(start, dir);
+  const long *idx = walker.GetIndex();
+  while(idx[0] >= 0 && idx[0] < (long) size[0] &&
+        idx[1] >= 0 && idx[1] < (long) size[1] &&
+        idx[2] >= 0 && idx[2] < (long) size[2])
     {
+    // Empty bricks are passed over without looking up their voxels
+    if(occupancy && occupancy->SkipEmptySpace(walker))
+      continue;
 
-    // offset point by (-.5, -.5) [to account for earlier offset] and
-    // get the nearest sample voxel within unit cube around (px,py,pz)
-    //    lx = my_round(px-0.5);
-    //    ly = my_round(py-0.5);
-    //    lz = my_round(pz-0.5);
-    lIndex[0] = (int)px;
-    lIndex[1] = (int)py;
-    lIndex[2] = (int)pz;
-
-    // Get the pixel
-    typename ImageType::PixelType hitPixel = image->GetPixel(lIndex);
+    lIndex[0] = idx[0];
+    lIndex[1] = idx[1];
+    lIndex[2] = idx[2];
 
     // Test if the pixel is a hit
-    if(m_HitTester(hitPixel))
+    if(m_HitTester(image->GetPixel(lIndex)))
       {
       hit[0] = lIndex[0];
       hit[1] = lIndex[1];
@@ -110,69 +104,8 @@ ImageRayIntersectionFinder<TImage, THitTester>
       return 1;
       }
 
-    // BEGIN : walk along ray to border of next voxel touched by ray
-
-    // compute path to YZ-plane surface of next voxel
-    if (rx == 0)
-      { // ray is parallel to 0 axis
-      delta[0][0] = 9999;
-      }
-    else
-      {
-      delta[0][0] = (int)(px+signrx) - px;
-      }
-
-    // compute path to XZ-plane surface of next voxel
-    if (ry == 0)
-      { // ray is parallel to 1 axis
-      delta[1][0] = 9999;
-      }
-    else
-      {
-      delta[1][1] = (int)(py+signry) - py;
-      dratio[1]   = delta[1][1]/ry;
-      delta[1][0] = dratio[1] * rx;
-      }
-
-    // compute path to XY-plane surface of next voxel
-    if (rz == 0)
-      { // ray is parallel to 2 axis
-      delta[2][0] = 9999;
-      }
-    else
-      {
-      delta[2][2] = (int)(pz+signrz) - pz;
-      dratio[2]   = delta[2][2]/rz;
-      delta[2][0] = dratio[2] * rx;
-      }
-
-    // choose the shortest path
-    if ( fabs(delta[0][0]) <= fabs(delta[1][0]) && fabs(delta[0][0]) <= fabs(delta[2][0]) )
-      {
-      dratio[0]   = delta[0][0]/rx;
-      delta[0][1] = dratio[0] * ry;
-      delta[0][2] = dratio[0] * rz;
-      px += delta[0][0];
-      py += delta[0][1];
-      pz += delta[0][2];
-      }
-    else if ( fabs(delta[1][0]) <= fabs(delta[0][0]) && fabs(delta[1][0]) <= fabs(delta[2][0]) )
-      {
-      delta[1][2] = dratio[1] * rz;
-      px += delta[1][0];
-      py += delta[1][1];
-      pz += delta[1][2];
-      }
-    else
-      { //if (fabs(delta[2][0] <= fabs(delta[0][0] && fabs(delta[2][0] <= fabs(delta[0][0])
-      delta[2][1] = dratio[2] * ry;
-      px += delta[2][0];
-      py += delta[2][1];
-      pz += delta[2][2];
-      }
-    // END : walk along ray to border of next voxel touched by ray
-
-    } // while ( (px
+    walker.Step();
+    }
   return 0;
 }
 
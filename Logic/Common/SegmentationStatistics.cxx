@@ -36,15 +36,21 @@
 #include "GenericImageData.h"
 #include "IRISApplication.h"
 #include "ImageCollectionToImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMultiThreaderBase.h"
 
 #include <iostream>
 #include <iomanip>
+#include <mutex>
 
 
 using namespace std;
 
+// Types used to walk the run-length encoded scanlines of the segmentation
+typedef LabelImageWrapper::ImageType LabelImageType;
+typedef LabelImageType::BufferType LabelBufferType;
+typedef itk::ImageRegionConstIteratorWithIndex<LabelBufferType> LineIterator;
 
-// TODO: improve efficiency by using filters to integrate label intensities
 void
 SegmentationStatistics
 ::Compute(IRISApplication *app)
@@ -92,40 +98,69 @@ SegmentationStatistics
   // Clear and initialize the statistics table
   m_Stats.clear();
 
-  // Start the label image iteration
-  LabelImageWrapper::ConstIterator itLabel = seg->GetImageConstIterator();
-  itk::ImageRegion<3> region = itLabel.GetRegion();
+  // The label image is run-length encoded, so rather than visiting every
+  // voxel, we walk the runs in each scanline and pass whole runs on to the
+  // intensity layers. Scanlines are processed in parallel, each thread
+  // accumulating statistics in its own table that is merged at the end.
+  const LabelImageType *label = seg->GetImage();
+  LabelBufferType *buffer = label->GetBuffer();
+  itk::ImageRegion<3> region = label->GetBufferedRegion();
 
-  // Cache the entry to avoid many calls to std::map
-  LabelType runLabel = 0;
-  Entry *cachedEntry = &m_Stats[runLabel];
-  cachedEntry->resize(ngray);
-  itk::Index<3> runStart = itLabel.GetIndex();
-  long runLength = 0;
+  // Entry for the clear label is always present in the table
+  m_Stats[0].resize(ngray);
 
-  // Aggregate the statistical data
-  for( ; !itLabel.IsAtEnd(); ++itLabel, ++runLength)
+  // A mutex to control updating the main statistics table
+  std::mutex stats_mutex;
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeImageRegion<2>(
+        buffer->GetBufferedRegion(),
+        [this, buffer, region, ngray, &layers, &stats_mutex](const itk::ImageRegion<2> &lines)
     {
-    // Get the label and the corresponding entry (use cache to reduce time wasted in std::map)
-    LabelType label = itLabel.Value();
-    if(label != runLabel)
-      {
-      // Record the statistics from the last run
-      this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+    // Thread-local statistics table
+    EntryMap local_stats;
 
-      // Change the cached entry
-      runLabel = label;
-      cachedEntry = &m_Stats[runLabel];
-      if(cachedEntry->count == 0)
-        cachedEntry->resize(ngray);
+    // Cache the entry to avoid many calls to std::map
+    LabelType runLabel = 0;
+    Entry *cachedEntry = NULL;
 
-      runStart = itLabel.GetIndex();
-      runLength = 0;
+    itk::ImageRegion<3> local_region = region;
+    for(LineIterator itLine(buffer, lines); !itLine.IsAtEnd(); ++itLine)
+      {
+      // Index of the first voxel in the scanline
+      itk::Index<3> runStart;
+      runStart[0] = local_region.GetIndex(0);
+      runStart[1] = itLine.GetIndex()[0];
+      runStart[2] = itLine.GetIndex()[1];
+
+      const LabelImageType::RLLine &line = itLine.Get();
+      for(size_t i = 0; i < line.size(); i++)
+        {
+        if(!cachedEntry || line[i].second != runLabel)
+          {
+          runLabel = line[i].second;
+          cachedEntry = &local_stats[runLabel];
+          if(cachedEntry->count == 0)
+            cachedEntry->resize(ngray);
+          }
+
+        this->RecordRunLength(ngray, layers, local_region, runStart, line[i].first, cachedEntry);
+        runStart[0] += line[i].first;
+        }
       }
-    }
 
-  // Record the statistics from the last run
-  this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+    // In a reentrant block, update the main statistics table
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    for(EntryMap::const_iterator it = local_stats.begin(); it != local_stats.end(); ++it)
+      {
+      Entry &entry = m_Stats[it->first];
+      if(entry.count == 0)
+        entry.resize(ngray);
+      entry.count += it->second.count;
+      entry.sum += it->second.sum;
+      entry.sumsq += it->second.sumsq;
+      }
+    }, nullptr);
 
   // Compute the size of a voxel, in mm^3
   const double *spacing = 
@@ -175,32 +210,10 @@ void SegmentationStatistics
   // Get selected segmentation layer
   LabelImageWrapper *liw = app->GetSelectedSegmentationLayer();
 
-  // Get the iterator from the segmentation
-  LabelImageWrapper::ConstIterator it = liw->GetImageConstIterator();
-
-  // Iterate through image and update count
-  LabelType runLabel = 0;
-  unsigned long *cachedCnt = &result[runLabel];
-  unsigned long runLength = 0;
-
-  // Start counting
-  for (; !it.IsAtEnd(); ++it, ++runLength)
-    {
-      LabelType label = it.Value();
-      if (label != runLabel)
-        {
-          // std::cout << "run length: " << runLength << endl;
-          *cachedCnt += runLength;
-
-          // Reset for new count
-          runLabel = label;
-          cachedCnt = &result[runLabel];
-          runLength = 0;
-        }
-    }
-
-  // Add last run Length
-  *cachedCnt += runLength;
+  // The label counts are maintained by the segmentation layer
+  const LabelImageWrapper::LabelCountMap &counts = liw->GetLabelCounts();
+  for(LabelImageWrapper::LabelCountMap::const_iterator it = counts.begin(); it != counts.end(); ++it)
+    result[it->first] += it->second;
 
   // Debug
   /*
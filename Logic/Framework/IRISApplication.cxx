@@ -89,10 +89,12 @@
 #include "ImageMeshLayers.h"
 #include "StandaloneMeshWrapper.h"
 #include "AllPurposeProgressAccumulator.h"
+#include "itkMultiThreaderBase.h"
 
 #include <stdio.h>
 #include <sstream>
 #include <iomanip>
+#include <cmath>
 
 IRISApplication
 ::IRISApplication() 
@@ -555,6 +557,93 @@ IRISApplication
   return iTarget;
 }
 
+/**
+ * Relabel runs of voxels in a run-length encoded line of the segmentation.
+ * The runs [first, second) are given relative to the start of the line, and
+ * must be sorted, disjoint and lie within [x0, x1). Voxels in the runs whose
+ * label passes the test are assigned new_label. The change to the range
+ * [x0, x1) of the line is appended to the undo delta, and the changes in the
+ * label counts are recorded. Returns the number of voxels changed.
+ */
+template <class TLabelTest>
+static unsigned long
+RelabelScanlineRuns(LabelImageWrapper::ImageType::RLLine &line,
+                    const std::vector<std::pair<long, long> > &runs,
+                    long x0, long x1, LabelType new_label, TLabelTest test,
+                    LabelImageWrapper::UndoManagerDelta &delta,
+                    LabelImageWrapper::LabelCountDelta &count_delta,
+                    LabelImageWrapper::ImageType::RLLine &work)
+{
+  typedef LabelImageWrapper::ImageType::RLSegment RLSegment;
+
+  // Nothing to paint on this line
+  if(runs.empty())
+    {
+    delta.Encode(0, x1 - x0);
+    return 0;
+    }
+
+  // Rebuild the line, splitting its segments at the ends of the range and
+  // of the runs, and merging adjacent segments with the same value
+  work.clear();
+  work.reserve(line.size() + 2 * runs.size());
+  unsigned long changed = 0;
+  size_t r = 0;
+  long pos = 0;
+  for(size_t s = 0; s < line.size(); s++)
+    {
+    LabelType value = line[s].second;
+    long a = pos, seg_end = pos + line[s].first;
+    pos = seg_end;
+    while(a < seg_end)
+      {
+      long b = seg_end;
+      bool in_run = false;
+      if(a < x0)
+        {
+        b = std::min(seg_end, x0);
+        }
+      else if(a < x1)
+        {
+        b = std::min(seg_end, x1);
+        while(r < runs.size() && runs[r].second <= a)
+          ++r;
+        if(r < runs.size() && runs[r].first <= a)
+          {
+          in_run = true;
+          b = std::min(b, runs[r].second);
+          }
+        else if(r < runs.size())
+          {
+          b = std::min(b, runs[r].first);
+          }
+        }
+
+      LabelType new_value = (in_run && test(value)) ? new_label : value;
+      if(new_value != value)
+        {
+        changed += b - a;
+        count_delta[value] -= b - a;
+        count_delta[new_value] += b - a;
+        }
+
+      if(a >= x0 && a < x1)
+        delta.Encode(static_cast<LabelType>(new_value - value), b - a);
+
+      if(work.size() && work.back().second == new_value)
+        work.back().first += b - a;
+      else
+        work.push_back(RLSegment(b - a, new_value));
+      a = b;
+      }
+    }
+
+  if(changed)
+    line.swap(work);
+
+  return changed;
+}
+
 unsigned int
 IRISApplication
 ::UpdateSegmentationWithSliceDrawing(
@@ -607,46 +696,92 @@ IRISApplication
   r_vol.SetUpperIndex(to_itkIndex(pos_max));
   r_vol.Crop(this->GetSelectedSegmentationLayer()->GetBufferedRegion());
 
-  // Create an iterator for painting
-  SegmentationUpdateIterator itVol(this->GetSelectedSegmentationLayer(), r_vol,
-                                   m_GlobalState->GetDrawingColorLabel(),
-                                   m_GlobalState->GetDrawOverFilter());
-
   // Drawing parameters
   bool invert = m_GlobalState->GetPolygonInvert();
+  LabelType active = m_GlobalState->GetDrawingColorLabel();
+  DrawOverFilter draw_over = m_GlobalState->GetDrawOverFilter();
+
+  // Same test as SegmentationUpdateIterator::PaintAsForeground
+  auto paint_test = [active, &draw_over](LabelType value)
+    {
+    return value != active &&
+        (draw_over.CoverageMode == PAINT_OVER_ALL ||
+         (draw_over.CoverageMode == PAINT_OVER_ONE && value == draw_over.DrawOverLabel) ||
+         (draw_over.CoverageMode == PAINT_OVER_VISIBLE && value != 0));
+    };
 
   // Inverse transform
   ImageCoordinateTransform::Pointer xfmImageToSlice = ImageCoordinateTransform::New();
   xfmSliceToImage->ComputeInverse(xfmImageToSlice);
 
-  // Iterate over the volume region
-  for(; !itVol.IsAtEnd(); ++itVol)
-    {
-    // Find the coordinate of the voxel in the slice
-    itk::Index<3> idx_vol = itVol.GetIndex();
-    Vector3d x_slice = xfmImageToSlice->TransformPoint(
-                         Vector3d(idx_vol[0] + 0.5, idx_vol[1] + 0.5, idx_vol[2] + 0.5));
-    itk::Index<2> idx_slice;
-    idx_slice[0] = (int) x_slice[0];
-    idx_slice[1] = (int) x_slice[1];
+  // The transform only permutes and flips the axes, so along each scanline
+  // of the segmentation the slice coordinates change by a fixed step. Each
+  // scanline is turned into runs of drawn voxels, which are then painted
+  // into the run-length encoded line as a whole.
+  Vector3d step = xfmImageToSlice->TransformVector(Vector3d(1.0, 0.0, 0.0));
+
+  LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
+  LabelImageType *image = seg->GetModifiableImage();
+  LabelImageType::BufferType *buffer = image->GetBuffer();
+  long xb = image->GetBufferedRegion().GetIndex(0);
+  long x0 = r_vol.GetIndex(0) - xb, x1 = x0 + (long) r_vol.GetSize(0);
+
+  LabelImageWrapper::UndoManagerDelta *delta = new LabelImageWrapper::UndoManagerDelta();
+  delta->SetRegion(r_vol);
+  LabelImageWrapper::LabelCountDelta count_delta;
+  unsigned long n_changed = 0;
+
+  std::vector<std::pair<long, long> > runs;
+  LabelImageType::RLLine work;
+  LabelImageType::BufferType::IndexType line_index;
+  for(long z = r_vol.GetIndex(2); z < r_vol.GetIndex(2) + (long) r_vol.GetSize(2); z++)
+    {
+    line_index[1] = z;
+    for(long y = r_vol.GetIndex(1); y < r_vol.GetIndex(1) + (long) r_vol.GetSize(1); y++)
+      {
+      line_index[0] = y;
 
-    // Check value
-    SliceBinaryImageType::PixelType px = drawing->GetPixel(idx_slice);
-    if((px != 0) ^ invert)
-      itVol.PaintAsForeground();
+      // Find the runs of voxels on this line that are drawn
+      Vector3d x_slice = xfmImageToSlice->TransformPoint(
+                           Vector3d(xb + x0 + 0.5, y + 0.5, z + 0.5));
+      runs.clear();
+      for(long x = x0; x < x1; x++, x_slice += step)
+        {
+        itk::Index<2> idx_slice;
+        idx_slice[0] = (int) x_slice[0];
+        idx_slice[1] = (int) x_slice[1];
 
+        if((drawing->GetPixel(idx_slice) != 0) ^ invert)
+          {
+          if(runs.size() && runs.back().second == x)
+            runs.back().second++;
+          else
+            runs.push_back(std::make_pair(x, x + 1));
+          }
+        }
 
+      n_changed += RelabelScanlineRuns(
+            buffer->GetPixel(line_index), runs, x0, x1, active, paint_test,
+            *delta, count_delta, work);
+      }
     }
+  delta->FinishEncoding();
 
   // Finalize
-  if(itVol.Finalize(undoTitle.c_str()))
+  if(n_changed > 0)
     {
     // Voxels were updated
+    seg->PixelsModified(count_delta);
+    seg->StoreUndoPoint(undoTitle.c_str(), delta);
     this->RecordCurrentLabelUse();
     InvokeEvent(SegmentationChangeEvent());
     }
+  else
+    {
+    delete delta;
+    }
 
-  return itVol.GetNumberOfChangedVoxels();
+  return n_changed;
 }
 
 void 
@@ -1200,8 +1335,6 @@ IRISApplication
   return it.GetNumberOfChangedVoxels();
 }
 
-// TODO: This information should be cached at the segmentation layer level
-// by keeping track of label counts after every update operation.
 size_t
 IRISApplication
 ::GetNumberOfVoxelsWithLabel(LabelType label)
@@ -1209,20 +1342,12 @@ IRISApplication
   // Number of voxels matching current label
   size_t nvoxels = 0;
 
-  // We must iterate over all the label images
+  // The label counts are maintained by each of the label images
   for(LayerIterator it = this->GetCurrentImageData()->GetLayers(LABEL_ROLE);
       !it.IsAtEnd(); ++it)
     {
     LabelImageWrapper *wrapper = dynamic_cast<LabelImageWrapper *>(it.GetLayer());
-    const LabelImageType *seg = wrapper->GetImage();
-
-    // Get the number of voxels
-    for(LabelImageWrapper::ConstIterator it(seg, seg->GetBufferedRegion());
-        !it.IsAtEnd(); ++it)
-      {
-      if(it.Get() == label)
-        ++nvoxels;
-      }
+    nvoxels += wrapper->GetNumberOfVoxelsWithLabel(label);
     }
 
   return nvoxels;
@@ -1233,46 +1358,143 @@ int
 IRISApplication
 ::RelabelSegmentationWithCutPlane(const Vector3d &normal, double intercept) 
 {
+  typedef LabelImageType::BufferType BufferType;
+  typedef LabelImageType::RLLine RLLine;
+  typedef LabelImageWrapper::UndoManagerDelta UndoDelta;
+
   // Get the label image
   LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
-  
-  // Create the smart target iterator
-  SegmentationUpdateIterator it(
-        seg, seg->GetBufferedRegion(),
-        m_GlobalState->GetDrawingColorLabel(), m_GlobalState->GetDrawOverFilter());
+  LabelImageType *image = seg->GetModifiableImage();
+  BufferType *buffer = image->GetBuffer();
+  const itk::ImageRegion<3> &region = image->GetBufferedRegion();
+
+  LabelType active = m_GlobalState->GetDrawingColorLabel();
+  DrawOverFilter draw_over = m_GlobalState->GetDrawOverFilter();
 
   // Adjust the intercept by 0.5 for voxel offset
   intercept -= 0.5 * (normal[0] + normal[1] + normal[2]);
 
-  // Iterate over the image, relabeling labels on one side of the plane
-  while(!it.IsAtEnd())
+  // Signed distance to the plane, voxels with positive distance are relabeled
+  auto distance = [&normal, intercept](long x, long y, long z)
+    { return x*normal[0] + y*normal[1] + z*normal[2] - intercept; };
+
+  // Along each scanline the positive side of the plane is a single range of
+  // x, which is computed directly. The estimate is corrected by evaluating
+  // the distance at the boundary, so that the result is the same as testing
+  // each voxel.
+  long xb = region.GetIndex(0), xe = xb + (long) region.GetSize(0);
+  auto positive_range = [&](long y, long z, long &x0, long &x1)
     {
-    // Compute the distance to the plane
-    itk::Index<3> index = it.GetIndex();
-    double distance = 
-      index[0]*normal[0] + 
-      index[1]*normal[1] + 
-      index[2]*normal[2] - intercept;
+    if(normal[0] == 0.0)
+      {
+      x0 = xb; x1 = distance(xb, y, z) > 0 ? xe : xb;
+      return;
+      }
 
-    // Check the side of the plane
-    if(distance > 0)
-      it.PaintAsForegroundPreserveClear();
+    // Position where the scanline crosses the plane
+    double t = (intercept - y*normal[1] - z*normal[2]) / normal[0];
+    t = std::max((double) xb - 1.0, std::min((double) xe + 1.0, t));
+    if(normal[0] > 0)
+      {
+      x0 = std::max(xb, std::min(xe, (long) std::floor(t) + 1)); x1 = xe;
+      while(x0 > xb && distance(x0 - 1, y, z) > 0) x0--;
+      while(x0 < xe && !(distance(x0, y, z) > 0)) x0++;
+      }
+    else
+      {
+      x0 = xb; x1 = std::max(xb, std::min(xe, (long) std::ceil(t)));
+      while(x1 < xe && distance(x1, y, z) > 0) x1++;
+      while(x1 > xb && !(distance(x1 - 1, y, z) > 0)) x1--;
+      }
+    };
+
+  // Same test as SegmentationUpdateIterator::PaintAsForegroundPreserveClear
+  auto relabel = [active, &draw_over](LabelType value)
+    {
+    if(value == 0 || value == active)
+      return false;
+    return draw_over.CoverageMode == PAINT_OVER_ALL
+        || draw_over.CoverageMode == PAINT_OVER_VISIBLE
+        || (draw_over.CoverageMode == PAINT_OVER_ONE && value == draw_over.DrawOverLabel);
+    };
+
+  // The volume is processed in z-slabs in parallel. Each slab produces its
+  // own undo delta and label count changes, which are merged afterwards
+  long nz = (long) region.GetSize(2), ny = (long) region.GetSize(1);
+  long width = (long) region.GetSize(0);
+  long n_slabs = std::min(nz, (long) std::max(
+                            itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(), 1u) * 4);
+
+  struct SlabResult
+  {
+    SlabResult() : Changed(0) {}
+    UndoDelta Delta;
+    LabelImageWrapper::LabelCountDelta CountDelta;
+    unsigned long Changed;
+  };
+  std::vector<SlabResult> slabs(std::max(n_slabs, 0l));
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, n_slabs, [&](itk::SizeValueType i_slab)
+    {
+    SlabResult &res = slabs[i_slab];
+    long z_first = region.GetIndex(2) + (nz * (long) i_slab) / n_slabs;
+    long z_last = region.GetIndex(2) + (nz * ((long) i_slab + 1)) / n_slabs;
+
+    std::vector<std::pair<long, long> > runs;
+    RLLine work;
+    BufferType::IndexType line_index;
+    for(long z = z_first; z < z_last; z++)
+      {
+      line_index[1] = z;
+      for(long y = region.GetIndex(1); y < region.GetIndex(1) + ny; y++)
+        {
+        // Lines that do not reach the positive side of the plane are skipped
+        long x0, x1;
+        positive_range(y, z, x0, x1);
+        runs.clear();
+        if(x0 < x1)
+          runs.push_back(std::make_pair(x0 - xb, x1 - xb));
+
+        line_index[0] = y;
+        res.Changed += RelabelScanlineRuns(
+              buffer->GetPixel(line_index), runs, 0, width, active, relabel,
+              res.Delta, res.CountDelta, work);
+        }
+      }
+    res.Delta.FinishEncoding();
+    }, nullptr);
 
-    // Next voxel
-    ++it;
+  // Merge the slab deltas, which follow each other in raster order
+  UndoDelta *delta = new UndoDelta();
+  delta->SetRegion(region);
+  LabelImageWrapper::LabelCountDelta count_delta;
+  unsigned long n_changed = 0;
+  for(long i = 0; i < n_slabs; i++)
+    {
+    SlabResult &res = slabs[i];
+    for(size_t j = 0; j < res.Delta.GetNumberOfRLEs(); j++)
+      delta->Encode(res.Delta.GetRLEValue(j), res.Delta.GetRLELength(j));
+    for(auto it = res.CountDelta.begin(); it != res.CountDelta.end(); ++it)
+      count_delta[it->first] += it->second;
+    n_changed += res.Changed;
     }
-
-  // Finalize
-
+  delta->FinishEncoding();
 
   // Store the undo point if needed
-  if(it.Finalize("3D scalpel"))
+  if(n_changed > 0)
     {
+    seg->PixelsModified(count_delta);
+    seg->StoreUndoPoint("3D scalpel", delta);
     RecordCurrentLabelUse();
     InvokeEvent(SegmentationChangeEvent());
     }
+  else
+    {
+    delete delta;
+    }
 
-  return it.GetNumberOfChangedVoxels();
+  return n_changed;
 }
 
 int 
@@ -1287,9 +1509,6 @@ IRISApplication
   itk::Index<3> lIndex;
   Vector3ui lSize = xLabelWrapper->GetSize();
 
-  double delta[3][3] = {{0.,0.,0.},{0.,0.,0.},{0.,0.,0.}}, dratio[3] = {0., 0., 0.};
-  int    signrx, signry, signrz;
-
   double rx = ray[0];
   double ry = ray[1];
   double rz = ray[2];
@@ -1300,10 +1519,6 @@ IRISApplication
   double rfac = 1.0 / sqrt(rlen);
   rx *= rfac; ry *= rfac; rz *= rfac;
 
-  if (rx >=0) signrx = 1; else signrx = -1;
-  if (ry >=0) signry = 1; else signry = -1;
-  if (rz >=0) signrz = 1; else signrz = -1;
-
   // offset everything by (.5, .5) [becuz samples are at center of voxels]
   // this offset will put borders of voxels at integer values
   // we will work with this offset grid and offset back to check samples
@@ -1325,23 +1540,29 @@ IRISApplication
     }
   if (c >= 9999) return -1;
 
-  // walk along ray to find intersection with any voxel with val > 0
-  while ( (px >= 0 && px < lSize[0]&&
-           py >= 0 && py < lSize[1] &&
-           pz >= 0 && pz < lSize[2]) )
-    {
+  // Empty bricks can be passed over unless the clear label is visible
+  const LabelOccupancyMap *occupancy = xLabelWrapper->GetOccupancyMap();
+  if(m_ColorLabelTable->IsColorLabelValid(0) && m_ColorLabelTable->GetColorLabel(0).IsVisible())
+    occupancy = NULL;
+
+  // Walk along the ray through each voxel it crosses, to find the first
+  // voxel with a visible label
+  double start[3] = { px, py, pz }, dir[3] = { rx, ry, rz };
+  VoxelRayWalker walker(start, dir);
+  const long *idx = walker.GetIndex();
+  while(idx[0] >= 0 && idx[0] < (long) lSize[0] &&
+        idx[1] >= 0 && idx[1] < (long) lSize[1] &&
+        idx[2] >= 0 && idx[2] < (long) lSize[2])
+    {
+    // Empty bricks are passed over without looking up their voxels
+    if(occupancy && occupancy->SkipEmptySpace(walker))
+      continue;
 
-    // offset point by (-.5, -.5) [to account for earlier offset] and
-    // get the nearest sample voxel within unit cube around (px,py,pz)
-    //    lx = my_round(px-0.5);
-    //    ly = my_round(py-0.5);
-    //    lz = my_round(pz-0.5);
-    lIndex[0] = (int) px;
-    lIndex[1] = (int) py;
-    lIndex[2] = (int) pz;
+    lIndex[0] = idx[0];
+    lIndex[1] = idx[1];
+    lIndex[2] = idx[2];
 
     LabelType hitlabel = xLabelWrapper->GetVoxel(lIndex);
-
     if (m_ColorLabelTable->IsColorLabelValid(hitlabel))
       {
       ColorLabel cl = m_ColorLabelTable->GetColorLabel(hitlabel);
@@ -1354,69 +1575,8 @@ IRISApplication
         }
       }
 
-    // BEGIN : walk along ray to border of next voxel touched by ray
-
-    // compute path to YZ-plane surface of next voxel
-    if (rx == 0)
-      { // ray is parallel to 0 axis
-      delta[0][0] = 9999;
-      }
-    else
-      {
-      delta[0][0] = (int)(px+signrx) - px;
-      }
-
-    // compute path to XZ-plane surface of next voxel
-    if (ry == 0)
-      { // ray is parallel to 1 axis
-      delta[1][0] = 9999;
-      }
-    else
-      {
-      delta[1][1] = (int)(py+signry) - py;
-      dratio[1]   = delta[1][1]/ry;
-      delta[1][0] = dratio[1] * rx;
-      }
-
-    // compute path to XY-plane surface of next voxel
-    if (rz == 0)
-      { // ray is parallel to 2 axis
-      delta[2][0] = 9999;
-      }
-    else
-      {
-      delta[2][2] = (int)(pz+signrz) - pz;
-      dratio[2]   = delta[2][2]/rz;
-      delta[2][0] = dratio[2] * rx;
-      }
-
-    // choose the shortest path 
-    if ( fabs(delta[0][0]) <= fabs(delta[1][0]) && fabs(delta[0][0]) <= fabs(delta[2][0]) )
-      {
-      dratio[0]   = delta[0][0]/rx;
-      delta[0][1] = dratio[0] * ry;
-      delta[0][2] = dratio[0] * rz;
-      px += delta[0][0];
-      py += delta[0][1];
-      pz += delta[0][2];
-      }
-    else if ( fabs(delta[1][0]) <= fabs(delta[0][0]) && fabs(delta[1][0]) <= fabs(delta[2][0]) )
-      {
-      delta[1][2] = dratio[1] * rz;
-      px += delta[1][0];
-      py += delta[1][1];
-      pz += delta[1][2];
-      }
-    else
-      { //if (fabs(delta[2][0] <= fabs(delta[0][0] && fabs(delta[2][0] <= fabs(delta[0][0]) 
-      delta[2][1] = dratio[2] * ry;
-      px += delta[2][0];
-      py += delta[2][1];
-      pz += delta[2][2];
-      }
-    // END : walk along ray to border of next voxel touched by ray
-
-    } // while ( (px
+    walker.Step();
+    }
   return 0;
 }
 
@@ -75,7 +75,8 @@ public:
       m_ActiveLabel(active_label),
       m_DrawOver(draw_over),
       m_Iterator(seg_wrapper->GetModifiableImage(), region),
-      m_ChangedVoxels(0)
+      m_ChangedVoxels(0),
+      m_RunOldLabel(0), m_RunNewLabel(0), m_RunLength(0)
   {
     // Create the delta
     m_Delta = new UndoDelta();
@@ -125,7 +126,7 @@ public:
         {
         m_VoxelDelta += new_label - lOld;
         m_Iterator.Set(new_label);
-        m_ChangedVoxels++;
+        this->RecordLabelChange(lOld, new_label);
         }
       }
   }
@@ -156,7 +157,7 @@ public:
         {
         m_VoxelDelta += m_ActiveLabel - lOld;
         m_Iterator.Set(m_ActiveLabel);
-        m_ChangedVoxels++;
+        this->RecordLabelChange(lOld, m_ActiveLabel);
         }
       }
   }
@@ -172,7 +173,7 @@ public:
       {
       m_VoxelDelta += 0 - lOld;
       m_Iterator.Set(0);
-      m_ChangedVoxels++;
+      this->RecordLabelChange(lOld, 0);
       }
   }
 
@@ -188,7 +189,7 @@ public:
       {
       m_VoxelDelta += new_label - lOld;
       m_Iterator.Set(new_label);
-      m_ChangedVoxels++;
+      this->RecordLabelChange(lOld, new_label);
       }
   }
 
@@ -214,7 +215,7 @@ public:
       {
       m_VoxelDelta += new_label - lOld;
       m_Iterator.Set(new_label);
-      m_ChangedVoxels++;
+      this->RecordLabelChange(lOld, new_label);
       }
   }
 
@@ -235,7 +236,8 @@ public:
     m_Delta->FinishEncoding();
     if(m_ChangedVoxels > 0)
       {
-      m_Wrapper->PixelsModified();
+      this->FlushLabelChanges();
+      m_Wrapper->PixelsModified(m_CountDelta);
       if(undo_string)
         m_Wrapper->StoreUndoPoint(undo_string, RelinquishDelta());
       return true;
@@ -265,6 +267,29 @@ public:
 
 protected:
 
+  // Record that a voxel has been changed from one label to another. Changes
+  // between the same pair of labels are counted up before touching the map
+  void RecordLabelChange(LabelType lOld, LabelType lNew)
+  {
+    if(m_RunLength && (lOld != m_RunOldLabel || lNew != m_RunNewLabel))
+      this->FlushLabelChanges();
+
+    m_RunOldLabel = lOld;
+    m_RunNewLabel = lNew;
+    m_RunLength++;
+    m_ChangedVoxels++;
+  }
+
+  void FlushLabelChanges()
+  {
+    if(m_RunLength)
+      {
+      m_CountDelta[m_RunOldLabel] -= m_RunLength;
+      m_CountDelta[m_RunNewLabel] += m_RunLength;
+      m_RunLength = 0;
+      }
+  }
+
   // The label image wrapper to which segmentation is applied
   LabelImageWrapper *m_Wrapper;
 
@@ -291,6 +316,14 @@ protected:
 
   // Number of voxels actually modified
   unsigned long m_ChangedVoxels;
+
+  // Change in the number of voxels with each label, passed on to the wrapper
+  // so that it does not have to recount them
+  LabelImageWrapper::LabelCountDelta m_CountDelta;
+
+  // Label changes not yet added to m_CountDelta
+  LabelType m_RunOldLabel, m_RunNewLabel;
+  long m_RunLength;
 };
 
 
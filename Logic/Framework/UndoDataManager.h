@@ -39,6 +39,7 @@
 #include <list>
 
 #include <RLEImage.h>
+#include "UndoSpillFile.h"
 
 /**
  * The Delta class represents a difference between two images used in
@@ -53,6 +54,8 @@ public:
 
   UndoDelta();
 
+  ~UndoDelta();
+
   void SetRegion(const RegionType &region)
   { this->m_Region = region; }
 
@@ -61,10 +64,13 @@ public:
 
   void Encode(const TPixel &value);
 
+  /** Encode a run of identical values, e.g. a segment of an RLE image */
+  void Encode(const TPixel &value, size_t count);
+
   void FinishEncoding();
 
   size_t GetNumberOfRLEs()
-  { return m_Array.size(); }
+  { return m_State == HOT ? m_Array.size() : m_NumberOfRLEs; }
 
   TPixel GetRLEValue(size_t i)
   { return m_Array[i].second; }
@@ -77,6 +83,39 @@ public:
 
   UndoDelta & operator = (const UndoDelta &other);
 
+  /**
+   * Pack the RLE array into a compact (varint + zlib) byte buffer. While
+   * compressed, only GetNumberOfRLEs() and GetRegion() may be called. The
+   * delta must not be compressed while it is still being encoded.
+   */
+  void Compress();
+
+  /**
+   * Move the compressed buffer into the spill file. If the file is full, the
+   * delta stays compressed in memory. The file must outlive the delta.
+   */
+  void Spill(UndoSpillFile *file);
+
+  /** Restore the RLE array from the compressed or spilled buffer */
+  void Decompress();
+
+  bool IsCompressed() const
+  { return m_State != HOT; }
+
+  bool IsSpilled() const
+  { return m_State == SPILLED; }
+
+  /**
+   * Memory held by this delta, expressed in units of uncompressed RLEs so
+   * that it can be compared against the undo manager's size limit. Spilled
+   * deltas take up no memory.
+   */
+  size_t GetFootprint() const;
+
+  /** Number of bytes this delta occupies in the spill file */
+  size_t GetSpilledSize() const
+  { return m_State == SPILLED ? m_PackedSize : 0; }
+
 protected:
   typedef std::pair<size_t, TPixel> RLEPair;
   typedef std::vector<RLEPair> RLEArray;
@@ -84,6 +123,18 @@ protected:
   size_t m_CurrentLength;
   TPixel m_LastValue;
 
+  // Storage state of the RLE data
+  enum StorageState { HOT, COMPRESSED, SPILLED };
+  StorageState m_State;
+
+  // Compressed RLE data and the information needed to unpack it
+  std::vector<unsigned char> m_Packed;
+  size_t m_NumberOfRLEs, m_PackedSize, m_UnpackedSize;
+
+  // Location of the compressed data when spilled to disk
+  UndoSpillFile *m_SpillFile;
+  long m_SpillOffset;
+
   // The delta is associated with an image region
   RegionType m_Region;
 
@@ -124,6 +175,18 @@ public:
     void DeleteDeltas();
     size_t GetNumberOfRLEs() const;
     const DList &GetDeltas() const { return m_Deltas; }
+
+    /** Memory used by the deltas, in uncompressed RLE units */
+    size_t GetFootprint() const;
+
+    /** Bytes used by the deltas in the spill file */
+    size_t GetSpilledSize() const;
+
+    /**
+     * Keep the deltas uncompressed (hot) or compress them. Compressed deltas
+     * are moved to the spill file if one is provided
+     */
+    void SetStorage(bool hot, UndoSpillFile *spill_file);
   protected:
     DList m_Deltas;
     std::string m_Name;
@@ -131,6 +194,23 @@ public:
 
   UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize);
 
+  ~UndoDataManager();
+
+  /**
+   * Set the number of commits on either side of the current undo position
+   * that are kept uncompressed. Older commits are stored compressed, which
+   * lets a much deeper history fit into the same size limit. Default is 2.
+   */
+  void SetNumberOfHotCommits(size_t n);
+
+  /**
+   * Move compressed commits out of memory into a temporary file, which may be
+   * shared with other undo managers. When the file is full, commits stay in
+   * memory and the oldest ones are discarded as usual. Pass NULL to keep all
+   * commits in memory (default).
+   */
+  void SetSpillFile(UndoSpillFile *file);
+
   /** Add a delta to the staging list. The staging list must be committed */
   void AddDeltaToStaging(Delta *delta);
 
@@ -163,6 +243,16 @@ private:
   CList m_CommitList;
   CIterator m_Position;
   size_t m_TotalSize, m_MinCommits, m_MaxTotalSize;
+
+  // Compression and spilling settings
+  size_t m_HotCommits;
+  SmartPtr<UndoSpillFile> m_SpillFile;
+
+  // Compress or spill the commits away from the current position, decompress
+  // the ones near it and update the memory accounting. Unless all commits are
+  // visited, only the ones that may have entered or left the hot window since
+  // the position last moved by one are updated
+  void UpdateStorageTiers(bool all = false);
 };
 
 #endif // __UndoDataManager_h_
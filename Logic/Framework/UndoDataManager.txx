@@ -32,6 +32,10 @@
   PURPOSE.  See the above copyright notices for more information. 
 
 =========================================================================*/
+#include "IRISException.h"
+#include "itk_zlib.h"
+#include <algorithm>
+#include <iterator>
 
 template<typename TPixel> unsigned long UndoDelta<TPixel>::m_UniqueIDCounter = 0;
 
@@ -41,6 +45,19 @@ UndoDelta<TPixel>
 {
   m_CurrentLength = 0;
   m_UniqueID = m_UniqueIDCounter++;
+  m_State = HOT;
+  m_NumberOfRLEs = m_PackedSize = m_UnpackedSize = 0;
+  m_SpillFile = NULL;
+  m_SpillOffset = 0;
+}
+
+template<typename TPixel>
+UndoDelta<TPixel>
+::~UndoDelta()
+{
+  // Give the space in the spill file back
+  if(m_State == SPILLED)
+    m_SpillFile->Release(m_SpillOffset, m_PackedSize);
 }
 
 template<typename TPixel>
@@ -65,6 +82,31 @@ UndoDelta<TPixel>
     }
 }
 
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Encode(const TPixel &value, size_t count)
+{
+  if(count == 0)
+    return;
+
+  if(m_CurrentLength == 0)
+    {
+    m_LastValue = value;
+    m_CurrentLength = count;
+    }
+  else if(value == m_LastValue)
+    {
+    m_CurrentLength += count;
+    }
+  else
+    {
+    m_Array.push_back(std::make_pair(m_CurrentLength, m_LastValue));
+    m_CurrentLength = count;
+    m_LastValue = value;
+    }
+}
+
 template<typename TPixel>
 void
 UndoDelta<TPixel>
@@ -83,9 +125,164 @@ UndoDelta<TPixel>
   m_CurrentLength = other.m_CurrentLength;
   m_LastValue = other.m_LastValue;
   m_Region = other.m_Region;
+  m_NumberOfRLEs = other.m_NumberOfRLEs;
+  m_PackedSize = other.m_PackedSize;
+  m_UnpackedSize = other.m_UnpackedSize;
+
+  // Release our own spilled data
+  if(m_State == SPILLED)
+    m_SpillFile->Release(m_SpillOffset, m_PackedSize);
+  m_SpillFile = NULL;
+  m_SpillOffset = 0;
+
+  // Each block in the spill file has one owner, so the copy of a spilled
+  // delta is kept compressed in memory
+  if(other.m_State == SPILLED)
+    {
+    m_Packed.resize(other.m_PackedSize);
+    if(!other.m_SpillFile->Load(other.m_SpillOffset, &m_Packed[0], other.m_PackedSize))
+      throw IRISException("Unable to read undo data from temporary file");
+    m_State = COMPRESSED;
+    }
+  else
+    {
+    m_Packed = other.m_Packed;
+    m_State = other.m_State;
+    }
   return *this;
 }
 
+// Varint helpers used to pack the RLE array before zlib compression. Most
+// run lengths and label values fit into one or two bytes this way
+inline void UndoDeltaPutVarint(std::vector<unsigned char> &buf, unsigned long long x)
+{
+  while(x >= 0x80)
+    {
+    buf.push_back(static_cast<unsigned char>(x | 0x80));
+    x >>= 7;
+    }
+  buf.push_back(static_cast<unsigned char>(x));
+}
+
+inline unsigned long long UndoDeltaGetVarint(const unsigned char *&p, const unsigned char *end)
+{
+  unsigned long long x = 0;
+  for(int shift = 0; p < end && shift < 64; shift += 7)
+    {
+    unsigned char b = *p++;
+    x |= static_cast<unsigned long long>(b & 0x7f) << shift;
+    if(!(b & 0x80))
+      return x;
+    }
+  throw IRISException("Corrupt compressed undo data");
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Compress()
+{
+  if(m_State != HOT || m_Array.empty())
+    return;
+
+  // Pack the runs as varints
+  std::vector<unsigned char> raw;
+  raw.reserve(m_Array.size() * 3);
+  for(typename RLEArray::const_iterator it = m_Array.begin(); it != m_Array.end(); ++it)
+    {
+    UndoDeltaPutVarint(raw, static_cast<unsigned long long>(it->first));
+    UndoDeltaPutVarint(raw, static_cast<unsigned long long>(it->second));
+    }
+
+  // Deflate the packed runs. If this fails for any reason, the delta just
+  // stays uncompressed
+  uLongf n_packed = compressBound(static_cast<uLong>(raw.size()));
+  std::vector<unsigned char> packed(n_packed);
+  if(compress2(&packed[0], &n_packed, &raw[0], static_cast<uLong>(raw.size()),
+               Z_BEST_SPEED) != Z_OK)
+    return;
+  packed.resize(n_packed);
+
+  m_Packed.assign(packed.begin(), packed.end());
+  m_PackedSize = m_Packed.size();
+  m_UnpackedSize = raw.size();
+  m_NumberOfRLEs = m_Array.size();
+  RLEArray().swap(m_Array);
+  m_State = COMPRESSED;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Spill(UndoSpillFile *file)
+{
+  if(m_State != COMPRESSED || !file)
+    return;
+
+  // Store the compressed buffer in the file. On failure keep it in memory
+  long offset = file->Store(&m_Packed[0], m_PackedSize);
+  if(offset < 0)
+    return;
+
+  m_SpillFile = file;
+  m_SpillOffset = offset;
+  std::vector<unsigned char>().swap(m_Packed);
+  m_State = SPILLED;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Decompress()
+{
+  if(m_State == HOT)
+    return;
+
+  // Read the data back from disk and free the space it took up there
+  if(m_State == SPILLED)
+    {
+    m_Packed.resize(m_PackedSize);
+    if(!m_SpillFile->Load(m_SpillOffset, &m_Packed[0], m_PackedSize))
+      throw IRISException("Unable to read undo data from temporary file");
+    m_SpillFile->Release(m_SpillOffset, m_PackedSize);
+    m_SpillFile = NULL;
+    m_State = COMPRESSED;
+    }
+
+  // Inflate
+  std::vector<unsigned char> raw(m_UnpackedSize);
+  uLongf n_raw = static_cast<uLongf>(m_UnpackedSize);
+  if(uncompress(&raw[0], &n_raw, &m_Packed[0], static_cast<uLong>(m_PackedSize)) != Z_OK
+     || n_raw != m_UnpackedSize)
+    throw IRISException("Corrupt compressed undo data");
+
+  // Unpack the runs
+  m_Array.reserve(m_NumberOfRLEs);
+  const unsigned char *p = &raw[0], *end = p + raw.size();
+  for(size_t i = 0; i < m_NumberOfRLEs; i++)
+    {
+    size_t length = static_cast<size_t>(UndoDeltaGetVarint(p, end));
+    TPixel value = static_cast<TPixel>(UndoDeltaGetVarint(p, end));
+    m_Array.push_back(std::make_pair(length, value));
+    }
+
+  std::vector<unsigned char>().swap(m_Packed);
+  m_State = HOT;
+}
+
+template<typename TPixel>
+size_t
+UndoDelta<TPixel>
+::GetFootprint() const
+{
+  switch(m_State)
+    {
+    case HOT: return m_Array.size();
+    case COMPRESSED: return (m_PackedSize + sizeof(RLEPair) - 1) / sizeof(RLEPair);
+    default: return 0;
+    }
+}
+
 
 template<typename TPixel>
 UndoDataManager<TPixel>
@@ -94,9 +291,78 @@ UndoDataManager<TPixel>
   this->m_MinCommits = nMinCommits;
   this->m_MaxTotalSize = nMaxTotalSize;
   this->m_TotalSize = 0;
+  this->m_HotCommits = 2;
   m_Position = m_CommitList.begin();
 }
 
+template<typename TPixel>
+UndoDataManager<TPixel>
+::~UndoDataManager()
+{
+  // Free the deltas, releasing their space in the spill file
+  this->Clear();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::SetNumberOfHotCommits(size_t n)
+{
+  // The commit at the current position must always be hot
+  m_HotCommits = std::max(n, (size_t) 1);
+  this->UpdateStorageTiers(true);
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::SetSpillFile(UndoSpillFile *file)
+{
+  if(file == m_SpillFile)
+    return;
+
+  // Bring commits spilled to the old file back into memory
+  for(CIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    if(it->GetSpilledSize())
+      {
+      it->SetStorage(true, NULL);
+      it->SetStorage(false, NULL);
+      }
+
+  m_SpillFile = file;
+  this->UpdateStorageTiers(true);
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::UpdateStorageTiers(bool all)
+{
+  // Commits whose signed distance d from the current position satisfies
+  // -hot <= d < hot are kept uncompressed. When the position moves by one,
+  // only the commits with -hot-1 <= d <= hot change state
+  long hot = (long) m_HotCommits;
+  long d = 0;
+  CIterator it = m_Position;
+  if(all)
+    {
+    d = -(long) std::distance(m_CommitList.begin(), m_Position);
+    it = m_CommitList.begin();
+    }
+  else
+    {
+    for(; d > -hot - 1 && it != m_CommitList.begin(); --d)
+      --it;
+    }
+
+  for(; it != m_CommitList.end() && (all || d <= hot); ++it, ++d)
+    {
+    m_TotalSize -= it->GetFootprint();
+    it->SetStorage(d >= -hot && d < hot, m_SpillFile);
+    m_TotalSize += it->GetFootprint();
+    }
+}
+
 template<typename TPixel>
 void
 UndoDataManager<TPixel>
@@ -135,7 +401,7 @@ UndoDataManager<TPixel>
   // to the end. So that's the loop that we do
   while(m_Position != m_CommitList.end())
     {
-    m_TotalSize -= m_Position->GetNumberOfRLEs();
+    m_TotalSize -= m_Position->GetFootprint();
     m_Position->DeleteDeltas();
     m_Position = m_CommitList.erase(m_Position);
     }
@@ -156,11 +422,14 @@ UndoDataManager<TPixel>
     return 0;
     }
 
-  // Check whether we need to prune from the back to keep total size under control
+  // Check whether we need to prune from the back to keep total size under control.
+  // Older commits are usually compressed or spilled, so their footprint is
+  // much smaller than their number of RLEs
   CIterator itHead = m_CommitList.begin();
-  while(m_CommitList.size() > m_MinCommits && m_TotalSize + n_new_rles > m_MaxTotalSize)
+  while(m_CommitList.size() > m_MinCommits &&
+        m_TotalSize + n_new_rles > m_MaxTotalSize)
     {
-    m_TotalSize -= itHead->GetNumberOfRLEs();
+    m_TotalSize -= itHead->GetFootprint();
     itHead->DeleteDeltas();
     itHead = m_CommitList.erase(itHead);
     }
@@ -171,6 +440,9 @@ UndoDataManager<TPixel>
   m_Position = m_CommitList.end();
   m_TotalSize += n_new_rles;
 
+  // Compress the commits that are now far from the current position
+  this->UpdateStorageTiers();
+
   // Return the number of RLEs
   return n_new_rles;
 }
@@ -194,6 +466,9 @@ UndoDataManager<TPixel>
   // Move the position one delta to the beginning
   m_Position--;
 
+  // Make sure the commit is uncompressed
+  this->UpdateStorageTiers();
+
   // Return the current delta
   return *m_Position;
 }
@@ -220,6 +495,9 @@ UndoDataManager<TPixel>
   // Move the position one delta to the end
   m_Position++;
 
+  // The returned commit is just before the position, so this keeps it hot
+  this->UpdateStorageTiers();
+
   // Return the current delta
   return commit;
 }
@@ -263,3 +541,51 @@ UndoDataManager<TPixel>::Commit::GetNumberOfRLEs() const
     }
   return n;
 }
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>::Commit::GetFootprint() const
+{
+  size_t n = 0;
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit)
+      n += (*dit)->GetFootprint();
+    }
+  return n;
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>::Commit::GetSpilledSize() const
+{
+  size_t n = 0;
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit)
+      n += (*dit)->GetSpilledSize();
+    }
+  return n;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::SetStorage(bool hot, UndoSpillFile *spill_file)
+{
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(!*dit)
+      continue;
+
+    if(hot)
+      {
+      (*dit)->Decompress();
+      }
+    else
+      {
+      (*dit)->Compress();
+      if(spill_file)
+        (*dit)->Spill(spill_file);
+      }
+    }
+}
@@ -0,0 +1,112 @@
+#include "UndoSpillFile.h"
+
+UndoSpillFile::UndoSpillFile()
+{
+  m_File = NULL;
+  m_MaximumSize = 0x40000000;
+  m_UsedSize = 0;
+  m_FileSize = 0;
+}
+
+UndoSpillFile::~UndoSpillFile()
+{
+  if(m_File)
+    fclose(m_File);
+}
+
+long
+UndoSpillFile::Store(const unsigned char *data, size_t size)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  // Find the first free block that is large enough
+  long offset = -1;
+  for(FreeListType::iterator it = m_FreeList.begin(); it != m_FreeList.end(); ++it)
+    {
+    if(it->second >= size)
+      {
+      offset = it->first;
+      if(it->second > size)
+        m_FreeList[it->first + (long) size] = it->second - size;
+      m_FreeList.erase(it);
+      break;
+      }
+    }
+
+  // Otherwise, grow the file if it is allowed to
+  bool grow = (offset < 0);
+  if(grow)
+    {
+    if(m_FileSize + size > m_MaximumSize)
+      return -1;
+
+    if(!m_File && !(m_File = tmpfile()))
+      return -1;
+
+    offset = (long) m_FileSize;
+    }
+
+  // Write the data. If this fails, the block is given back
+  if(fseek(m_File, offset, SEEK_SET) != 0 || fwrite(data, 1, size, m_File) != size)
+    {
+    if(!grow)
+      m_FreeList[offset] = size;
+    return -1;
+    }
+
+  if(grow)
+    m_FileSize += size;
+  m_UsedSize += size;
+  return offset;
+}
+
+bool
+UndoSpillFile::Load(long offset, unsigned char *data, size_t size)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_File
+      && fseek(m_File, offset, SEEK_SET) == 0
+      && fread(data, 1, size, m_File) == size;
+}
+
+void
+UndoSpillFile::Release(long offset, size_t size)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_UsedSize -= size;
+
+  // Once the file is empty, close it to give the disk space back
+  if(m_UsedSize == 0)
+    {
+    if(m_File)
+      fclose(m_File);
+    m_File = NULL;
+    m_FileSize = 0;
+    m_FreeList.clear();
+    return;
+    }
+
+  // Merge the block with its free neighbors
+  FreeListType::iterator next = m_FreeList.lower_bound(offset);
+  if(next != m_FreeList.end() && offset + (long) size == next->first)
+    {
+    size += next->second;
+    next = m_FreeList.erase(next);
+    }
+  if(next != m_FreeList.begin())
+    {
+    FreeListType::iterator prev = std::prev(next);
+    if(prev->first + (long) prev->second == offset)
+      {
+      offset = prev->first;
+      size += prev->second;
+      m_FreeList.erase(prev);
+      }
+    }
+
+  // A free block at the end of the file just shrinks the used extent
+  if(offset + size == m_FileSize)
+    m_FileSize = offset;
+  else
+    m_FreeList[offset] = size;
+}
@@ -0,0 +1,63 @@
+#ifndef UNDOSPILLFILE_H
+#define UNDOSPILLFILE_H
+
+#include "SNAPCommon.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+/**
+ * A temporary file that holds compressed undo data moved out of memory. The
+ * file can be shared by several undo managers (e.g., one per time point of a
+ * 4D segmentation). Space is handed out in blocks; released blocks are put
+ * on a free list and reused, so the file never grows beyond the maximum size.
+ * The file is closed (and its disk space returned) when no blocks are in use.
+ */
+class UndoSpillFile : public itk::Object
+{
+public:
+  irisITKObjectMacro(UndoSpillFile, itk::Object)
+
+  /** Maximum size of the file in bytes. Default is 1GB */
+  itkSetMacro(MaximumSize, size_t)
+  itkGetConstMacro(MaximumSize, size_t)
+
+  /**
+   * Write a block of data into the file, returning its offset, or -1 if the
+   * file is full or can not be written.
+   */
+  long Store(const unsigned char *data, size_t size);
+
+  /** Read a block back from the file */
+  bool Load(long offset, unsigned char *data, size_t size);
+
+  /** Return a block to the free list */
+  void Release(long offset, size_t size);
+
+  /** Number of bytes in use */
+  size_t GetUsedSize() const
+  { return m_UsedSize; }
+
+  /** Current extent of the file in bytes */
+  size_t GetFileSize() const
+  { return m_FileSize; }
+
+protected:
+  UndoSpillFile();
+  virtual ~UndoSpillFile();
+
+  FILE *m_File;
+  size_t m_MaximumSize, m_UsedSize, m_FileSize;
+
+  // Free blocks, by offset
+  typedef std::map<long, size_t> FreeListType;
+  FreeListType m_FreeList;
+
+  // Undo managers of different time points may be used from different threads
+  std::mutex m_Mutex;
+};
+
+#endif // UNDOSPILLFILE_H
@@ -74,11 +74,15 @@
 #include "MultiFrameDicomSeriesSorter.h"
 #include "itkStringTools.h"
 #include "AllPurposeProgressAccumulator.h"
+#include "MemoryMappedImageContainer.h"
+#include "itkByteSwapper.h"
 
 #include <itk_zlib.h>
 #include "itkImportImageFilter.h"
 #include <algorithm>
 #include "itksys/Base64.h"
+#include "itksys/SystemTools.hxx"
+#include <fstream>
 
 
 using namespace std;
@@ -310,6 +314,151 @@ GuidedNativeImageIO
   m_NativeFileName = "";
   m_NativeByteOrder = itk::ImageIOBase::OrderNotApplicable;
   m_NativeSizeInBytes = 0;
+  m_NativeRangeMin = m_NativeRangeMax = 0.0;
+  m_NativeRangeValid = false;
+  m_StreamingChunkSize = 16 * 1024 * 1024;
+  m_UseMemoryMapping = true;
+  m_NativeImageMapped = false;
+}
+
+bool
+GuidedNativeImageIO
+::GetMappableDataLocation(std::string &file, size_t &offset)
+{
+  if(!m_IOBase || m_IOBase->GetNumberOfDimensions() > 4)
+    return false;
+
+  // The data must be stored in the byte order of this machine
+  if(m_IOBase->GetComponentSize() > 1)
+    {
+    IOBase::ByteOrder host = itk::ByteSwapper<int>::SystemIsBigEndian()
+        ? IOBase::BigEndian : IOBase::LittleEndian;
+    if(m_IOBase->GetByteOrder() != host)
+      return false;
+    }
+
+  file = m_IOBase->GetFileName();
+  switch(m_FileFormat)
+    {
+    case FORMAT_RAW:
+      offset = (size_t) m_Hints["Raw.HeaderSize"][0];
+      return true;
+
+    case FORMAT_VOXBO_CUB:
+      {
+      // The header is read as text, so the reader knows where the data starts
+      const itk::VoxBoCUBImageIO *cub =
+          dynamic_cast<const itk::VoxBoCUBImageIO *>(m_IOBase.GetPointer());
+      if(!cub || cub->GetDataOffset() < 0)
+        return false;
+      offset = (size_t) cub->GetDataOffset();
+      return true;
+      }
+
+    case FORMAT_NIFTI:
+      {
+      // Only single-file NIfTI-1 images with scalar voxels are laid out the
+      // same way as in memory. This also excludes gzipped files, whose first
+      // bytes do not match the header. ITK converts images with a non-trivial
+      // intensity scaling to floating point, so these are excluded as well.
+      if(m_IOBase->GetNumberOfComponents() != 1)
+        return false;
+
+      char hdr[348];
+      std::ifstream fin(file.c_str(), std::ios::binary);
+      if(!fin.read(hdr, 348))
+        return false;
+
+      int sizeof_hdr;
+      float vox_offset, scl_slope, scl_inter;
+      memcpy(&sizeof_hdr, hdr, 4);
+      memcpy(&vox_offset, hdr + 108, 4);
+      memcpy(&scl_slope, hdr + 112, 4);
+      memcpy(&scl_inter, hdr + 116, 4);
+      if(sizeof_hdr != 348 || memcmp(hdr + 344, "n+1", 4) != 0)
+        return false;
+      if(scl_slope != 0.0f && (scl_slope != 1.0f || scl_inter != 0.0f))
+        return false;
+
+      offset = (size_t) vox_offset;
+      return true;
+      }
+
+    case FORMAT_MHA:
+      {
+      // Scan the text header up to the ElementDataFile entry, which is last
+      std::ifstream fin(file.c_str(), std::ios::binary);
+      std::string line, data_file;
+      long header_size = 0;
+      while(data_file.empty() && std::getline(fin, line))
+        {
+        size_t eq = line.find('=');
+        if(eq == std::string::npos)
+          continue;
+
+        std::string key = line.substr(0, eq), value = line.substr(eq + 1);
+        itk::StringTools::Trim(key);
+        itk::StringTools::Trim(value);
+        if(value.empty())
+          continue;
+
+        if(key == "CompressedData" && (value[0] == 'T' || value[0] == 't'))
+          return false;
+        else if(key == "BinaryData" && (value[0] == 'F' || value[0] == 'f'))
+          return false;
+        else if(key == "HeaderSize")
+          header_size = atol(value.c_str());
+        else if(key == "ElementDataFile")
+          data_file = value;
+        }
+
+      if(data_file.empty())
+        return false;
+
+      // Data in the header file follows the header
+      if(data_file == "LOCAL")
+        {
+        offset = (size_t) fin.tellg();
+        return true;
+        }
+
+      // Data split over several files can not be mapped
+      if(data_file.find(' ') != std::string::npos || data_file.find('%') != std::string::npos
+         || data_file.find("LIST") == 0)
+        return false;
+
+      if(!itksys::SystemTools::FileIsFullPath(data_file))
+        data_file = itksys::SystemTools::GetFilenamePath(file) + "/" + data_file;
+      file = data_file;
+
+      // A header size of -1 means the data is at the end of the file
+      if(header_size < 0)
+        {
+        unsigned long length = itksys::SystemTools::FileLength(file);
+        if(length < m_IOBase->GetImageSizeInBytes())
+          return false;
+        offset = length - m_IOBase->GetImageSizeInBytes();
+        }
+      else
+        offset = (size_t) header_size;
+      return true;
+      }
+
+    default:
+      return false;
+    }
+}
+
+bool
+GuidedNativeImageIO
+::GetNativeIntensityRange(double &imin, double &imax) const
+{
+  if(!m_NativeRangeValid || m_NativeImage.IsNull())
+    return false;
+
+  imin = m_NativeRangeMin;
+  imax = m_NativeRangeMax;
+  return true;
 }
 
 GuidedNativeImageIO::FileFormat 
@@ -786,6 +935,28 @@ GuidedNativeImageIO
 }
 
 
+bool
+GuidedNativeImageIO
+::IsImageDataCompressed()
+{
+  // Gzipped files, e.g., .nii.gz or the .img.gz of an Analyze/NIfTI pair
+  std::string file = m_IOBase->GetFileName();
+  std::string ext = itksys::SystemTools::LowerCase(
+        itksys::SystemTools::GetFilenameLastExtension(file));
+  if(ext == ".gz")
+    return true;
+  if(ext == ".hdr" && itksys::SystemTools::FileExists(
+       file.substr(0, file.size() - ext.size()) + ".img.gz"))
+    return true;
+
+  // MetaImages may store compressed data under any name
+  itk::MetaImageIO *mio = dynamic_cast<itk::MetaImageIO *>(m_IOBase.GetPointer());
+  if(mio && mio->GetMetaImagePointer()->CompressedData())
+    return true;
+
+  return false;
+}
+
 template<class TScalar>
 void
 GuidedNativeImageIO
@@ -794,6 +965,9 @@ GuidedNativeImageIO
 	if (!progressCmd)
 		progressCmd = DoNothingCommandSingleton::GetInstance().GetCommand();
 
+  // The range is only known if the image is streamed below
+  m_NativeRangeValid = false;
+  m_NativeImageMapped = false;
 
   // Define the image type of interest
   typedef itk::VectorImage<TScalar, 4> NativeImageType;
@@ -1230,40 +1404,115 @@ GuidedNativeImageIO
     region.SetSize(dim);
     image->SetRegions(region);
     image->SetVectorLength(ncomp);
-    image->Allocate();
+
+    // If the data is stored in the file the same way as in memory, map it
+    // instead of reading it
+    typedef typename NativeImageType::PixelContainer::ElementIdentifier ElementId;
+    typedef MemoryMappedImageContainer<ElementId, TScalar> MappedContainer;
+    typename MappedContainer::Pointer mapped = MappedContainer::New();
+    std::string map_file;
+    size_t map_offset;
+    if(m_UseMemoryMapping && this->GetMappableDataLocation(map_file, map_offset)
+       && mapped->MapFile(map_file.c_str(), map_offset, region.GetNumberOfPixels() * ncomp))
+      {
+      image->SetPixelContainer(mapped);
+      m_NativeImageMapped = true;
+      }
+    else
+      {
+      image->Allocate();
+      }
 
 		regularImageReadingProgSrc->AddProgress(0.05);
 
-    // Set the IO region
-    if(nd_actual <= 4)
+    // Streaming is done along the last dimension of the image, so that each
+    // chunk occupies a contiguous part of the buffer
+    unsigned int sd = (nd_actual == 4) ? 3 : 2;
+    size_t n_chunk = 1, chunk_len = dim[sd];
+    if(nd_actual <= 4 && !m_NativeImageMapped
+       && m_StreamingChunkSize > 0 && m_IOBase->CanStreamRead()
+       && !this->IsImageDataCompressed())
       {
-      // This is the old code, which we preserve
-      itk::ImageIORegion ioRegion(4);
-      itk::ImageIORegionAdaptor<4>::Convert(region, ioRegion, index);
-      m_IOBase->SetIORegion(ioRegion);
+      size_t slice_bytes = image->GetPixelContainer()->Size() * sizeof(TScalar) / dim[sd];
+      chunk_len = std::max((size_t) 1, (size_t) (m_StreamingChunkSize / slice_bytes));
+      n_chunk = (dim[sd] + chunk_len - 1) / chunk_len;
       }
-    else
+
+    if(m_NativeImageMapped)
+      {
+      m_NativeImage = image;
+      regularImageReadingProgSrc->AddProgress(0.95);
+      }
+    else if(n_chunk > 1)
       {
-      itk::ImageIORegion ioRegion(nd_actual);
-      itk::ImageIORegion::IndexType ioIndex;
-      itk::ImageIORegion::SizeType ioSize;
-			for(size_t i = 0; i < nd_actual; i++)
+      regularImageReadingProgSrc->AddProgress(0.05);
+
+      size_t slice_size = image->GetPixelContainer()->Size() / dim[sd];
+      TScalar rmin = itk::NumericTraits<TScalar>::max();
+      TScalar rmax = itk::NumericTraits<TScalar>::NonpositiveMin();
+      for(size_t k = 0; k < dim[sd]; k += chunk_len)
         {
-        ioIndex.push_back(0);
-        ioSize.push_back(m_IOBase->GetDimensions(i));
+        typename NativeImageType::RegionType chunk = region;
+        chunk.SetIndex(sd, k);
+        chunk.SetSize(sd, std::min(chunk_len, (size_t) (dim[sd] - k)));
+
+        itk::ImageIORegion ioRegion(4);
+        itk::ImageIORegionAdaptor<4>::Convert(chunk, ioRegion, index);
+        m_IOBase->SetIORegion(ioRegion);
+
+        TScalar *chunk_begin = image->GetBufferPointer() + k * slice_size;
+        TScalar *chunk_end = chunk_begin + chunk.GetSize(sd) * slice_size;
+        m_IOBase->Read(chunk_begin);
+
+        // Compute the intensity range while the chunk is still in cache
+        for(TScalar *p = chunk_begin; p < chunk_end; ++p)
+          {
+          if(*p < rmin) rmin = *p;
+          if(*p > rmax) rmax = *p;
+          }
+
+        regularImageReadingProgSrc->AddProgress(0.9 * chunk.GetSize(sd) / dim[sd]);
         }
-      ioRegion.SetIndex(ioIndex);
-      ioRegion.SetSize(ioSize);
-      m_IOBase->SetIORegion(ioRegion);
+
+      // The image is only made available once it has been read completely
+      m_NativeImage = image;
+      m_NativeRangeMin = static_cast<double>(rmin);
+      m_NativeRangeMax = static_cast<double>(rmax);
+      m_NativeRangeValid = true;
       }
+    else
+      {
+      // Set the IO region
+      if(nd_actual <= 4)
+        {
+        // This is the old code, which we preserve
+        itk::ImageIORegion ioRegion(4);
+        itk::ImageIORegionAdaptor<4>::Convert(region, ioRegion, index);
+        m_IOBase->SetIORegion(ioRegion);
+        }
+      else
+        {
+        itk::ImageIORegion ioRegion(nd_actual);
+        itk::ImageIORegion::IndexType ioIndex;
+        itk::ImageIORegion::SizeType ioSize;
+        for(size_t i = 0; i < nd_actual; i++)
+          {
+          ioIndex.push_back(0);
+          ioSize.push_back(m_IOBase->GetDimensions(i));
+          }
+        ioRegion.SetIndex(ioIndex);
+        ioRegion.SetSize(ioSize);
+        m_IOBase->SetIORegion(ioRegion);
+        }
 
-		regularImageReadingProgSrc->AddProgress(0.05);
+      regularImageReadingProgSrc->AddProgress(0.05);
 
-    // Read the image into the buffer
-		m_IOBase->Read(image->GetBufferPointer());
-    m_NativeImage = image;
+      // Read the image into the buffer
+      m_IOBase->Read(image->GetBufferPointer());
+      m_NativeImage = image;
 
-		regularImageReadingProgSrc->AddProgress(0.9);
+      regularImageReadingProgSrc->AddProgress(0.9);
+      }
 
 
     // If the image is 4-dimensional or more, we must perform an in-place transpose
@@ -1368,6 +1617,25 @@ GuidedNativeImageIO
   typedef itk::ImageFileWriter<TImageType> WriterType;
   typename WriterType::Pointer writer = WriterType::New();
   
+  // Overwriting a file that is mapped into memory would pull the data out
+  // from under the images that use the mapping. Mappings of the file, and of
+  // data files with the same name that may be written with it (e.g., the data
+  // file of a MetaImage or Analyze header) are first copied into memory
+  std::string save_path = itksys::SystemTools::CollapseFullPath(FileName);
+  std::string save_stem = itksys::SystemTools::GetFilenamePath(save_path) + "/"
+      + itksys::SystemTools::GetFilenameWithoutLastExtension(save_path);
+  std::vector<std::string> mapped_files = MemoryMappedFile::GetMappedFiles();
+  for(size_t i = 0; i < mapped_files.size(); i++)
+    {
+    const std::string &mf = mapped_files[i];
+    std::string mf_stem = itksys::SystemTools::GetFilenamePath(mf) + "/"
+        + itksys::SystemTools::GetFilenameWithoutLastExtension(mf);
+    if((mf == save_path || mf_stem == save_stem) && !MemoryMappedFile::DetachFile(mf))
+      throw IRISException("Error: The file %s can not be overwritten because an "
+                          "image loaded from it is in use. Please save the image "
+                          "to a different file.", mf.c_str());
+    }
+
   writer->SetFileName(FileName);
   if(m_IOBase)
     writer->SetImageIO(m_IOBase);
@@ -1432,6 +1700,10 @@ RescaleNativeImageToIntegralType<TOutputImage>::operator()(
   // Get the native image pointer
   auto *native = nativeIO->GetNativeImage();
 
+  // If the range was computed while reading the image, there is no need
+  // to scan the image for it again
+  m_KnownRangeValid = nativeIO->GetNativeIntensityRange(m_KnownMin, m_KnownMax);
+
   // Cast image from native format to TPixel
   itk::ImageIOBase::IOComponentType itype = nativeIO->GetComponentTypeInNativeImage();
   switch(itype) 
@@ -1572,11 +1844,19 @@ RescaleNativeImageToIntegralType<TOutputImage>
     TNative imin_nat = *ib_begin, imax_nat = *ib_begin;
 
     // Iterate over all the components in the input image
-    for(TNative *buffer = ib_begin + 1; buffer < ib_end; ++buffer)
+    if(m_KnownRangeValid)
       {
-      TNative val = *buffer;
-      if(val < imin_nat) imin_nat = val;
-      if(val > imax_nat) imax_nat = val;
+      imin_nat = static_cast<TNative>(m_KnownMin);
+      imax_nat = static_cast<TNative>(m_KnownMax);
+      }
+    else
+      {
+      for(TNative *buffer = ib_begin + 1; buffer < ib_end; ++buffer)
+        {
+        TNative val = *buffer;
+        if(val < imin_nat) imin_nat = val;
+        if(val > imax_nat) imax_nat = val;
+        }
       }
 
     // Cast the values to double
@@ -1738,6 +2018,29 @@ CastNativeImage<TOutputImage,TCastFunctor>
                         "an output image with %d components", ncomp, ncomp_out);
     }
 
+  // A native buffer mapped from the image file can not be converted in place.
+  // If the type differs, the data is converted into a new buffer instead. If
+  // the type is the same, the mapped buffer is passed to the output below,
+  // so the image shares its memory with the page cache
+  typedef MemoryMappedImageContainer<typename InPixCon::ElementIdentifier, TNative> MappedPixCon;
+  if(dynamic_cast<MappedPixCon *>(ipc) && typeid(OutputComponentType) != typeid(TNative))
+    {
+    size_t nval = ipc->Size();
+    OutputComponentType *ob = reinterpret_cast<OutputComponentType *>(
+          malloc(nval * sizeof(OutputComponentType)));
+    if(!ob)
+      throw IRISException("Out of memory converting an image with %d values", (int) nval);
+
+    TNative *pn = ipc->GetImportPointer();
+    for(OutputComponentType *pt = ob; pt < ob + nval; pt++, pn++)
+      m_Functor(pn, pt);
+
+    SmartPtr<OutPixCon> pc = OutPixCon::New();
+    pc->SetImportPointer(ob, nval, true);
+    m_Output->SetPixelContainer(pc);
+    return;
+    }
+
   // Special case: native image is the same as target image
   if(typeid(OutputComponentType) == typeid(TNative))
     {
@@ -1920,6 +2223,8 @@ const gdcm::Tag GuidedNativeImageIO::m_tagSliceThickness(0x0018, 0x0050);
 
 #include "gdcmDirectory.h"
 #include "gdcmImageReader.h"
+#include "itkMultiThreaderBase.h"
+#include "DicomHeaderIndex.h"
 
 void
 GuidedNativeImageIO
@@ -1963,98 +2268,175 @@ GuidedNativeImageIO
   // Load the directory - this should be quick
   dirList.Load(dir, false);
   gdcm::Directory::FilenamesType const &filenames = dirList.GetFilenames();
-  for(gdcm::Directory::FilenamesType::const_iterator it = filenames.begin();
-    it != filenames.end(); ++it)
+
+  // The tags recorded in the DICOM header index, in a fixed order
+  DicomHeaderIndex::TagList tags_index(tags_all.begin(), tags_all.end());
+
+  // Index of previously read headers. Unchanged files are looked up in the
+  // index rather than read again
+  DicomHeaderIndex index(dir);
+
+  // The header fields of a single file that are needed for grouping
+  struct DicomFileHeader
+  {
+    bool Valid, Indexed;
+    DicomHeaderIndex::ValueList Values;
+    std::string FullId, Desc, SeriesNumber, Rows, Cols;
+  };
+
+  // Reading the headers is dominated by file access, which is slow on network
+  // storage, so the files are read in parallel. They are processed in batches,
+  // so that progress can be reported and the table updated between batches.
+  // The headers are merged into the series map in the order of the directory
+  // listing, which makes the result the same as for a serial scan.
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  const size_t batch_size = 256;
+  std::vector<DicomFileHeader> headers(batch_size);
+
+  for(size_t batch_start = 0; batch_start < filenames.size(); batch_start += batch_size)
     {
-    // Process each filename in the directory
-    gdcm::Reader reader;
-    reader.SetFileName(it->c_str());
+    size_t batch_end = std::min(batch_start + batch_size, filenames.size());
 
-    // Try reading this file. Fail quietly.
-    bool read = false;
-    try { read = reader.ReadSelectedTags(tags_all, true); }
-    catch(...) {}
+    mt->ParallelizeArray(batch_start, batch_end, [&](itk::SizeValueType iFile)
+      {
+      DicomFileHeader &hdr = headers[iFile - batch_start];
+      hdr.Valid = false;
 
-    // If nothing read, keep going
-    if(!read)
-      continue;
+      // Check the index first
+      hdr.Indexed = index.Lookup(filenames[iFile], tags_index, hdr.Valid, hdr.Values);
+      if(!hdr.Indexed)
+        {
+        // Process each filename in the directory
+        gdcm::Reader reader;
+        reader.SetFileName(filenames[iFile].c_str());
+
+        // Try reading this file. Fail quietly.
+        bool read = false;
+        try { read = reader.ReadSelectedTags(tags_all, true); }
+        catch(...) {}
+
+        // If nothing read, keep going
+        hdr.Valid = read;
+        if(!read)
+          return;
+
+        // Create a string filter to get tags
+        gdcm::StringFilter sf;
+        sf.SetFile(reader.GetFile());
+
+        hdr.Values.resize(tags_index.size());
+        for(size_t iTag = 0u; iTag < tags_index.size(); iTag++)
+          hdr.Values[iTag] = sf.ToString(tags_index[iTag]);
+        }
 
-    // Create a string filter to get tags
-    gdcm::StringFilter sf;
-    sf.SetFile(reader.GetFile());
+      if(!hdr.Valid)
+        return;
 
-    // Start with the ID being the UID
-    std::string uid = sf.ToString(m_tagSeriesInstanceUID);
-    std::string full_id = uid;
+      // Get a tag value by tag
+      auto tag_value = [&](const gdcm::Tag &tag) -> const std::string &
+        {
+        return hdr.Values[std::find(tags_index.begin(), tags_index.end(), tag) - tags_index.begin()];
+        };
 
-    // Iterate over the tags in the refine list
-		for(size_t iTag = 0u; iTag < tags_refine.size(); iTag++)
-      {
-      // Read the tag value
-      std::string s = sf.ToString(tags_refine[iTag]);
+      // Start with the ID being the UID
+      std::string uid = tag_value(m_tagSeriesInstanceUID);
+      std::string full_id = uid;
 
-      // This code is from gdcmSerieHelper
-      if( full_id == uid && !s.empty() )
+      // Iterate over the tags in the refine list
+      for(size_t iTag = 0u; iTag < tags_refine.size(); iTag++)
         {
-        full_id += "."; // add separator
+        // Read the tag value
+        std::string s = tag_value(tags_refine[iTag]);
+
+        // This code is from gdcmSerieHelper
+        if( full_id == uid && !s.empty() )
+          {
+          full_id += "."; // add separator
+          }
+        full_id += s;
         }
-      full_id += s;
-      }
 
-    // Eliminate non-alnum characters, including whitespace...
-    //   that may have been introduced by concats.
-    for(size_t i=0; i<full_id.size(); i++)
-      {
-      while(i<full_id.size()
-        && !( full_id[i] == '.'
-          || (full_id[i] >= 'a' && full_id[i] <= 'z')
-          || (full_id[i] >= '0' && full_id[i] <= '9')
-          || (full_id[i] >= 'A' && full_id[i] <= 'Z')))
+      // Eliminate non-alnum characters, including whitespace...
+      //   that may have been introduced by concats.
+      for(size_t i=0; i<full_id.size(); i++)
         {
-        full_id.erase(i, 1);
+        while(i<full_id.size()
+          && !( full_id[i] == '.'
+            || (full_id[i] >= 'a' && full_id[i] <= 'z')
+            || (full_id[i] >= '0' && full_id[i] <= '9')
+            || (full_id[i] >= 'A' && full_id[i] <= 'Z')))
+          {
+          full_id.erase(i, 1);
+          }
         }
-      }
 
-    // The info for the current series
-    DicomDirectoryParseResult::DicomSeriesInfo &series_info
-        = m_LastDicomParseResult.SeriesMap[full_id];
+      hdr.FullId = full_id;
+      hdr.Desc = tag_value(m_tagDesc);
+      hdr.SeriesNumber = tag_value(m_tagSeriesNumber);
+      hdr.Rows = tag_value(m_tagRows);
+      hdr.Cols = tag_value(m_tagCols);
+      }, nullptr);
 
-    // The registry for the current series
-    Registry &r = series_info.MetaData;
+    // Record newly read headers in the index
+    for(size_t iFile = batch_start; iFile < batch_end; iFile++)
+      {
+      const DicomFileHeader &hdr = headers[iFile - batch_start];
+      if(!hdr.Indexed)
+        index.Store(filenames[iFile], tags_index, hdr.Valid, hdr.Values);
+      }
 
-    // Have we found this ID before?
-    if(r.IsEmpty())
+    // Merge the batch into the series map
+    for(size_t iFile = batch_start; iFile < batch_end; iFile++)
       {
-      r["SeriesId"] << full_id;
+      const DicomFileHeader &hdr = headers[iFile - batch_start];
+      if(!hdr.Valid)
+        continue;
 
-      // Read series description
-      r["SeriesDescription"] << sf.ToString(m_tagDesc);
-      r["SeriesNumber"] << sf.ToString(m_tagSeriesNumber);
+      // The info for the current series
+      DicomDirectoryParseResult::DicomSeriesInfo &series_info
+          = m_LastDicomParseResult.SeriesMap[hdr.FullId];
 
-      // Read the dimensions
-      r["Rows"] << std::atoi(sf.ToString(m_tagRows).c_str());
-      r["Columns"] << std::atoi(sf.ToString(m_tagCols).c_str());
-      r["NumberOfImages"] << 1;
-      }
-    else
-      {
-      // Increement the number of images
-      r["NumberOfImages"] << r["NumberOfImages"][0] + 1;
-      }
+      // The registry for the current series
+      Registry &r = series_info.MetaData;
 
-    // Update the dimensions string
-    ostringstream oss;
-    oss << r["Rows"][0] << " x " << r["Columns"][0] << " x " << r["NumberOfImages"][0];
-    r["Dimensions"] << oss.str();
+      // Have we found this ID before?
+      if(r.IsEmpty())
+        {
+        r["SeriesId"] << hdr.FullId;
 
-    // Update the filelist
-    series_info.FileList.push_back(*it);
+        // Read series description
+        r["SeriesDescription"] << hdr.Desc;
+        r["SeriesNumber"] << hdr.SeriesNumber;
 
-    // Indicate some progress
+        // Read the dimensions
+        r["Rows"] << std::atoi(hdr.Rows.c_str());
+        r["Columns"] << std::atoi(hdr.Cols.c_str());
+        r["NumberOfImages"] << 1;
+        }
+      else
+        {
+        // Increement the number of images
+        r["NumberOfImages"] << r["NumberOfImages"][0] + 1;
+        }
+
+      // Update the dimensions string
+      ostringstream oss;
+      oss << r["Rows"][0] << " x " << r["Columns"][0] << " x " << r["NumberOfImages"][0];
+      r["Dimensions"] << oss.str();
+
+      // Update the filelist
+      series_info.FileList.push_back(filenames[iFile]);
+      }
+
+    // Indicate some progress. This is done from the calling thread, since
+    // the command may be processing GUI events
     if(progressCommand)
       progressCommand->Execute(this, itk::ProgressEvent());
     }
 
+  // Keep the headers for the next time this directory is opened
+  index.Save();
+
   // Complain if no series have been found
   if(m_LastDicomParseResult.SeriesMap.size() == 0)
     throw IRISException(
@@ -198,6 +198,48 @@ public:
   bool IsNativeImageLoaded() const
     { return m_NativeImage.IsNotNull(); }
 
+  /**
+   * Get the range of the native image intensities over all components. This
+   * is only available if the range was computed as the image was read in
+   * chunks; otherwise false is returned.
+   */
+  bool GetNativeIntensityRange(double &imin, double &imax) const;
+
+  /**
+   * Set the approximate size, in bytes, of the chunks in which the image data
+   * is read when the format supports streaming. Reading in chunks gives finer
+   * progress reporting and computes the intensity range while the data is in
+   * cache. Compressed files are never read in chunks, since each chunk would
+   * have to decompress the file from the start. Zero disables streaming.
+   *
+   * The native image becomes available only after the last chunk has been
+   * read, so the image is not displayed while it is being read, and its
+   * histogram is computed by the image wrapper once it is loaded.
+   */
+  irisSetMacro(StreamingChunkSize, unsigned long)
+  irisGetMacro(StreamingChunkSize, unsigned long)
+
+  /**
+   * Whether uncompressed NIfTI, MetaImage, VoxBo CUB and raw images may be
+   * mapped into memory instead of being read (on by default). The native
+   * image then shares its memory with the page cache. If the native type is
+   * the internal type of the image wrapper, casting passes the mapping on to
+   * the wrapper, so the loaded image uses no memory of its own and several
+   * programs opening the same file share it. Otherwise the cast converts the
+   * data into a new buffer.
+   *
+   * Voxels changed by ITK-SNAP are never written to the file. Before saving
+   * over a mapped file, SaveImage() copies the mapped data into memory. While
+   * a mapping is in use, the file must not be modified by other programs: if
+   * it is truncated, accessing the image crashes with a bus error, and if it
+   * is rewritten in place, the image data changes.
+   */
+  irisSetMacro(UseMemoryMapping, bool)
+  irisGetMacro(UseMemoryMapping, bool)
+
+  /** Whether the native image data is mapped from the image file */
+  irisGetMacro(NativeImageMapped, bool)
+
   /** 
    * Save the native image it its native format (to a different location and
    * filename, presumably). This function is not meant as part of the normal
@@ -217,7 +259,10 @@ public:
    * the format of interest.
    */
   void DeallocateNativeImage()
-    { m_IOBase = NULL; m_NativeImage = NULL; }
+    {
+    m_IOBase = NULL; m_NativeImage = NULL;
+    m_NativeRangeValid = false; m_NativeImageMapped = false;
+    }
 
   /** 
    * Get RAI code for an image. If there is nothing in the registry, this will
@@ -371,6 +416,26 @@ protected:
   // The reader supports reading up to 4-dimensional data
   vnl_vector_fixed<unsigned int, 4> m_NativeDimensions;
 
+  // Intensity range of the native image, computed while streaming
+  double m_NativeRangeMin, m_NativeRangeMax;
+  bool m_NativeRangeValid;
+
+  // Size of the chunks for streamed reading
+  unsigned long m_StreamingChunkSize;
+
+  // Memory mapping of image files
+  bool m_UseMemoryMapping, m_NativeImageMapped;
+
+  /**
+   * Check whether the data of the image opened by ReadNativeImageHeader() is
+   * stored uncompressed, in native byte order and in the same layout as the
+   * native image, and if so find the file and offset where it is stored.
+   */
+  bool GetMappableDataLocation(std::string &file, size_t &offset);
+
+  /** Check whether the image opened by ReadNativeImageHeader() is compressed */
+  bool IsImageDataCompressed();
+
   // Copy of the registry passed in when reading header
   Registry m_Hints;
 
@@ -415,7 +480,7 @@ template<class TOutputImage>
 class RescaleNativeImageToIntegralType
 {
 public:
-  RescaleNativeImageToIntegralType() {}
+  RescaleNativeImageToIntegralType() : m_KnownRangeValid(false) {}
   virtual ~RescaleNativeImageToIntegralType() {}
 
   typedef TOutputImage                                         OutputImageType;
@@ -437,6 +502,10 @@ private:
   typename OutputImageType::Pointer m_Output;
   double m_NativeScale, m_NativeShift;
 
+  // Intensity range of the native image, if known from reading it
+  bool m_KnownRangeValid;
+  double m_KnownMin, m_KnownMax;
+
   // Method that does the casting
   template<typename TNative> void DoCast(NativeImageType *native);
 };
@@ -49,6 +49,7 @@
 #include "itkRegionOfInterestImageFilter.h"
 #include "itkIdentityTransform.h"
 #include "AdaptiveSlicingPipeline.h"
+#include "DisplaySliceCacheFilter.h"
 #include "SNAPSegmentationROISettings.h"
 #include "itkCommand.h"
 #include "ImageCoordinateGeometry.h"
@@ -78,8 +79,10 @@
 #include <vnl/vnl_inverse.h>
 #include <iostream>
 #include <cassert>
+#include <algorithm>
 
 #include <itksys/SystemTools.hxx>
+#include "MemoryMappedImageContainer.h"
 
 
 template <class TPixel>
@@ -209,6 +212,13 @@ public:
                         image_4d->GetNameOfClass());
   }
 
+  static void AdviseTimePointResidency(Image4DType *itkNotUsed(image_4d),
+                                      unsigned int itkNotUsed(tp),
+                                      bool itkNotUsed(resident))
+  {
+    // Only images mapped from a file can be paged in and out
+  }
+
   static void UpdatePixelContainer(Image4DType *image_4d,
                                    typename Image4DType::PixelContainer *itkNotUsed(container))
   {
@@ -369,6 +379,24 @@ public:
     image_4d->SetPixelContainer(image_tp->GetPixelContainer());
   }
 
+  static void AdviseTimePointResidency(Image4DType *image_4d,
+                                      unsigned int tp,
+                                      bool resident)
+  {
+    typedef typename Image4DType::PixelContainer PixelContainer;
+    typedef MemoryMappedImageContainer<
+        typename PixelContainer::ElementIdentifier,
+        typename PixelContainer::Element> MappedContainer;
+
+    MappedContainer *mapped = dynamic_cast<MappedContainer *>(image_4d->GetPixelContainer());
+    if(mapped)
+      {
+      unsigned int nt = image_4d->GetBufferedRegion().GetSize()[TImage::ImageDimension];
+      size_t n = mapped->Size() / nt;
+      mapped->AdviseElements(n * tp, n, resident);
+      }
+  }
+
   static void UpdatePixelContainer(Image4DType *image_4d,
                                    typename Image4DType::PixelContainer *container)
   {
@@ -837,9 +865,12 @@ ImageWrapper<TTraits,TBase>
   // Create empty IO hints
   m_IOHints = new Registry();
 
-  // Create the slicers
+  // Create the slicers and the display slice caches
   for(unsigned int i = 0; i < 3; i++)
+    {
     m_Slicers[i] = SlicerType::New();
+    m_DisplaySliceCache[i] = DisplaySliceCacheFilter::New();
+    }
 
   // Initialize the display mapping
   m_DisplayMapping = DisplayMapping::New();
@@ -1267,6 +1298,18 @@ ImageWrapper<TTraits,TBase>
     m_TimePointSelectFilter->AddSelectableInput(i, ip);
     }
 
+  // Start over with the time points that are kept in memory. Loading the
+  // image may have read all of them, so all are released except the ones
+  // around the current time point
+  m_ResidentTimePoints.clear();
+  if(nt > 1 && m_ResidentTimePointWindow > 0)
+    {
+    typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+    for(unsigned int i = 0; i < nt; i++)
+      Specialization::AdviseTimePointResidency(image_4d, i, false);
+    }
+  this->UpdateResidentTimePoints();
+
   // Update the selected time point in the selector
   m_TimePointSelectFilter->SetSelectedInput(m_TimePointIndex);
 
@@ -1692,6 +1735,29 @@ void
 ImageWrapper<TTraits,TBase>
 ::SetSliceIndex(const IndexType &cursor)
 {
+  // Queue up the slices that are likely to be shown next, i.e., the ones
+  // that follow the new position in the direction of scrolling
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    if(!m_ReferenceSpace || !m_Slicers[i]->GetOrthogonalTransform())
+      continue;
+
+    unsigned int axis = this->GetDisplaySliceImageAxis(i);
+    long delta = cursor[axis] - m_SliceIndex[axis];
+    if(delta == 0)
+      continue;
+
+    long step = delta > 0 ? 1 : -1;
+    long size = m_ReferenceSpace->GetLargestPossibleRegion().GetSize()[axis];
+    m_PrefetchQueue[i].clear();
+    for(long k = 1; k <= 4; k++)
+      {
+      long target = cursor[axis] + k * step;
+      if(target >= 0 && target < size)
+        m_PrefetchQueue[i].push_back(target);
+      }
+    }
+
   // Save the cursor position
   m_SliceIndex = cursor;
 
@@ -1717,6 +1783,43 @@ ImageWrapper<TTraits,TBase>
     // Update the image selector
     m_TimePointSelectFilter->SetSelectedInput(index);
     m_TimePointSelectFilter->Update();
+
+    this->UpdateResidentTimePoints();
+    }
+}
+
+template<class TTraits, class TBase>
+void
+ImageWrapper<TTraits,TBase>
+::UpdateResidentTimePoints()
+{
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  unsigned int nt = m_ImageTimePoints.size();
+  if(nt < 2 || m_ResidentTimePointWindow == 0)
+    return;
+
+  // The current time point and the ones that follow it during playback are
+  // the most recently used, in that order
+  unsigned int n_ahead = std::min(m_TimePointPrefetchCount, nt - 1);
+  for(int k = (int) n_ahead; k >= 0; k--)
+    {
+    unsigned int tp = (m_TimePointIndex + k) % nt;
+    bool is_new = std::find(m_ResidentTimePoints.begin(), m_ResidentTimePoints.end(), tp)
+        == m_ResidentTimePoints.end();
+    if(!is_new)
+      m_ResidentTimePoints.remove(tp);
+    m_ResidentTimePoints.push_front(tp);
+
+    // Start reading time points that are not in memory yet
+    if(is_new)
+      Specialization::AdviseTimePointResidency(m_Image4D, tp, true);
+    }
+
+  // Release the least recently used time points
+  while(m_ResidentTimePoints.size() > std::max(m_ResidentTimePointWindow, n_ahead + 1))
+    {
+    Specialization::AdviseTimePointResidency(m_Image4D, m_ResidentTimePoints.back(), false);
+    m_ResidentTimePoints.pop_back();
     }
 }
 
@@ -1965,7 +2068,40 @@ template<class TTraits, class TBase>
 typename ImageWrapper<TTraits,TBase>::DisplaySlicePointer
 ImageWrapper<TTraits,TBase>::GetDisplaySlice(unsigned int dim)
 {
-  return m_DisplayMapping->GetDisplaySlice(dim);
+  // The display mapping may switch between slices (e.g., for previews), so
+  // the input of the cache is updated on every call
+  DisplaySlicePointer slice = m_DisplayMapping->GetDisplaySlice(dim);
+  if(!slice)
+    return slice;
+
+  m_DisplaySliceCache[dim]->SetInput(slice);
+  return m_DisplaySliceCache[dim]->GetOutput();
+}
+
+template<class TTraits, class TBase>
+bool
+ImageWrapper<TTraits,TBase>
+::PrefetchDisplaySlice(unsigned int dim)
+{
+  if(!m_Initialized || !m_DisplaySliceCache[dim]->GetInput()
+     || !m_Slicers[dim]->IsOrthogonalSlice())
+    {
+    m_PrefetchQueue[dim].clear();
+    return false;
+    }
+
+  if(m_PrefetchQueue[dim].empty())
+    return false;
+
+  long target = m_PrefetchQueue[dim].front();
+  m_PrefetchQueue[dim].pop_front();
+
+  // The slicers feeding the display slice (which, for multi-component images,
+  // may belong to the component wrappers) compute the target slice with their
+  // own prefetch slicers, so the displayed pipeline is not disturbed
+  m_DisplaySliceCache[dim]->Prefetch(target);
+
+  return !m_PrefetchQueue[dim].empty();
 }
 
 template<class TTraits, class TBase>
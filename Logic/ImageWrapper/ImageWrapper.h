@@ -44,6 +44,8 @@
 #include <DisplayMappingPolicy.h>
 #include <itkSimpleDataObjectDecorator.h>
 #include <array>
+#include <deque>
+#include <list>
 #include <vector>
 
 // Forward declarations to IRIS classes
@@ -51,6 +53,7 @@ template <class TFunctor> class UnaryValueToValueFilter;
 
 template <class TInputImage, class TOutputImage, class TTraits>
 class AdaptiveSlicingPipeline;
+class DisplaySliceCacheFilter;
 
 template <class TInputImage, class TTag> class InputSelectionImageFilter;
 
@@ -402,6 +405,21 @@ public:
   /** Set the current time index */
   virtual void SetTimePointIndex(unsigned int index) ITK_OVERRIDE;
 
+  /**
+   * Set the number of time points kept in memory. This only has an effect on
+   * 4D images that are mapped from the image file (see GuidedNativeImageIO),
+   * whose time points are read from the file as they are accessed. The most
+   * recently used time points are kept, and the rest are released from memory
+   * and read again when needed.
+   */
+  irisGetSetMacro(ResidentTimePointWindow, unsigned int)
+
+  /**
+   * Set the number of time points after the current one that are read ahead
+   * of time, for smooth playback of mapped 4D images
+   */
+  irisGetSetMacro(TimePointPrefetchCount, unsigned int)
+
   const ImageBaseType* GetDisplayViewportGeometry(unsigned int index) const;
 
   virtual void SetDisplayViewportGeometry(
@@ -524,6 +542,13 @@ public:
    */
   DisplaySlicePointer GetDisplaySlice(unsigned int dim) ITK_OVERRIDE;
 
+  /**
+   * Have the slicers that feed the display slice in the given direction
+   * compute the next slice queued for prefetching, using their own prefetch
+   * slicers.
+   */
+  virtual bool PrefetchDisplaySlice(unsigned int dim) ITK_OVERRIDE;
+
   /**
     Attach a preview pipeline to the wrapper. This is used with wrappers that
     represent results of image processing operations, such as speed images.
@@ -726,6 +751,14 @@ protected:
   /** The current time point (index into m_ImageTimePoints) */
   unsigned int m_TimePointIndex = 0;
 
+  /** Time points of a mapped 4D image kept in memory, most recently used first */
+  std::list<unsigned int> m_ResidentTimePoints;
+  unsigned int m_ResidentTimePointWindow = 8;
+  unsigned int m_TimePointPrefetchCount = 2;
+
+  /** Prefetch time points around the current one and release unused ones */
+  void UpdateResidentTimePoints();
+
   /**
    * Is the image wrapper initialized? That is a prerequisite for all
    * operations.
@@ -747,6 +780,12 @@ protected:
   /** The pipeline that handles mapping intensities to the display slices */
   SmartPtr<DisplayMapping> m_DisplayMapping;
 
+  /** Caches of recently displayed slices, one per slice direction */
+  SmartPtr<DisplaySliceCacheFilter> m_DisplaySliceCache[3];
+
+  /** Slices to prefetch in each direction, in the direction of scrolling */
+  std::deque<long> m_PrefetchQueue[3];
+
   // Mapping from native to internal format
   NativeIntensityMapping m_NativeMapping;
 
@@ -292,6 +292,12 @@ public:
   /** Get a display slice correpsponding to the current index */
   virtual DisplaySlicePointer GetDisplaySlice(unsigned int dim) = 0;
 
+  /**
+    Prefetch one of the display slices that are likely to be shown next in
+    the given direction. Returns true if more slices remain to be prefetched.
+    */
+  virtual bool PrefetchDisplaySlice(unsigned int dim) = 0;
+
   /** For each slicer, find out which image dimension does is slice along */
   virtual unsigned int GetDisplaySliceImageAxis(unsigned int slice) = 0;
 
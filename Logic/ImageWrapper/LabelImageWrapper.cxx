@@ -43,9 +43,13 @@
 #include "LabelImageWrapper.h"
 #include "UndoDataManager.h"
 #include "Rebroadcaster.h"
+#include "itkImageRegionIterator.h"
+#include <algorithm>
 
 LabelImageWrapper::LabelImageWrapper()
 {
+  m_OccupancyImage = NULL;
+  m_OccupancyMTime = 0;
 }
 
 LabelImageWrapper::~LabelImageWrapper()
@@ -65,10 +69,23 @@ void LabelImageWrapper::UpdateWrappedImages(
   for(auto p : m_TimePointUndoManagers)
     delete p;
 
-  // Set up new undo managers
+  // Set up new undo managers. Older commits are kept compressed; with many
+  // time points they are also moved out of memory into a temporary file,
+  // which is shared by all the time points
+  m_UndoSpillFile = NULL;
+  if(this->GetNumberOfTimePoints() > 1)
+    m_UndoSpillFile = UndoSpillFile::New();
+
   m_TimePointUndoManagers.resize(this->GetNumberOfTimePoints());
   for(auto &p : m_TimePointUndoManagers)
+    {
     p = new UndoManagerType(4, 200000);
+    p->SetSpillFile(m_UndoSpillFile);
+    }
+
+  // Label counts are computed when first requested
+  m_TimePointLabelCounts.clear();
+  m_TimePointLabelCounts.resize(this->GetNumberOfTimePoints());
 
   // Modified event on the image is rebroadcast as the WrapperImageChangeEvent
   Rebroadcaster::Rebroadcast(image_4d, itk::ModifiedEvent(), this, WrapperImageChangeEvent());
@@ -121,35 +138,14 @@ void LabelImageWrapper::Undo()
   // Get the commit for the undo
   const UndoManagerType::Commit &commit = um->GetCommitForUndo();
 
-  // The label image that will undergo undo
-  typedef itk::ImageRegionIterator<ImageType> IteratorType;
-
   // Iterate over all the deltas in reverse order
+  LabelCountDelta count_delta;
   UndoManagerType::DList::const_reverse_iterator dit = commit.GetDeltas().rbegin();
   for(; dit != commit.GetDeltas().rend(); ++dit)
-    {
-    // Apply the changes in the current delta
-    UndoManagerType::Delta *delta = *dit;
-
-    // Iterator for the relevant region in the label image
-    IteratorType lit(m_Image, delta->GetRegion());
-
-    // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
-      {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
-      for(size_t j = 0; j < n; j++)
-        {
-        if(d != 0)
-          lit.Set(lit.Get() - d);
-        ++lit;
-        }
-      }
-    }
+    this->ApplyUndoDelta(*dit, false, count_delta);
 
   // Set modified flags
-  this->PixelsModified();
+  this->PixelsModified(count_delta);
 }
 
 bool LabelImageWrapper::IsRedoPossible()
@@ -165,35 +161,100 @@ void LabelImageWrapper::Redo()
   // Get the commit for the redo
   const UndoManagerType::Commit &commit = um->GetCommitForRedo();
 
-  // The label image that will undergo redo
-  typedef itk::ImageRegionIterator<ImageType> IteratorType;
-
-  // Iterate over all the deltas in reverse order
+  // Iterate over all the deltas in forward order
+  LabelCountDelta count_delta;
   UndoManagerType::DList::const_iterator dit = commit.GetDeltas().begin();
   for(; dit != commit.GetDeltas().end(); ++dit)
-    {
-    // Apply the changes in the current delta
-    UndoManagerType::Delta *delta = *dit;
+    this->ApplyUndoDelta(*dit, true, count_delta);
+
+  // Set modified flags
+  this->PixelsModified(count_delta);
+}
 
-    // Iterator for the relevant region in the label image
-    IteratorType lit(m_Image, delta->GetRegion());
+void LabelImageWrapper::ApplyUndoDelta(
+    UndoManagerDelta *delta, bool redo, LabelCountDelta &count_delta)
+{
+  typedef ImageType::RLLine RLLine;
+  typedef ImageType::RLSegment RLSegment;
+  typedef ImageType::BufferType BufferType;
+
+  // The delta covers its region in raster order, so it can be consumed one
+  // scanline at a time. Within a scanline, it only affects the x-range below
+  // (relative to the start of the run-length encoded line)
+  const UndoManagerDelta::RegionType &region = delta->GetRegion();
+  long x0 = region.GetIndex(0) - m_Image->GetBufferedRegion().GetIndex(0);
+  long x1 = x0 + region.GetSize(0);
+  size_t width = region.GetSize(0);
+
+  // Position in the delta: current RLE and the voxels left in it
+  size_t n_rle = delta->GetNumberOfRLEs();
+  size_t i_rle = 0;
+  size_t rle_left = n_rle ? delta->GetRLELength(0) : 0;
+
+  // Line into which the updated scanline is written
+  RLLine out;
+
+  itk::ImageRegionIterator<BufferType> itLine(
+        m_Image->GetBuffer(), ImageType::truncateRegion(region));
+  for(; !itLine.IsAtEnd() && i_rle < n_rle; ++itLine)
+    {
+    // Scanlines fully covered by a run of zeros in the delta are unchanged
+    if(delta->GetRLEValue(i_rle) == 0 && rle_left >= width)
+      {
+      rle_left -= width;
+      if(rle_left == 0 && ++i_rle < n_rle)
+        rle_left = delta->GetRLELength(i_rle);
+      continue;
+      }
 
-    // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    // Rebuild the scanline, splitting its segments where the delta changes
+    // and merging adjacent segments with the same value
+    RLLine &line = itLine.Value();
+    out.clear();
+    out.reserve(line.size() + 2);
+    long pos = 0;
+    for(size_t s = 0; s < line.size(); s++)
       {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
-      for(size_t j = 0; j < n; j++)
+      LabelType value = line[s].second;
+      long a = pos, seg_end = pos + line[s].first;
+      pos = seg_end;
+      while(a < seg_end)
         {
-        if(d != 0)
-          lit.Set(lit.Get() + d);
-        ++lit;
+        LabelType new_value = value;
+        long b = seg_end;
+        if(a < x0)
+          {
+          // Portion of the segment before the delta
+          b = std::min(seg_end, x0);
+          }
+        else if(a < x1 && i_rle < n_rle)
+          {
+          // Portion of the segment covered by the current delta RLE
+          b = std::min(std::min(seg_end, x1), a + (long) rle_left);
+          LabelType d = delta->GetRLEValue(i_rle);
+          new_value = static_cast<LabelType>(redo ? value + d : value - d);
+          rle_left -= b - a;
+          if(rle_left == 0 && ++i_rle < n_rle)
+            rle_left = delta->GetRLELength(i_rle);
+
+          // Record the change in the label counts
+          if(new_value != value)
+            {
+            count_delta[value] -= b - a;
+            count_delta[new_value] += b - a;
+            }
+          }
+
+        if(out.size() && out.back().second == new_value)
+          out.back().first += b - a;
+        else
+          out.push_back(RLSegment(b - a, new_value));
+        a = b;
         }
       }
-    }
 
-  // Set modified flags
-  this->PixelsModified();
+    line.swap(out);
+    }
 }
 
 const
@@ -209,10 +270,110 @@ LabelImageWrapper::CompressImage() const
 {
   UndoManagerDelta *new_cumulative = new UndoManagerDelta();
 
-  itk::ImageRegionConstIterator<ImageType> it(m_Image, m_Image->GetLargestPossibleRegion());
+  // Encode the image one RLE segment at a time rather than voxel by voxel
+  typedef ImageType::BufferType BufferType;
+  BufferType *buffer = m_Image->GetBuffer();
+  itk::ImageRegionConstIterator<BufferType> it(
+        buffer, ImageType::truncateRegion(m_Image->GetLargestPossibleRegion()));
   for (; !it.IsAtEnd(); ++it)
-    new_cumulative->Encode(it.Get());
+    {
+    const ImageType::RLLine &line = it.Value();
+    for(size_t i = 0; i < line.size(); i++)
+      new_cumulative->Encode(line[i].second, line[i].first);
+    }
 
   new_cumulative->FinishEncoding();
   return new_cumulative;
 }
+
+LabelImageWrapper::LabelCountTable &
+LabelImageWrapper::UpdateLabelCounts()
+{
+  LabelCountTable &table = m_TimePointLabelCounts[m_TimePointIndex];
+  ImageType *image = m_ImageTimePoints[m_TimePointIndex];
+  if(table.MTime == image->GetMTime())
+    return table;
+
+  // Count whole runs at a time
+  table.Counts.clear();
+  typedef ImageType::BufferType BufferType;
+  itk::ImageRegionConstIterator<BufferType> it(
+        image->GetBuffer(), ImageType::truncateRegion(image->GetBufferedRegion()));
+  LabelType runLabel = 0;
+  unsigned long *cachedCnt = &table.Counts[runLabel];
+  for(; !it.IsAtEnd(); ++it)
+    {
+    const ImageType::RLLine &line = it.Value();
+    for(size_t i = 0; i < line.size(); i++)
+      {
+      if(line[i].second != runLabel)
+        {
+        runLabel = line[i].second;
+        cachedCnt = &table.Counts[runLabel];
+        }
+      *cachedCnt += line[i].first;
+      }
+    }
+
+  // The clear label is inserted above even if absent
+  LabelCountMap::iterator itZero = table.Counts.find(0);
+  if(itZero->second == 0)
+    table.Counts.erase(itZero);
+
+  table.MTime = image->GetMTime();
+  return table;
+}
+
+unsigned long
+LabelImageWrapper::GetNumberOfVoxelsWithLabel(LabelType label)
+{
+  const LabelCountMap &counts = this->UpdateLabelCounts().Counts;
+  LabelCountMap::const_iterator it = counts.find(label);
+  return it == counts.end() ? 0 : it->second;
+}
+
+const LabelImageWrapper::LabelCountMap &
+LabelImageWrapper::GetLabelCounts()
+{
+  return this->UpdateLabelCounts().Counts;
+}
+
+void
+LabelImageWrapper::PixelsModified(const LabelCountDelta &count_delta)
+{
+  // Are the counts valid before the modification?
+  LabelCountTable &table = m_TimePointLabelCounts[m_TimePointIndex];
+  ImageType *image = m_ImageTimePoints[m_TimePointIndex];
+  bool valid = (table.MTime == image->GetMTime());
+
+  Superclass::PixelsModified();
+
+  // If so, apply the changes and keep them valid; otherwise they will be
+  // recomputed when next requested
+  if(valid)
+    {
+    for(LabelCountDelta::const_iterator it = count_delta.begin(); it != count_delta.end(); ++it)
+      {
+      if(it->second == 0)
+        continue;
+      unsigned long &count = table.Counts[it->first];
+      count = static_cast<unsigned long>(count + it->second);
+      if(count == 0)
+        table.Counts.erase(it->first);
+      }
+    table.MTime = image->GetMTime();
+    }
+}
+
+const LabelOccupancyMap *
+LabelImageWrapper::GetOccupancyMap()
+{
+  ImageType *image = m_ImageTimePoints[m_TimePointIndex];
+  if(m_OccupancyImage != image || m_OccupancyMTime != image->GetMTime())
+    {
+    m_OccupancyMap.Compute(image);
+    m_OccupancyImage = image;
+    m_OccupancyMTime = image->GetMTime();
+    }
+  return &m_OccupancyMap;
+}
@@ -3,6 +3,8 @@
 
 #include "ImageWrapperTraits.h"
 #include "ScalarImageWrapper.h"
+#include "LabelOccupancyMap.h"
+#include <map>
 
 template <typename TPixel> class UndoDataManager;
 template <typename TPixel> class UndoDelta;
@@ -31,6 +33,10 @@ public:
   typedef UndoDataManager<PixelType> UndoManagerType;
   typedef UndoDelta<PixelType>       UndoManagerDelta;
 
+  // Number of voxels with each label, and changes to these numbers
+  typedef std::map<LabelType, unsigned long> LabelCountMap;
+  typedef std::map<LabelType, long>          LabelCountDelta;
+
   // We are friends with the SegmentationUpdateIterator
   friend class SegmentationUpdateIterator;
 
@@ -83,16 +89,82 @@ public:
    * array created in this call. */
   UndoManagerDelta *CompressImage() const;
 
+  /**
+   * Get the number of voxels with a given label in the current time point.
+   * The counts are kept up to date as the segmentation is edited, so this
+   * does not require a pass over the image.
+   */
+  unsigned long GetNumberOfVoxelsWithLabel(LabelType label);
+
+  /**
+   * Get the number of voxels with each label in the current time point.
+   * Labels that are not present in the image are not included.
+   */
+  const LabelCountMap &GetLabelCounts();
+
+  /**
+   * Call this method instead of PixelsModified() when the change in the
+   * number of voxels with each label is known. This keeps the label counts
+   * valid without recounting.
+   */
+  void PixelsModified(const LabelCountDelta &count_delta);
+
+  // Make the base class method visible
+  using Superclass::PixelsModified;
+
+  /**
+   * Get the map of empty and occupied bricks in the current time point. This
+   * is used to pass over empty parts of the image when casting rays into the
+   * segmentation. The map is recomputed when requested after the
+   * segmentation has changed.
+   */
+  const LabelOccupancyMap *GetOccupancyMap();
+
 protected:
 
   LabelImageWrapper();
   ~LabelImageWrapper();
 
+  /**
+   * Apply a delta to the current time point, subtracting it (undo) or adding
+   * it (redo). This works on whole runs: scanlines covered by runs of zeros
+   * are skipped, and each affected scanline is rewritten in one pass.
+   */
+  void ApplyUndoDelta(UndoManagerDelta *delta, bool redo, LabelCountDelta &count_delta);
+
+  /**
+   * Label counts for a time point. The counts are valid as long as the time
+   * point image has not been modified since they were computed. Writes that
+   * do not report their changes to the counts (i.e., that only call
+   * PixelsModified()) cause the counts to be recomputed on the next query.
+   */
+  struct LabelCountTable
+  {
+    LabelCountTable() : MTime(0) {}
+
+    LabelCountMap Counts;
+    itk::ModifiedTimeType MTime;
+  };
+
+  // Make sure the label counts for the current time point are valid
+  LabelCountTable &UpdateLabelCounts();
+
+  // Label counts for each time point
+  std::vector<LabelCountTable> m_TimePointLabelCounts;
+
+  // Occupancy map, and the image and time for which it was computed
+  LabelOccupancyMap m_OccupancyMap;
+  ImageType *m_OccupancyImage;
+  itk::ModifiedTimeType m_OccupancyMTime;
+
   // Undo data manager, stores 'deltas', i.e., differences between states of the segmentation
   // image. These deltas are compressed, allowing us to store a bunch of
   // undo steps with little cost in performance or memory. We currently associate each time
   // point with its own undo manager
   std::vector<UndoManagerType *> m_TimePointUndoManagers;
+
+  // Temporary file shared by the undo managers of all time points
+  SmartPtr<UndoSpillFile> m_UndoSpillFile;
 };
 
 #endif // LABELIMAGEWRAPPER_H
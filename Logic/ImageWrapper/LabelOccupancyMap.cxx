@@ -0,0 +1,174 @@
+#include "LabelOccupancyMap.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include <cmath>
+
+VoxelRayWalker::VoxelRayWalker(const double point[3], const double ray[3])
+{
+  for(int a = 0; a < 3; a++)
+    {
+    m_Index[a] = (long) point[a];
+    m_Steps[a] = 0;
+    m_Dir[a] = (ray[a] > 0) ? 1 : ((ray[a] < 0) ? -1 : 0);
+    if(m_Dir[a])
+      {
+      double border = (m_Dir[a] > 0) ? m_Index[a] + 1.0 : (double) m_Index[a];
+      m_TMax0[a] = (border - point[a]) / ray[a];
+      m_TDelta[a] = 1.0 / fabs(ray[a]);
+      }
+    else
+      {
+      m_TMax0[a] = m_TDelta[a] = 0.0;
+      }
+    m_TMax[a] = this->GetCrossing(a, 0);
+    }
+}
+
+void
+VoxelRayWalker
+::SkipBlock(const long lo[3], long size)
+{
+  // Number of steps that leave the block along each axis, and when they happen
+  long n[3];
+  double t_exit[3];
+  for(int a = 0; a < 3; a++)
+    {
+    n[a] = (m_Dir[a] > 0) ? lo[a] + size - m_Index[a] : m_Index[a] - lo[a] + 1;
+    t_exit[a] = this->GetCrossing(a, m_Steps[a] + n[a] - 1);
+    }
+
+  // The ray leaves through the earliest crossing, with ties going to the
+  // lowest axis as in Step()
+  int a_exit = 0;
+  if(t_exit[1] < t_exit[a_exit]) a_exit = 1;
+  if(t_exit[2] < t_exit[a_exit]) a_exit = 2;
+  double t = t_exit[a_exit];
+
+  // Along the other axes, Step() would have taken all crossings before the
+  // exit, and those at the same time on a lower axis. The crossing k is
+  // estimated from tMax0 and tDelta, and then checked with the same formula
+  // that Step() uses
+  for(int b = 0; b < 3; b++)
+    {
+    if(b == a_exit || !m_Dir[b])
+      continue;
+
+    long k_first = m_Steps[b], k_last = m_Steps[b] + n[b] - 1;
+    double k_est = ceil((t - m_TMax0[b]) / m_TDelta[b]);
+    long k = (k_est <= k_first) ? k_first : ((k_est >= k_last) ? k_last : (long) k_est);
+
+    while(k > k_first && !(b < a_exit ? this->GetCrossing(b, k - 1) <= t
+                                      : this->GetCrossing(b, k - 1) < t))
+      k--;
+    while(k < k_last && (b < a_exit ? this->GetCrossing(b, k) <= t
+                                    : this->GetCrossing(b, k) < t))
+      k++;
+
+    this->Advance(b, k - k_first);
+    }
+
+  this->Advance(a_exit, n[a_exit]);
+}
+
+LabelOccupancyMap::LabelOccupancyMap()
+{
+  m_ImageSize[0] = m_ImageSize[1] = m_ImageSize[2] = 0;
+}
+
+void
+LabelOccupancyMap
+::Compute(const ImageType *image)
+{
+  typedef ImageType::BufferType BufferType;
+
+  const itk::ImageRegion<3> &region = image->GetBufferedRegion();
+  for(unsigned int d = 0; d < 3; d++)
+    m_ImageSize[d] = (long) region.GetSize(d);
+
+  // Set up the levels, stopping when a brick covers the whole image
+  m_Levels.clear();
+  for(long bs = 8; m_Levels.size() < 3; bs *= 8)
+    {
+    Level level;
+    level.BrickSize = bs;
+    for(unsigned int d = 0; d < 3; d++)
+      level.Size[d] = (m_ImageSize[d] + bs - 1) / bs;
+    level.Occupied.assign(level.Size[0] * level.Size[1] * level.Size[2], 0);
+    m_Levels.push_back(level);
+
+    if(level.Size[0] <= 1 && level.Size[1] <= 1 && level.Size[2] <= 1)
+      break;
+    }
+
+  // Mark the finest bricks covered by the non-zero runs of each line
+  Level &fine = m_Levels[0];
+  const BufferType *buffer = image->GetBuffer();
+  itk::ImageRegionConstIteratorWithIndex<BufferType> it(buffer, buffer->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    const ImageType::RLLine &line = it.Get();
+    if(line.size() == 1 && line[0].second == 0)
+      continue;
+
+    long by = (it.GetIndex()[0] - region.GetIndex(1)) / fine.BrickSize;
+    long bz = (it.GetIndex()[1] - region.GetIndex(2)) / fine.BrickSize;
+    unsigned char *row = &fine.Occupied[(bz * fine.Size[1] + by) * fine.Size[0]];
+
+    long x = 0;
+    for(size_t i = 0; i < line.size(); i++)
+      {
+      long x_end = x + line[i].first;
+      if(line[i].second != 0)
+        {
+        for(long bx = x / fine.BrickSize; bx <= (x_end - 1) / fine.BrickSize; bx++)
+          row[bx] = 1;
+        }
+      x = x_end;
+      }
+    }
+
+  // Each coarser brick is occupied if any of the bricks it contains are
+  for(size_t k = 1; k < m_Levels.size(); k++)
+    {
+    const Level &src = m_Levels[k-1];
+    Level &trg = m_Levels[k];
+    for(long z = 0; z < src.Size[2]; z++)
+      for(long y = 0; y < src.Size[1]; y++)
+        for(long x = 0; x < src.Size[0]; x++)
+          if(src.Occupied[(z * src.Size[1] + y) * src.Size[0] + x])
+            trg.Occupied[((z / 8) * trg.Size[1] + y / 8) * trg.Size[0] + x / 8] = 1;
+    }
+}
+
+bool
+LabelOccupancyMap
+::IsBrickEmpty(unsigned int level, long x, long y, long z) const
+{
+  if(x < 0 || y < 0 || z < 0
+     || x >= m_ImageSize[0] || y >= m_ImageSize[1] || z >= m_ImageSize[2])
+    return false;
+
+  const Level &lev = m_Levels[level];
+  long bs = lev.BrickSize;
+  return !lev.Occupied[((z / bs) * lev.Size[1] + y / bs) * lev.Size[0] + x / bs];
+}
+
+bool
+LabelOccupancyMap
+::SkipEmptySpace(VoxelRayWalker &walker) const
+{
+  // Find the coarsest empty brick containing the voxel. Bricks inside an
+  // empty brick are empty as well
+  const long *idx = walker.GetIndex();
+  int level = -1;
+  while(level + 1 < (int) m_Levels.size()
+        && this->IsBrickEmpty(level + 1, idx[0], idx[1], idx[2]))
+    level++;
+
+  if(level < 0)
+    return false;
+
+  long bs = m_Levels[level].BrickSize;
+  long lo[3] = { (idx[0] / bs) * bs, (idx[1] / bs) * bs, (idx[2] / bs) * bs };
+  walker.SkipBlock(lo, bs);
+  return true;
+}
@@ -0,0 +1,130 @@
+#ifndef LABELOCCUPANCYMAP_H
+#define LABELOCCUPANCYMAP_H
+
+#include "SNAPCommon.h"
+#include "RLEImage.h"
+#include <limits>
+#include <vector>
+
+/**
+ * Walks along a ray through the voxels of an image, visiting each voxel that
+ * the ray passes through (Amanatides and Woo). The point and the ray are
+ * given in continuous index coordinates in which voxel borders fall on
+ * integer values, i.e., voxel i spans [i, i+1), and the point must not be
+ * negative.
+ *
+ * The parameter at which the ray crosses the k-th voxel border along an axis
+ * is always computed as tMax0 + k * tDelta, so the state of the walk depends
+ * only on the number of steps taken along each axis. This allows SkipBlock()
+ * to pass over a block of voxels in one go and end in exactly the state that
+ * stepping through the block would have reached.
+ */
+class VoxelRayWalker
+{
+public:
+
+  VoxelRayWalker(const double point[3], const double ray[3]);
+
+  /** Index of the current voxel */
+  const long *GetIndex() const
+    { return m_Index; }
+
+  /** Move to the next voxel along the ray */
+  void Step()
+  {
+    // Ties go to the lowest axis
+    int a = 0;
+    if(m_TMax[1] < m_TMax[a]) a = 1;
+    if(m_TMax[2] < m_TMax[a]) a = 2;
+    this->Advance(a, 1);
+  }
+
+  /**
+   * Move to the first voxel outside of the block [lo, lo + size) along each
+   * axis, which must contain the current voxel.
+   */
+  void SkipBlock(const long lo[3], long size);
+
+protected:
+
+  // Parameter of the ray at its k-th voxel border crossing along an axis
+  double GetCrossing(int a, long k) const
+    {
+    return m_Dir[a] ? m_TMax0[a] + k * m_TDelta[a]
+                    : std::numeric_limits<double>::infinity();
+    }
+
+  void Advance(int a, long n)
+    {
+    m_Steps[a] += n;
+    m_Index[a] += n * m_Dir[a];
+    m_TMax[a] = this->GetCrossing(a, m_Steps[a]);
+    }
+
+  // Current voxel, direction of the steps and number of steps along each axis
+  long m_Index[3], m_Dir[3], m_Steps[3];
+
+  // First border crossing, distance between crossings and next crossing
+  double m_TMax0[3], m_TDelta[3], m_TMax[3];
+};
+
+/**
+ * A coarse map of the parts of a label image that contain non-zero labels.
+ * The image is divided into cubic bricks of 8 voxels on a side, and each
+ * brick is marked as empty (all voxels have the clear label) or occupied.
+ * Coarser levels with bricks of 64 and 512 voxels are built on top of it.
+ *
+ * This is used when casting rays into the segmentation (e.g., for picking
+ * in the 3D window) to pass over empty parts of the image with a constant
+ * number of operations per brick instead of one per voxel. The walk visits
+ * the same voxels as without the map, so the hits are the same.
+ */
+class LabelOccupancyMap
+{
+public:
+
+  typedef RLEImage<LabelType> ImageType;
+
+  LabelOccupancyMap();
+
+  /** Compute the map for a label image */
+  void Compute(const ImageType *image);
+
+  /** Number of levels in the map, including the finest */
+  unsigned int GetNumberOfLevels() const
+    { return (unsigned int) m_Levels.size(); }
+
+  /** Size of the bricks at a given level, in voxels */
+  long GetBrickSize(unsigned int level) const
+    { return m_Levels[level].BrickSize; }
+
+  /**
+   * Check whether the brick at the given level containing the voxel index
+   * (relative to the corner of the image) contains only the clear label.
+   * Voxels outside of the image are not considered empty.
+   */
+  bool IsBrickEmpty(unsigned int level, long x, long y, long z) const;
+
+  /**
+   * Move a ray walk past the coarsest empty brick that contains its current
+   * voxel. Returns false, leaving the walk unchanged, if the current voxel
+   * is in an occupied brick.
+   */
+  bool SkipEmptySpace(VoxelRayWalker &walker) const;
+
+protected:
+
+  struct Level
+  {
+    long BrickSize;
+    long Size[3];
+    std::vector<unsigned char> Occupied;
+  };
+
+  std::vector<Level> m_Levels;
+
+  // Size of the image
+  long m_ImageSize[3];
+};
+
+#endif // LABELOCCUPANCYMAP_H
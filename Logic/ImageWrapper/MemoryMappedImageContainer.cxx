@@ -0,0 +1,275 @@
+#include "MemoryMappedImageContainer.h"
+#include "itksys/SystemTools.hxx"
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Mappings of each file held by this process
+static std::multimap<std::string, MemoryMappedFile *> MemoryMappedFiles;
+static std::mutex MemoryMappedFileMutex;
+
+MemoryMappedFile::MemoryMappedFile()
+  : m_Base(NULL), m_Data(NULL), m_MappedLength(0)
+{
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+  this->Unmap();
+}
+
+bool
+MemoryMappedFile
+::Map(const char *file, size_t offset, size_t length)
+{
+  this->Unmap();
+  if(length == 0)
+    return false;
+
+#ifdef WIN32
+
+  // The view must start at a multiple of the allocation granularity
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  size_t start = offset - offset % si.dwAllocationGranularity;
+  size_t map_length = length + (offset - start);
+
+  HANDLE hFile = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(hFile == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER file_size;
+  if(!GetFileSizeEx(hFile, &file_size)
+     || (unsigned long long) file_size.QuadPart < offset + length)
+    {
+    CloseHandle(hFile);
+    return false;
+    }
+
+  // The view keeps the file and the mapping object open after the handles
+  // are closed
+  HANDLE hMap = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  CloseHandle(hFile);
+  if(hMap == NULL)
+    return false;
+
+  unsigned long long start64 = start;
+  m_Base = MapViewOfFile(hMap, FILE_MAP_COPY,
+                         (DWORD) (start64 >> 32), (DWORD) (start64 & 0xffffffff),
+                         map_length);
+  CloseHandle(hMap);
+  if(m_Base == NULL)
+    return false;
+
+#else
+
+  // The mapping must start at a page boundary
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  size_t start = offset - offset % page;
+  size_t map_length = length + (offset - start);
+
+  int fd = open(file, O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  // Mapping past the end of the file would crash on access
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t) st.st_size < offset + length)
+    {
+    close(fd);
+    return false;
+    }
+
+  void *base = mmap(NULL, map_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t) start);
+  close(fd);
+  if(base == MAP_FAILED)
+    return false;
+
+  m_Base = base;
+
+#endif
+
+  m_MappedLength = map_length;
+  m_Data = static_cast<char *>(m_Base) + (offset - start);
+  m_File = itksys::SystemTools::CollapseFullPath(file);
+
+  std::lock_guard<std::mutex> lock(MemoryMappedFileMutex);
+  MemoryMappedFiles.insert(std::make_pair(m_File, this));
+
+  return true;
+}
+
+void
+MemoryMappedFile
+::Unmap()
+{
+  if(!m_Base)
+    return;
+
+#ifdef WIN32
+  UnmapViewOfFile(m_Base);
+#else
+  munmap(m_Base, m_MappedLength);
+#endif
+
+  m_Base = m_Data = NULL;
+  m_MappedLength = 0;
+
+  std::lock_guard<std::mutex> lock(MemoryMappedFileMutex);
+  if(!m_File.empty())
+    {
+    typedef std::multimap<std::string, MemoryMappedFile *>::iterator Iterator;
+    std::pair<Iterator, Iterator> range = MemoryMappedFiles.equal_range(m_File);
+    for(Iterator it = range.first; it != range.second; ++it)
+      {
+      if(it->second == this)
+        {
+        MemoryMappedFiles.erase(it);
+        break;
+        }
+      }
+    m_File.clear();
+    }
+}
+
+bool
+MemoryMappedFile
+::Detach()
+{
+#ifdef WIN32
+
+  // A view of a file can not be replaced at the same address
+  return false;
+
+#else
+
+  // Copy the data aside, replace the mapping by anonymous memory at the same
+  // address and copy the data back
+  void *copy = mmap(NULL, m_MappedLength, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(copy == MAP_FAILED)
+    return false;
+
+  memcpy(copy, m_Base, m_MappedLength);
+  void *anon = mmap(m_Base, m_MappedLength, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  if(anon == MAP_FAILED)
+    {
+    munmap(copy, m_MappedLength);
+    return false;
+    }
+
+  memcpy(m_Base, copy, m_MappedLength);
+  munmap(copy, m_MappedLength);
+  m_File.clear();
+  return true;
+
+#endif
+}
+
+void
+MemoryMappedFile
+::Advise(size_t offset, size_t length, bool will_need)
+{
+  // Once detached, the data is no longer backed by the file and would be
+  // paged out to swap
+  if(!m_Data || m_File.empty() || length == 0)
+    return;
+
+#ifdef WIN32
+  size_t page = 4096;
+#else
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+#endif
+
+  // Prefetching covers every page touched by the range, while releasing only
+  // covers the pages that lie entirely within it
+  size_t begin = (size_t) static_cast<char *>(m_Data) + offset;
+  size_t end = begin + length;
+  if(will_need)
+    {
+    begin -= begin % page;
+    end += (page - end % page) % page;
+    }
+  else
+    {
+    begin += (page - begin % page) % page;
+    end -= end % page;
+    }
+
+  if(end <= begin)
+    return;
+
+  void *addr = reinterpret_cast<void *>(begin);
+#ifdef WIN32
+  // Unlocking pages that are not locked removes them from the working set
+  if(!will_need)
+    VirtualUnlock(addr, end - begin);
+#else
+  if(will_need)
+    madvise(addr, end - begin, MADV_WILLNEED);
+#if defined(MADV_PAGEOUT)
+  else
+    madvise(addr, end - begin, MADV_PAGEOUT);
+#elif defined(MADV_COLD)
+  else
+    madvise(addr, end - begin, MADV_COLD);
+#endif
+#endif
+}
+
+bool
+MemoryMappedFile
+::IsFileMapped(const std::string &file)
+{
+  std::string path = itksys::SystemTools::CollapseFullPath(file);
+  std::lock_guard<std::mutex> lock(MemoryMappedFileMutex);
+  return MemoryMappedFiles.count(path) > 0;
+}
+
+std::vector<std::string>
+MemoryMappedFile
+::GetMappedFiles()
+{
+  std::lock_guard<std::mutex> lock(MemoryMappedFileMutex);
+  std::vector<std::string> files;
+  for(std::multimap<std::string, MemoryMappedFile *>::const_iterator it = MemoryMappedFiles.begin();
+      it != MemoryMappedFiles.end(); it = MemoryMappedFiles.upper_bound(it->first))
+    files.push_back(it->first);
+  return files;
+}
+
+bool
+MemoryMappedFile
+::DetachFile(const std::string &file)
+{
+  std::string path = itksys::SystemTools::CollapseFullPath(file);
+  std::lock_guard<std::mutex> lock(MemoryMappedFileMutex);
+
+  bool detached = true;
+  typedef std::multimap<std::string, MemoryMappedFile *>::iterator Iterator;
+  std::pair<Iterator, Iterator> range = MemoryMappedFiles.equal_range(path);
+  for(Iterator it = range.first; it != range.second; )
+    {
+    if(it->second->Detach())
+      {
+      MemoryMappedFiles.erase(it++);
+      }
+    else
+      {
+      detached = false;
+      ++it;
+      }
+    }
+  return detached;
+}
@@ -0,0 +1,125 @@
+#ifndef MEMORYMAPPEDIMAGECONTAINER_H
+#define MEMORYMAPPEDIMAGECONTAINER_H
+
+#include "SNAPCommon.h"
+#include "itkImportImageContainer.h"
+#include <string>
+#include <vector>
+
+/**
+ * A private, copy-on-write mapping of part of a file into memory. Pages are
+ * read from the file (and shared with other processes mapping the same file)
+ * as they are accessed; pages that are written to become private copies, so
+ * the file itself is never modified.
+ *
+ * The mapped data becomes invalid if the file is truncated or rewritten in
+ * place while it is mapped. Before this process writes a file, DetachFile()
+ * copies the data of every mapping of that file into private memory at the
+ * same address, so images using the mappings are not affected.
+ */
+class MemoryMappedFile
+{
+public:
+  MemoryMappedFile();
+  ~MemoryMappedFile();
+
+  /**
+   * Map length bytes of the file, starting at offset. Returns false if the
+   * file could not be mapped, e.g., if it is shorter than offset + length.
+   */
+  bool Map(const char *file, size_t offset, size_t length);
+
+  /** Release the mapping */
+  void Unmap();
+
+  /** Pointer to the first mapped byte (at offset in the file) */
+  void *GetData() const { return m_Data; }
+
+  /**
+   * Tell the operating system how a range of the mapped data (relative to
+   * GetData()) will be used. If will_need is true, the pages are read in
+   * ahead of time; otherwise they may be dropped from memory, to be read
+   * from the file again (or from swap, if modified) when next accessed.
+   * This has no effect once the mapping has been detached.
+   */
+  void Advise(size_t offset, size_t length, bool will_need);
+
+  /** Check whether this process currently maps some part of a file */
+  static bool IsFileMapped(const std::string &file);
+
+  /** Get the full paths of all files currently mapped by this process */
+  static std::vector<std::string> GetMappedFiles();
+
+  /**
+   * Copy the data of all mappings of a file into private memory, keeping
+   * their addresses, so that the file can be overwritten. The data must not
+   * be accessed by other threads meanwhile. Returns false if some mapping
+   * could not be detached (this is not supported on Windows).
+   */
+  static bool DetachFile(const std::string &file);
+
+private:
+  MemoryMappedFile(const MemoryMappedFile &);
+  void operator = (const MemoryMappedFile &);
+
+  // Replace the mapping by private memory with the same contents. Called
+  // with the registry of mappings locked
+  bool Detach();
+
+  // The mapping starts at a page boundary, before the requested data
+  void *m_Base, *m_Data;
+  size_t m_MappedLength;
+
+  // Full path of the mapped file, empty once the mapping is detached
+  std::string m_File;
+};
+
+/**
+ * An image pixel container whose buffer is mapped from an image file, for
+ * files in which the voxel data is stored uncompressed in the same layout
+ * and byte order as in memory. This lets large images be loaded without
+ * reading and copying them, and several instances of ITK-SNAP opening the
+ * same image share its memory through the page cache.
+ *
+ * The container never owns the buffer (GetContainerManageMemory() is false)
+ * so code that converts pixel containers in place must make a copy instead.
+ * Pixels written by the program are copied on write and never reach the
+ * file.
+ */
+template <typename TElementIdentifier, typename TElement>
+class MemoryMappedImageContainer
+    : public itk::ImportImageContainer<TElementIdentifier, TElement>
+{
+public:
+
+  typedef itk::ImportImageContainer<TElementIdentifier, TElement> ContainerType;
+  irisITKObjectMacro(MemoryMappedImageContainer, ContainerType)
+
+  /**
+   * Map n_elements from the file, starting at the given byte offset. Returns
+   * false if the file can not be mapped.
+   */
+  bool MapFile(const char *file, size_t offset, TElementIdentifier n_elements)
+    {
+    if(!m_Mapping.Map(file, offset, n_elements * sizeof(TElement)))
+      return false;
+
+    this->SetImportPointer(reinterpret_cast<TElement *>(m_Mapping.GetData()),
+                           n_elements, false);
+    return true;
+    }
+
+  /** Prefetch or release a range of elements, see MemoryMappedFile::Advise() */
+  void AdviseElements(TElementIdentifier first, TElementIdentifier count, bool will_need)
+    {
+    m_Mapping.Advise(first * sizeof(TElement), count * sizeof(TElement), will_need);
+    }
+
+protected:
+  MemoryMappedImageContainer() {}
+  virtual ~MemoryMappedImageContainer() {}
+
+  MemoryMappedFile m_Mapping;
+};
+
+#endif // MEMORYMAPPEDIMAGECONTAINER_H
@@ -124,6 +124,8 @@ public:
   /** Floating point image type used internally */
   typedef itk::Image<float, VDimension>              FloatImageType;
   typedef typename itk::SmartPointer<FloatImageType>      FloatImagePointer;
+  typedef typename FloatImageType::RegionType                  RegionType;
+  typedef typename FloatImageType::IndexType                    IndexType;
 
   /** Type definition for the level set function */
   typedef SNAPLevelSetFunction<ShortImageType, FloatImageType>
@@ -172,12 +174,15 @@ public:
   void CleanUp();
 
   /**
-   * Get the output image. The way the ParallelSparseFieldLevelSetImageFilter is
-   * coded in ITK 4, there is no way to graft an image as an output to the filter,
-   * so to access output, this method should be called
+   * Get the output image. This is the level_set_image passed to the
+   * constructor, into which the evolving part of the level set is copied
+   * after each call to Run().
    */
   FloatImageType *GetOutput();
-  
+
+  /** Get the region of the level set image in which the level set evolves */
+  const RegionType &GetWorkingRegion() const { return m_WorkingRegion; }
+
 private:
   /** An internal class used to invert an image */
   class InvertFunctor {
@@ -198,6 +203,22 @@ private:
   /** An initialization image */
   FloatImagePointer m_InitializationCopyImage, m_LevelSetImage;
 
+  /**
+   * The level set filter only evolves the part of the level set image that
+   * lies in the working region: the bounding box of the zero level set plus
+   * a margin. This image holds that part of the level set, with the index
+   * starting at zero. The working region is enlarged (and the filter is
+   * reinitialized) whenever the front gets close to its boundary.
+   */
+  FloatImagePointer m_WorkingImage;
+  RegionType m_WorkingRegion;
+
+  /** Minimal margin between the front and the boundary of the working region */
+  unsigned int m_WorkingRegionMargin;
+
+  /** Iterations elapsed before the level set filter was last created */
+  unsigned int m_IterationOffset;
+
   /** Speed image adaptor */
   typename ShortImageType::Pointer m_SpeedAdaptor;
 
@@ -209,6 +230,18 @@ private:
 
   /** Internal routines */
   void DoCreateLevelSetFilter();
+
+  /** Bounding box of the voxels on either side of the zero level set */
+  RegionType ComputeFrontBoundingBox(FloatImageType *image) const;
+
+  /** Enlarge a region by a margin, within the level set image */
+  RegionType PadWorkingRegion(const RegionType &region, unsigned int margin) const;
+
+  /** Set the working region and copy it from the level set image */
+  void DoCreateWorkingImage(const RegionType &region);
+
+  /** Copy the output of the filter into the level set image */
+  void DoCopyWorkingImageToOutput();
 };
 
 // Type definitions
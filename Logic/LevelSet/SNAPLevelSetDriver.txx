@@ -50,6 +50,9 @@
 #include "itkDenseFiniteDifferenceImageFilter.h"
 #include "LevelSetExtensionFilter.h"
 #include "itkImageDuplicator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+#include <algorithm>
 
 #include "itkParallelSparseFieldLevelSetImageFilter.h"
 
@@ -135,10 +138,16 @@ SNAPLevelSetDriver<VDimension>
 
   // Store the pointer to the evolving level set image
   m_LevelSetImage = level_set_image;
+  m_WorkingRegionMargin = 8;
+  m_IterationOffset = 0;
 
   // Pass the parameters to the level set function
   AssignParametersToPhi(sparms,true);
 
+  // Only evolve the level set around the initial front
+  DoCreateWorkingImage(PadWorkingRegion(
+    ComputeFrontBoundingBox(m_LevelSetImage), m_WorkingRegionMargin));
+
   // Create the filter
   DoCreateLevelSetFilter();
 }
@@ -202,7 +211,7 @@ SNAPLevelSetDriver<VDimension>
     m_LevelSetFilter = filter.GetPointer();
 
     // Perform the special configuration tasks on the filter
-    filter->SetInput(m_InitializationCopyImage);
+    filter->SetInput(m_WorkingImage);
     filter->SetNumberOfLayers(3);
     filter->SetIsoSurfaceValue(0.0f);
     filter->SetDifferenceFunction(m_LevelSetFunction);
@@ -241,7 +250,7 @@ SNAPLevelSetDriver<VDimension>
     m_LevelSetFilter = filter.GetPointer();
 
     // Perform the special configuration tasks on the filter
-    filter->SetInput(m_InitializationCopyImage);
+    filter->SetInput(m_WorkingImage);
     filter->SetDifferenceFunction(m_LevelSetFunction);
     }
 
@@ -259,6 +268,124 @@ SNAPLevelSetDriver<VDimension>
   // requested region on this image, so it's important that we always 
   // update the entire image
   m_LevelSetFilter->UpdateLargestPossibleRegion();
+
+  // The filter may have changed the values of the level set away from the
+  // front, so the output is copied right away
+  DoCopyWorkingImageToOutput();
+}
+
+template<unsigned int VDimension>
+typename SNAPLevelSetDriver<VDimension>::RegionType
+SNAPLevelSetDriver<VDimension>
+::ComputeFrontBoundingBox(FloatImageType *image) const
+{
+  const RegionType &region = image->GetBufferedRegion();
+  const typename FloatImageType::OffsetValueType *stride = image->GetOffsetTable();
+
+  // Find the voxels whose sign differs from one of their neighbors
+  IndexType lo, hi;
+  bool found = false;
+  typedef itk::ImageRegionConstIteratorWithIndex<FloatImageType> IteratorType;
+  for(IteratorType it(image, region); !it.IsAtEnd(); ++it)
+    {
+    const IndexType &idx = it.GetIndex();
+    const float *p = &it.Value();
+    bool inside = p[0] <= 0.0f;
+    for(unsigned int d = 0; d < VDimension; d++)
+      {
+      if(idx[d] + 1 < region.GetIndex(d) + (itk::IndexValueType) region.GetSize(d)
+         && (p[stride[d]] <= 0.0f) != inside)
+        {
+        for(unsigned int j = 0; j < VDimension; j++)
+          {
+          itk::IndexValueType a = idx[j], b = (j == d) ? idx[j] + 1 : idx[j];
+          lo[j] = found ? std::min(lo[j], a) : a;
+          hi[j] = found ? std::max(hi[j], b) : b;
+          }
+        found = true;
+        }
+      }
+    }
+
+  // The region is empty if there is no front
+  RegionType box;
+  if(found)
+    {
+    box.SetIndex(lo);
+    for(unsigned int d = 0; d < VDimension; d++)
+      box.SetSize(d, hi[d] - lo[d] + 1);
+    }
+  return box;
+}
+
+template<unsigned int VDimension>
+typename SNAPLevelSetDriver<VDimension>::RegionType
+SNAPLevelSetDriver<VDimension>
+::PadWorkingRegion(const RegionType &region, unsigned int margin) const
+{
+  // Without a front, the whole image is evolved
+  const RegionType &full = m_LevelSetImage->GetBufferedRegion();
+  if(region.GetNumberOfPixels() == 0)
+    return full;
+
+  // The margin also grows with the size of the front, so that an expanding
+  // front only causes the working region to be enlarged a few times
+  typename RegionType::SizeType radius;
+  for(unsigned int d = 0; d < VDimension; d++)
+    radius[d] = std::max((itk::SizeValueType) margin, region.GetSize(d) / 4);
+
+  RegionType padded = region;
+  padded.PadByRadius(radius);
+  padded.Crop(full);
+  return padded;
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::DoCreateWorkingImage(const RegionType &region)
+{
+  m_WorkingRegion = region;
+
+  // The parallel sparse field filter requires the image index to start at
+  // zero, so the origin of the working image is moved instead
+  RegionType zero_region;
+  zero_region.SetSize(region.GetSize());
+
+  typename FloatImageType::PointType origin;
+  m_LevelSetImage->TransformIndexToPhysicalPoint(region.GetIndex(), origin);
+
+  m_WorkingImage = FloatImageType::New();
+  m_WorkingImage->SetRegions(zero_region);
+  m_WorkingImage->SetOrigin(origin);
+  m_WorkingImage->SetSpacing(m_LevelSetImage->GetSpacing());
+  m_WorkingImage->SetDirection(m_LevelSetImage->GetDirection());
+  m_WorkingImage->Allocate();
+
+  itk::ImageRegionConstIterator<FloatImageType> itSrc(m_LevelSetImage, region);
+  itk::ImageRegionIterator<FloatImageType> itTrg(m_WorkingImage, zero_region);
+  for(; !itSrc.IsAtEnd(); ++itSrc, ++itTrg)
+    itTrg.Set(itSrc.Get());
+
+  // The speed images are indexed like the level set image
+  itk::Offset<VDimension> offset;
+  for(unsigned int d = 0; d < VDimension; d++)
+    offset[d] = region.GetIndex(d);
+  m_LevelSetFunction->SetIndexOffset(offset);
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::DoCopyWorkingImageToOutput()
+{
+  FloatImageType *output = m_LevelSetFilter->GetOutput();
+  itk::ImageRegionConstIterator<FloatImageType> itSrc(output, output->GetBufferedRegion());
+  itk::ImageRegionIterator<FloatImageType> itTrg(m_LevelSetImage, m_WorkingRegion);
+  for(; !itSrc.IsAtEnd(); ++itSrc, ++itTrg)
+    itTrg.Set(itSrc.Get());
+
+  m_LevelSetImage->Modified();
 }
 
 template<unsigned int VDimension>
@@ -266,15 +393,19 @@ void
 SNAPLevelSetDriver<VDimension>
 ::Restart()
 { 
-  // Tell the filter to reinitialize next time that an update will 
-  // be performed, and set the number of iterations to 0
-  m_LevelSetFilter->SetStateToUninitialized();
-  m_LevelSetFilter->SetNumberOfIterations(0);
-
-  // Update the largest possible region. The slicer may be changing the 
-  // requested region on this image, so it's important that we always 
-  // update the entire image
-  m_LevelSetFilter->UpdateLargestPossibleRegion();
+  // The level set image has only changed inside of the working region, which
+  // never shrinks, so only that part of the initialization is copied back
+  itk::ImageRegionConstIterator<FloatImageType> itSrc(m_InitializationCopyImage, m_WorkingRegion);
+  itk::ImageRegionIterator<FloatImageType> itTrg(m_LevelSetImage, m_WorkingRegion);
+  for(; !itSrc.IsAtEnd(); ++itSrc, ++itTrg)
+    itTrg.Set(itSrc.Get());
+
+  // Evolve the level set around the initial front, with a new filter whose
+  // iteration counter is set to 0
+  m_IterationOffset = 0;
+  DoCreateWorkingImage(PadWorkingRegion(
+    ComputeFrontBoundingBox(m_LevelSetImage), m_WorkingRegionMargin));
+  DoCreateLevelSetFilter();
 }
 
 template<unsigned int VDimension>
@@ -282,6 +413,42 @@ void
 SNAPLevelSetDriver<VDimension>
 ::Run(unsigned int nIterations)
 {
+  // The front moves by at most a voxel per iteration, and the filter keeps
+  // a few layers of voxels around it. Make sure that these can not reach the
+  // boundary of the working region during the iterations, except where it
+  // coincides with the boundary of the image.
+  unsigned int clearance = nIterations + 5;
+  RegionType front = ComputeFrontBoundingBox(m_LevelSetFilter->GetOutput());
+  if(front.GetNumberOfPixels() > 0)
+    {
+    for(unsigned int d = 0; d < VDimension; d++)
+      front.SetIndex(d, front.GetIndex(d) + m_WorkingRegion.GetIndex(d));
+
+    RegionType needed = front;
+    needed.PadByRadius(clearance);
+    needed.Crop(m_LevelSetImage->GetBufferedRegion());
+
+    if(!m_WorkingRegion.IsInside(needed))
+      {
+      // Enlarge the working region to contain the padded front
+      RegionType grown = PadWorkingRegion(
+            front, std::max(clearance, m_WorkingRegionMargin));
+      IndexType lo, hi;
+      for(unsigned int d = 0; d < VDimension; d++)
+        {
+        lo[d] = std::min(grown.GetIndex(d), m_WorkingRegion.GetIndex(d));
+        hi[d] = std::max(grown.GetUpperIndex()[d], m_WorkingRegion.GetUpperIndex()[d]);
+        }
+      grown.SetIndex(lo);
+      grown.SetUpperIndex(hi);
+
+      // Continue the evolution from the current level set in a new filter
+      m_IterationOffset += m_LevelSetFilter->GetElapsedIterations();
+      DoCreateWorkingImage(grown);
+      DoCreateLevelSetFilter();
+      }
+    }
+
   // Increment the number of iterations 
   unsigned int nElapsed = m_LevelSetFilter->GetElapsedIterations();
   m_LevelSetFilter->SetNumberOfIterations(nElapsed + nIterations);
@@ -290,6 +457,9 @@ SNAPLevelSetDriver<VDimension>
   // requested region on this image, so it's important that we always 
   // update the entire image
   m_LevelSetFilter->UpdateLargestPossibleRegion();
+
+  // Copy the evolved level set into the output
+  DoCopyWorkingImageToOutput();
 }
 
 template<unsigned int VDimension>
@@ -310,7 +480,7 @@ unsigned int
 SNAPLevelSetDriver<VDimension>
 ::GetElapsedIterations() const
 {
-  return m_LevelSetFilter->GetElapsedIterations();
+  return m_IterationOffset + m_LevelSetFilter->GetElapsedIterations();
 }
 
 template<unsigned int VDimension>
@@ -323,6 +493,7 @@ SNAPLevelSetDriver<VDimension>
   // function to free memory
   m_LevelSetFilter = NULL;
   m_LevelSetFunction = NULL;
+  m_WorkingImage = NULL;
 }
 
 template<unsigned int VDimension>
@@ -330,7 +501,7 @@ typename SNAPLevelSetDriver<VDimension>::FloatImageType *
 SNAPLevelSetDriver<VDimension>
 ::GetOutput()
 {
-  return m_LevelSetFilter->GetOutput();
+  return m_LevelSetImage;
 }
 
 template<unsigned int VDimension>
@@ -346,10 +517,10 @@ SNAPLevelSetDriver<VDimension>
   // may not cause it to recompute it's images
   AssignParametersToPhi(sparms,false);
 
-  // Create a new level set filter
+  // Create a new level set filter, starting from the initialization
   if(destructive)
     {
-    DoCreateLevelSetFilter();
+    Restart();
     }
 }
 
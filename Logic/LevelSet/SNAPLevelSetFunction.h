@@ -174,6 +174,17 @@ public:
   /** Compute speed and advection images from feature image. */
   virtual void CalculateInternalImages();
 
+  /**
+   * Set the offset from the index of a voxel in the evolving level set image
+   * to the index of the same voxel in the speed images. This is non-zero when
+   * the level set only evolves in a sub-region of the speed image.
+   */
+  void SetIndexOffset(const itk::Offset<ImageDimension> &offset)
+    { m_IndexOffset = offset; }
+
+  const itk::Offset<ImageDimension> &GetIndexOffset() const
+    { return m_IndexOffset; }
+
   /**
     My implementation of ComputeUpdate. This will calculate the speed
     image value just once, instead of having to interpolate it for
@@ -333,6 +344,9 @@ private:
 
   /** The constant time step */
   TimeStepType m_TimeStepFactor;
+
+  /** Offset from level set image indices to speed image indices */
+  itk::Offset<ImageDimension> m_IndexOffset;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -54,6 +54,7 @@ SNAPLevelSetFunction<TSpeedImageType,TImageType>
   m_LaplacianSmoothingSpeedExponent = 0;
   m_UseExternalAdvectionField = false;
   m_SpeedScaleFactor = 1.0;
+  m_IndexOffset.Fill(0);
 
   m_SpeedInterpolator = SpeedImageInterpolatorType::New();
   m_AdvectionFieldInterpolator = VectorInterpolatorType::New();
@@ -108,7 +109,7 @@ SNAPLevelSetFunction<TSpeedImageType,TImageType>
                  const FloatOffsetType &offset,
                  GlobalDataStruct *) const
 {
-  IndexType idx = neighborhood.GetIndex();
+  IndexType idx = neighborhood.GetIndex() + m_IndexOffset;
   typename VectorInterpolatorType::ContinuousIndexType cdx;
   VectorType avec;
 
@@ -161,9 +162,9 @@ SNAPLevelSetFunction<TSpeedImageType, TImageType>
   thread_local IndexType cached_speed_index;
   thread_local SpeedImageType *cached_speed_ptr = nullptr;
 
-  IndexType idx = neighbourhood.GetIndex();
+  IndexType idx = neighbourhood.GetIndex() + m_IndexOffset;
 
-  if(cached_speed_ptr != m_SpeedImage || cached_speed_index != neighbourhood.GetIndex())
+  if(cached_speed_ptr != m_SpeedImage || cached_speed_index != idx)
     {
     // Interpolate the speed value at this location. This way, we don't need to
     // perform interpolation each time the GetXXXSpeed() function is called.
@@ -38,6 +38,8 @@ MeshOptions
 ::MeshOptions()
 {
   // Begin render switches
+  m_UseDiscreteMarchingCubesModel =
+    NewSimpleProperty("UseDiscreteMarchingCubes", false);
   m_UseGaussianSmoothingModel = 
     NewSimpleProperty("UseGaussianSmoothing", true);
   m_UseDecimationModel = 
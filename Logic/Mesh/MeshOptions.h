@@ -48,6 +48,11 @@ public:
 
   irisITKObjectMacro(MeshOptions, AbstractModel)
 
+  // Extract all segmentation label surfaces in a single discrete marching
+  // cubes pass instead of thresholding and meshing each label separately.
+  // Gaussian image smoothing does not apply in this mode.
+  irisSimplePropertyAccessMacro(UseDiscreteMarchingCubes,bool)
+
   // Gaussian smoothing properties
   irisSimplePropertyAccessMacro(UseGaussianSmoothing,bool)
   irisRangedPropertyAccessMacro(GaussianStandardDeviation,float)
@@ -74,6 +79,7 @@ protected:
 
 private:
   // Begin render switches
+  SmartPtr<ConcreteSimpleBooleanProperty> m_UseDiscreteMarchingCubesModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_UseGaussianSmoothingModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_UseDecimationModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_UseMeshSmoothingModel;
@@ -44,15 +44,96 @@
 #include "IRISVectorTypesToITKConversion.h"
 #include "VTKMeshPipeline.h"
 #include "MeshOptions.h"
+#include "IRISException.h"
+#include "SNAPExportITKToVTK.h"
 #include "vtkUnsignedShortArray.h"
+#include "vtkCellData.h"
+#include "vtkDiscreteMarchingCubes.h"
+#include "vtkPolyDataNormals.h"
+#include "AllPurposeProgressAccumulator.h"
 
 // ITK includes
 #include "itkBinaryThresholdImageFilter.h"
+#include "itkMultiThreaderBase.h"
+
+#include <atomic>
 
 using namespace std;
 
+/**
+ * A worker used by UpdateMeshes to compute label meshes concurrently. Each
+ * worker owns its own ROI, threshold and VTK pipelines, so that workers only
+ * share the input image, which they read. The workers already run on the ITK
+ * thread pool, so their filters are kept to a single thread.
+ */
+class MultiLabelMeshPipeline::MeshWorker
+{
+public:
+  MeshWorker(MeshOptions *options)
+  {
+    m_ROIFilter = ROIFilter::New();
+    m_ROIFilter->SetNumberOfWorkUnits(1);
+
+    m_ThresholdFilter = ThresholdFilter::New();
+    m_ThresholdFilter->SetNumberOfWorkUnits(1);
+    m_ThresholdFilter->ReleaseDataFlagOn();
+    m_ThresholdFilter->SetInsideValue(1.0f);
+    m_ThresholdFilter->SetOutsideValue(-1.0f);
+
+    m_VTKPipeline.SetMeshOptions(options);
+    m_VTKPipeline.SetSingleThreaded();
+  }
+
+  void ComputeMesh(const InputImageType *image, std::mutex &input_mutex,
+                   const InputImageType::RegionType &region,
+                   LabelType label, vtkPolyData *outMesh)
+  {
+    // Extract the region of interest. The ROI filter propagates its requested
+    // region to the shared input image, so this step must be serialized. The
+    // output is then disconnected so that the rest of the pipeline does not
+    // reach back to the shared input.
+    InputImagePointer roi;
+      {
+      std::lock_guard<std::mutex> guard(input_mutex);
+      m_ROIFilter->SetInput(image);
+      m_ROIFilter->SetRegionOfInterest(region);
+      m_ROIFilter->Update();
+      roi = m_ROIFilter->GetOutput();
+      roi->DisconnectPipeline();
+      }
+
+    // Set the parameters for the thresholding filter
+    m_ThresholdFilter->SetInput(roi);
+    m_ThresholdFilter->SetLowerThreshold(label);
+    m_ThresholdFilter->SetUpperThreshold(label);
+    m_ThresholdFilter->UpdateLargestPossibleRegion();
+
+    // Graft the polydata to the last filter in the pipeline
+    m_VTKPipeline.SetImage(m_ThresholdFilter->GetOutput());
+    m_VTKPipeline.ComputeMesh(outMesh);
+  }
+
+private:
+  ROIFilterPointer m_ROIFilter;
+  ThresholdFilterPointer m_ThresholdFilter;
+  VTKMeshPipeline m_VTKPipeline;
+};
+
 MultiLabelMeshPipeline
 ::MultiLabelMeshPipeline()
+{
+  // The single label pipeline is created on demand
+  m_VTKPipeline = NULL;
+
+  // Set the initial mesh options
+  m_MeshOptions = MeshOptions::New();
+
+  m_Progress = AllPurposeProgressAccumulator::New();
+}
+
+void
+MultiLabelMeshPipeline
+::BuildSingleLabelPipeline()
 {
   // Initialize the region of interest filter
   m_ROIFilter = ROIFilter::New();
@@ -69,9 +150,6 @@ MultiLabelMeshPipeline
   // Initialize the VTK Processing Pipeline
   m_VTKPipeline = new VTKMeshPipeline();
   m_VTKPipeline->SetImage(m_ThrehsoldFilter->GetOutput());
-
-  // Set the initial mesh options
-  m_MeshOptions = MeshOptions::New();
   m_VTKPipeline->SetMeshOptions(m_MeshOptions);
 }
 
@@ -92,7 +170,8 @@ MultiLabelMeshPipeline
     m_MeshOptions->DeepCopy(options);
 
     // Apply the options to the internal pipeline
-    m_VTKPipeline->SetMeshOptions(m_MeshOptions);
+    if(m_VTKPipeline)
+      m_VTKPipeline->SetMeshOptions(m_MeshOptions);
 
     // Clear the cached stuff
     m_MeshInfo.clear();
@@ -110,7 +189,7 @@ AllPurposeProgressAccumulator *
 MultiLabelMeshPipeline
 ::GetProgressAccumulator()
 {
-  return m_VTKPipeline->GetProgressAccumulator();
+  return m_Progress;
 }
   
 
@@ -124,6 +203,9 @@ MultiLabelMeshPipeline
   if(m_Histogram[label] == 0)
     return false;
 
+  if(!m_VTKPipeline)
+    this->BuildSingleLabelPipeline();
+
   // TODO: make this more elegant
   InputImageType::RegionType bbWiderRegion = m_BoundingBox[label];
   bbWiderRegion.PadByRadius(5);
@@ -140,8 +222,11 @@ MultiLabelMeshPipeline
   m_ThrehsoldFilter->UpdateLargestPossibleRegion();
 
   // Graft the polydata to the last filter in the pipeline
+  m_Progress->ResetProgress();
+  m_Progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(), 1.0f);
   m_VTKPipeline->SetImage(m_ThrehsoldFilter->GetOutput());
   m_VTKPipeline->ComputeMesh(outMesh);
+  m_Progress->UnregisterAllSources();
 
   // Done
   return true;
@@ -258,10 +343,6 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
       it++;
     }
 
-  // Deal with progress accumulation
-  SmartPtr<AllPurposeProgressAccumulator> progress = AllPurposeProgressAccumulator::New();
-  progress->AddObserver(itk::ProgressEvent(), progressCommand);
-
   // Next we check which meshes are new or updated and mark them as needing to
   // be recomputed
   for(MeshInfoMap::const_iterator it = meshmap.begin(); it != meshmap.end(); ++it)
@@ -278,59 +359,229 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
       info.BoundingBox[0] = it->second.BoundingBox[0];
       info.BoundingBox[1] = it->second.BoundingBox[1];
       info.Mesh = NULL;
-
-      //auto src = m_VTKPipeline->GetProgressAccumulator();
-
-      // Capture progress from this mesh
-      progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(), info.Count);
       }
     }
 
-  // Now compute the meshes
+  // Collect the labels whose meshes must be computed. The map entries are not
+  // added or removed below, so pointers to them remain valid in the workers
+  MeshJobList jobs;
   for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end(); it++)
     {
     if(it->second.Mesh == NULL)
       {
-      // Create the mesh
-      MeshInfo &mi = it->second;
-      mi.Mesh = vtkSmartPointer<vtkPolyData>::New();
+      it->second.Mesh = vtkSmartPointer<vtkPolyData>::New();
+      jobs.push_back(MeshJob(it->first, &it->second));
+      }
+    }
+
+  if(jobs.size())
+    {
+    // Deal with progress accumulation
+    m_Progress->ResetProgress();
+    unsigned long tag = m_Progress->AddObserver(itk::ProgressEvent(), progressCommand);
+
+    try
+      {
+      if(m_MeshOptions->GetUseDiscreteMarchingCubes())
+        this->ComputeMeshesDiscrete(jobs, m_Progress);
+      else
+        this->ComputeMeshesPerLabel(jobs, m_Progress);
+      }
+    catch(...)
+      {
+      // Meshes computed in this call are invalid
+      m_MeshInfo.clear();
+      m_Progress->UnregisterAllSources();
+      m_Progress->RemoveObserver(tag);
+      throw;
+      }
+
+    m_Progress->RemoveObserver(tag);
+    }
+
+  // Set the modified flag, so we can use the pipeline's MTime
+  this->Modified();
+}
 
-      // TODO: make this more elegant
-      InputImageType::RegionType bbWiderRegion;
-      for(int d = 0; d < 3; d++)
+void
+MultiLabelMeshPipeline
+::ComputeMeshesPerLabel(const MeshJobList &jobs, AllPurposeProgressAccumulator *progress)
+{
+  // Progress is weighted by the number of voxels in each label
+  void *progress_src = progress->RegisterGenericSource(1, 1.0);
+  unsigned long total_count = 0, done_count = 0;
+  for(size_t k = 0; k < jobs.size(); k++)
+    total_count += jobs[k].second->Count;
+
+  // The labels are processed in batches, so that progress can be reported
+  // from this thread between batches. Within a batch, each work unit creates
+  // a worker and pulls labels from the batch until none are left, which
+  // balances labels of very different sizes across the threads
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  size_t n_units = std::max(mt->GetNumberOfWorkUnits(), 1u);
+  size_t batch_size = 4 * n_units;
+
+  for(size_t batch_start = 0; batch_start < jobs.size(); batch_start += batch_size)
+    {
+    size_t batch_end = std::min(batch_start + batch_size, jobs.size());
+    std::atomic<size_t> next_job(batch_start);
+
+    mt->ParallelizeArray(0, std::min(n_units, batch_end - batch_start),
+                         [&](itk::SizeValueType)
+      {
+      MeshWorker worker(m_MeshOptions);
+      for(size_t k = next_job++; k < batch_end; k = next_job++)
         {
-        unsigned long len =
-            (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
-        bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
-        bbWiderRegion.SetSize(d, len);
+        MeshInfo *mi = jobs[k].second;
+        worker.ComputeMesh(m_InputImage, m_InputMutex,
+                           this->GetPaddedBoundingBox(mi->BoundingBox[0], mi->BoundingBox[1]),
+                           jobs[k].first, mi->Mesh);
         }
-      bbWiderRegion.PadByRadius(5);
-      bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
+      }, nullptr);
 
-      // Pass the region to the ROI filter and propagate the filter
-      m_ROIFilter->SetInput(m_InputImage);
-      m_ROIFilter->SetRegionOfInterest(bbWiderRegion);
-      m_ROIFilter->Update();
+    for(size_t k = batch_start; k < batch_end; k++)
+      done_count += jobs[k].second->Count;
+    AllPurposeProgressAccumulator::GenericProgressCallback(
+          progress_src, done_count * 1.0 / std::max(total_count, 1ul));
+    }
+
+  // Clean up the progress
+  progress->UnregsterGenericSource(progress_src);
+}
+
+void
+MultiLabelMeshPipeline
+::ComputeMeshesDiscrete(const MeshJobList &jobs, AllPurposeProgressAccumulator *progress)
+{
+  // Find the region that contains all the labels to be meshed
+  Vector3i bbLower = jobs[0].second->BoundingBox[0];
+  Vector3i bbUpper = jobs[0].second->BoundingBox[1];
+  for(size_t k = 1; k < jobs.size(); k++)
+    {
+    bbLower = vector_min(bbLower, jobs[k].second->BoundingBox[0]);
+    bbUpper = vector_max(bbUpper, jobs[k].second->BoundingBox[1]);
+    }
 
-      // Set the parameters for the thresholding filter
-      m_ThrehsoldFilter->SetLowerThreshold(it->first);
-      m_ThrehsoldFilter->SetUpperThreshold(it->first);
-      m_ThrehsoldFilter->UpdateLargestPossibleRegion();
+  // Decompress the region into a regular label image
+  typedef itk::Image<LabelType, 3> LabelImageType;
+  typedef itk::RegionOfInterestImageFilter<InputImageType, LabelImageType> LabelROIFilter;
+  SmartPtr<LabelROIFilter> fltROI = LabelROIFilter::New();
+  fltROI->SetInput(m_InputImage);
+  fltROI->SetRegionOfInterest(this->GetPaddedBoundingBox(bbLower, bbUpper));
+  fltROI->Update();
+
+  // Pass the label image to VTK
+  typedef itk::VTKImageExport<LabelImageType> LabelExportType;
+  SmartPtr<LabelExportType> exporter = LabelExportType::New();
+  exporter->SetInput(fltROI->GetOutput());
+  vtkSmartPointer<vtkImageImport> importer = vtkSmartPointer<vtkImageImport>::New();
+  ConnectITKExporterToVTKImporter(exporter.GetPointer(), importer.GetPointer());
+
+  // Extract the surfaces of all the labels in a single sweep. Each output
+  // triangle carries the label that it bounds as its cell scalar
+  vtkSmartPointer<vtkDiscreteMarchingCubes> fltContour =
+      vtkSmartPointer<vtkDiscreteMarchingCubes>::New();
+  fltContour->SetInputConnection(importer->GetOutputPort());
+  fltContour->ComputeNormalsOff();
+  fltContour->ComputeGradientsOff();
+  fltContour->ComputeScalarsOn();
+  fltContour->SetNumberOfContours(jobs.size());
+  for(size_t k = 0; k < jobs.size(); k++)
+    fltContour->SetValue(k, jobs[k].first);
+
+  progress->RegisterSource(fltContour.GetPointer(), 1.0f);
+  void *progress_src = progress->RegisterGenericSource(1, 1.0f);
+  fltContour->Update();
+
+  vtkPolyData *contours = fltContour->GetOutput();
+  vtkCellArray *polys = contours->GetPolys();
+  vtkDataArray *labels = contours->GetCellData()->GetScalars();
+  if(!labels)
+    throw IRISException("Discrete marching cubes did not assign labels to mesh cells");
+
+  // Sort the triangles by label
+  std::map<LabelType, std::vector<vtkIdType> > label_cells;
+  for(vtkIdType c = 0; c < polys->GetNumberOfCells(); c++)
+    label_cells[(LabelType) labels->GetTuple1(c)].push_back(c);
+
+  // The decimation, smoothing and transform stages are shared with the
+  // per-label pipeline
+  VTKMeshPipeline post;
+  post.SetMeshOptions(m_MeshOptions);
+  post.SetImageGeometry(fltROI->GetOutput());
+
+  // Map from point ids in the combined contour to ids in the label mesh
+  std::vector<vtkIdType> point_map(contours->GetNumberOfPoints(), -1);
+
+  for(size_t k = 0; k < jobs.size(); k++)
+    {
+    const std::vector<vtkIdType> &cells = label_cells[jobs[k].first];
 
-      // Graft the polydata to the last filter in the pipeline
-      m_VTKPipeline->SetImage(m_ThrehsoldFilter->GetOutput());
-      m_VTKPipeline->ComputeMesh(it->second.Mesh);
+    // Copy the triangles of this label, along with the points they use
+    vtkSmartPointer<vtkPoints> pts = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkCellArray> tris = vtkSmartPointer<vtkCellArray>::New();
+    for(size_t i = 0; i < cells.size(); i++)
+      {
+      vtkIdType npts; const vtkIdType *ids;
+      polys->GetCellAtId(cells[i], npts, ids);
+      tris->InsertNextCell(npts);
+      for(vtkIdType j = 0; j < npts; j++)
+        {
+        vtkIdType &q = point_map[ids[j]];
+        if(q < 0)
+          q = pts->InsertNextPoint(contours->GetPoint(ids[j]));
+        tris->InsertCellPoint(q);
+        }
+      }
 
-      // Update progress
-      progress->StartNextRun(m_VTKPipeline->GetProgressAccumulator());
+    // Reset the entries of the map touched by this label
+    for(size_t i = 0; i < cells.size(); i++)
+      {
+      vtkIdType npts; const vtkIdType *ids;
+      polys->GetCellAtId(cells[i], npts, ids);
+      for(vtkIdType j = 0; j < npts; j++)
+        point_map[ids[j]] = -1;
       }
+
+    vtkSmartPointer<vtkPolyData> piece = vtkSmartPointer<vtkPolyData>::New();
+    piece->SetPoints(pts);
+    piece->SetPolys(tris);
+
+    // Compute outward facing normals for the label surface
+    vtkSmartPointer<vtkPolyDataNormals> fltNormals = vtkSmartPointer<vtkPolyDataNormals>::New();
+    fltNormals->SetInputData(piece);
+    fltNormals->SplittingOff();
+    fltNormals->ConsistencyOn();
+    fltNormals->AutoOrientNormalsOn();
+    fltNormals->ComputeCellNormalsOff();
+    fltNormals->Update();
+
+    // Run the rest of the mesh pipeline
+    post.ComputeMeshFromContour(fltNormals->GetOutput(), jobs[k].second->Mesh);
+
+    AllPurposeProgressAccumulator::GenericProgressCallback(
+          progress_src, (k + 1.0) / jobs.size());
     }
 
   // Clean up the progress
   progress->UnregisterAllSources();
+}
 
-  // Set the modified flag, so we can use the pipeline's MTime
-  this->Modified();
+MultiLabelMeshPipeline::InputImageType::RegionType
+MultiLabelMeshPipeline
+::GetPaddedBoundingBox(const Vector3i &lower, const Vector3i &upper) const
+{
+  // TODO: make this more elegant
+  InputImageType::RegionType bbWiderRegion;
+  for(int d = 0; d < 3; d++)
+    {
+    unsigned long len = (unsigned long) (1 + upper[d] - lower[d]);
+    bbWiderRegion.SetIndex(d, lower[d]);
+    bbWiderRegion.SetSize(d, len);
+    }
+  bbWiderRegion.PadByRadius(5);
+  bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
+  return bbWiderRegion;
 }
 
 void 
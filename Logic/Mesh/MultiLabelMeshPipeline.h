@@ -44,6 +44,7 @@
 #include "ImageWrapperTraits.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include "RLEImageScanlineIterator.h"
+#include <mutex>
 
 
 // Forward reference to itk classes
@@ -70,6 +71,12 @@ class AllPurposeProgressAccumulator;
  * whether it has been updated relative to the corresponding mesh. This makes
  * it possible for selective mesh recomputation, leading to fast mesh computation
  * even for big segmentations.
+ *
+ * Meshes for the labels that need recomputation are computed concurrently on
+ * the ITK thread pool, by workers that each have their own copy of the
+ * ROI/threshold/VTK pipeline. Alternatively, when discrete marching cubes are
+ * selected in MeshOptions, the surfaces of all these labels are extracted in
+ * a single pass over the image and then split by label.
  */
 class MultiLabelMeshPipeline : public itk::Object
 {
@@ -136,7 +143,10 @@ public:
   std::map<LabelType, vtkSmartPointer<vtkPolyData> > GetMeshCollection();
 
   
-  /** Get the progress accumulator from the VTK mesh pipeline */
+  /**
+   * Get the progress accumulator that reports the progress of UpdateMeshes()
+   * and ComputeMesh()
+   */
   AllPurposeProgressAccumulator *GetProgressAccumulator();
 
 protected:
@@ -166,7 +176,9 @@ private:
   // The input image
   InputImageConstPointer      m_InputImage;
 
-  // The ROI extraction filter used for constructing a bounding box
+  // The ROI extraction filter used for constructing a bounding box. This and
+  // the following filters are only used by ComputeMesh() and are created on
+  // its first call
   ROIFilterPointer            m_ROIFilter;
 
   // The thresholding filter used to map intensity in the bounding box to
@@ -184,6 +196,34 @@ private:
   // The VTK pipeline
   VTKMeshPipeline *           m_VTKPipeline;
 
+  // Progress of mesh computation
+  SmartPtr<AllPurposeProgressAccumulator> m_Progress;
+
+  // Create the filters used by ComputeMesh()
+  void BuildSingleLabelPipeline();
+
+  // A worker used to compute label meshes in a separate thread
+  class MeshWorker;
+
+  // Mutex serializing the access of concurrent ROI filters to the input image
+  std::mutex                  m_InputMutex;
+
+  // A label whose mesh must be computed, and the entry that will hold the mesh
+  typedef std::pair<LabelType, MeshInfo *> MeshJob;
+  typedef std::vector<MeshJob> MeshJobList;
+
+  // Compute the padded bounding box from which meshes are extracted
+  InputImageType::RegionType GetPaddedBoundingBox(
+      const Vector3i &lower, const Vector3i &upper) const;
+
+  // Threshold and mesh each label separately, on the ITK thread pool
+  void ComputeMeshesPerLabel(const MeshJobList &jobs,
+                             AllPurposeProgressAccumulator *progress);
+
+  // Extract all the label surfaces in one discrete marching cubes pass
+  void ComputeMeshesDiscrete(const MeshJobList &jobs,
+                             AllPurposeProgressAccumulator *progress);
+
   // Helper routine for the update command
   void UpdateMeshInfoHelper(
       MeshInfo *current_meshinfo,
@@ -114,6 +114,14 @@ VTKMeshPipeline
   m_DecimateFilter->Delete();
 }
 
+void
+VTKMeshPipeline
+::SetSingleThreaded()
+{
+  m_VTKGaussianFilter->SetNumberOfThreads(1);
+  m_VTKGaussianFilter->EnableSMPOff();
+}
+
 void
 VTKMeshPipeline
 ::SetMeshOptions(MeshOptions *options)
@@ -248,20 +256,49 @@ VTKMeshPipeline
   // Update the pipeline
   m_StripperFilter->Update();
 
+  // Make sure normals point outwards in RAS space
+  this->FlipNormalsIfNeeded();
+
+  // Disconnect pipeline
+  m_StripperFilter->SetOutput(NULL);
+}
+
+void
+VTKMeshPipeline
+::ComputeMeshFromContour(vtkPolyData *contour, vtkPolyData *outMesh)
+{
+  // Graft the polydata to the last filter in the pipeline
+  m_StripperFilter->SetOutput(outMesh);
+
+  // Feed the contour to the transform filter, bypassing marching cubes
+  m_TransformFilter->SetInputData(contour);
+  m_StripperFilter->Update();
+
+  // Make sure normals point outwards in RAS space
+  this->FlipNormalsIfNeeded();
+
+  // Restore and disconnect pipeline
+  m_TransformFilter->SetInputConnection(m_MarchingCubesFilter->GetOutputPort());
+  m_StripperFilter->SetOutput(NULL);
+}
+
+void
+VTKMeshPipeline
+::FlipNormalsIfNeeded()
+{
   // In the case that the jacobian of the transform is negative,
   // flip the normals around
   if(m_Transform->GetMatrix()->Determinant() < 0)
     {
     vtkPointData *pd = m_StripperFilter->GetOutput()->GetPointData();
     vtkDataArray *nrm = pd->GetNormals();
+    if(!nrm)
+      return;
     for(size_t i = 0; i < (size_t)nrm->GetNumberOfTuples(); i++)
       for(size_t j = 0; j < (size_t)nrm->GetNumberOfComponents(); j++)
         nrm->SetComponent(i,j,-nrm->GetComponent(i,j));
     nrm->Modified();
     }
-
-  // Disconnect pipeline
-  m_StripperFilter->SetOutput(NULL);
 }
 
 void
@@ -271,6 +308,14 @@ VTKMeshPipeline
   // Store the image 
   m_InputImage = image;
 
+  // Set up the transform to RAS space
+  this->SetImageGeometry(image);
+}
+
+void
+VTKMeshPipeline
+::SetImageGeometry(const itk::ImageBase<3> *image)
+{
   // Compute the transform from VTK coordinates to NIFTI/RAS coordinates
   vnl_matrix_fixed<double, 4, 4> vtk2nii = 
     ImageWrapperBase::ConstructVTKtoNiftiTransform(
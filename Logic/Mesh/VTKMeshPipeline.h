@@ -92,6 +92,28 @@ public:
   /** Compute a mesh for a particular color label */
   void ComputeMesh(vtkPolyData *outData, std::mutex *mutex = nullptr);
 
+  /**
+   * Set the geometry of the image from which contours passed to
+   * ComputeMeshFromContour() were extracted. This is done automatically
+   * by SetImage()
+   */
+  void SetImageGeometry(const itk::ImageBase<3> *image);
+
+  /**
+   * Run a contour that was extracted outside of this pipeline (e.g., by
+   * discrete marching cubes) through the transform, decimation, smoothing
+   * and stripping stages of the pipeline. The contour must be in VTK
+   * coordinates of the image passed to SetImageGeometry() and have normals.
+   */
+  void ComputeMeshFromContour(vtkPolyData *contour, vtkPolyData *outMesh);
+
+  /**
+   * Run the Gaussian smoothing, which is the only multi-threaded stage of the
+   * pipeline, in the calling thread. This is used when several pipelines
+   * already run concurrently on the ITK thread pool.
+   */
+  void SetSingleThreaded();
+
   /** Get the progress accumulator */
   AllPurposeProgressAccumulator *GetProgressAccumulator()
     { return m_Progress; }
@@ -103,6 +125,9 @@ public:
   ~VTKMeshPipeline();
 
 private:
+
+  // Flip the normals of the output mesh if the transform reverses orientation
+  void FlipNormalsIfNeeded();
   
   // VTK-ITK Connection typedefs
   typedef itk::VTKImageExport<ImageType> VTKExportType;
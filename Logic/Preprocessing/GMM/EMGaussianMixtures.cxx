@@ -1,6 +1,28 @@
 #include "EMGaussianMixtures.h"
+#include "itkMultiThreaderBase.h"
 #include <iostream>
-#include <ctime>
+#include <algorithm>
+
+// Number of samples in each block processed by a thread
+static const int EM_BLOCK_SIZE = 1024;
+
+// Sum of the products a[i] * b[i]. Separate accumulators allow the compiler
+// to vectorize the loop
+static double BlockDotProduct(const double *a, const double *b, int n)
+{
+  double acc[4] = { 0.0, 0.0, 0.0, 0.0 };
+  int i = 0;
+  for(; i + 4 <= n; i += 4)
+    {
+    acc[0] += a[i] * b[i];
+    acc[1] += a[i+1] * b[i+1];
+    acc[2] += a[i+2] * b[i+2];
+    acc[3] += a[i+3] * b[i+3];
+    }
+  for(; i < n; i++)
+    acc[0] += a[i] * b[i];
+  return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
 
 EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, int numOfClass)
   :m_x(x), m_numOfData(dataSize), m_dimOfGaussian(dataDim), m_numOfGaussian(numOfClass), m_setPriorFlag(0), m_numOfIteration(0), m_fail(0)
@@ -27,8 +49,34 @@ EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, in
   m_gmm->Initialize(dataDim, numOfClass);
 
   m_maxIteration = 30;
-  m_precision = 1.0e-7;
-  m_logLikelihood = std::numeric_limits<double>::infinity();
+  m_precision = 1.0e-6;
+  m_logLikelihood = -std::numeric_limits<double>::infinity();
+
+  // Store the data one component after another
+  m_xsoa.resize((size_t) dataSize * dataDim);
+  for (int i = 0; i < dataSize; i++)
+    for (int k = 0; k < dataDim; k++)
+      m_xsoa[(size_t) k * dataSize + i] = x[i][k];
+
+  // Split the samples into blocks
+  for (int i = 0; i < dataSize; i += EM_BLOCK_SIZE)
+    {
+    SampleBlock block;
+    block.first = i;
+    block.size = std::min(EM_BLOCK_SIZE, dataSize - i);
+    block.logLikelihood = 0.0;
+    m_blocks.push_back(block);
+    }
+}
+
+template <class TFunction>
+void EMGaussianMixtures::ParallelizeBlocks(TFunction f)
+{
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, m_blocks.size(), [&](itk::SizeValueType i)
+    {
+    f(m_blocks[i]);
+    }, nullptr);
 }
 
 EMGaussianMixtures::~EMGaussianMixtures()
@@ -48,7 +96,7 @@ void EMGaussianMixtures::Reset(void)
 {
   m_numOfIteration = 0;
   m_fail = 0;
-  m_logLikelihood = std::numeric_limits<double>::infinity();
+  m_logLikelihood = -std::numeric_limits<double>::infinity();
   for (int i = 0; i < m_numOfData*m_numOfGaussian; i++)
     {
     m_probs[i] = 0;
@@ -102,17 +150,24 @@ int EMGaussianMixtures::GetMaxIteration(void)
   return m_maxIteration;
 }
 
+bool EMGaussianMixtures::IsConverged(double oldLogLikelihood, double newLogLikelihood) const
+{
+  // The total log-likelihood grows with the number of samples, so the change
+  // is compared to its magnitude rather than to a fixed threshold
+  return fabs(newLogLikelihood - oldLogLikelihood) <= m_precision * fabs(newLogLikelihood);
+}
+
 double ** EMGaussianMixtures::Update(void)
 {
   double currentLogLikelihood = 0;
   m_numOfIteration = 0;
   m_fail = 0;
-  while ((fabs(m_logLikelihood - currentLogLikelihood) > m_precision) && (m_numOfIteration < m_maxIteration))
+  while (!IsConverged(m_logLikelihood, currentLogLikelihood) && (m_numOfIteration < m_maxIteration))
     {
-    if (m_logLikelihood < currentLogLikelihood)
+    if (currentLogLikelihood < m_logLikelihood)
       {
       m_fail = 1;
-      std::cout << "!!!!!! Log Likelihood increase, EM fails" << std::endl;
+      std::cout << "!!!!!! Log Likelihood decrease, EM fails" << std::endl;
       std::cout << "old=" <<m_logLikelihood << std::endl << "new=" << currentLogLikelihood << std::endl;
       // break;
       }
@@ -139,23 +194,15 @@ double ** EMGaussianMixtures::Update(void)
 
 double ** EMGaussianMixtures::UpdateOnce(void)
 {
-  long start = 0;
-  long end = 0;
-  start = clock();
   EvaluatePDF();
-  end = clock();
-  std::cout << "evaluate pdf spending " << (end-start)/1000 << std::endl;
-  start = clock();
   double currentLogLikelihood = EvaluateLogLikelihood();
-  end = clock();
-  std::cout << "evaluate likelihood spending " << (end-start)/1000 << std::endl;
-  if (m_logLikelihood < currentLogLikelihood)
+  if (currentLogLikelihood < m_logLikelihood)
     {
     m_fail = 1;
-    std::cout << "!!!!!! Log Likelihood increase, EM fails" << std::endl;
+    std::cout << "!!!!!! Log Likelihood decrease, EM fails" << std::endl;
     std::cout << "old=" <<m_logLikelihood << std::endl << "new=" << currentLogLikelihood << std::endl;
     }
-  if (fabs(m_logLikelihood - currentLogLikelihood) <= m_precision)
+  if (IsConverged(m_logLikelihood, currentLogLikelihood))
     {
     std::cout << "Log Likelihood converged" << std::endl;
     }
@@ -166,24 +213,12 @@ double ** EMGaussianMixtures::UpdateOnce(void)
   ++m_numOfIteration;
   m_logLikelihood = currentLogLikelihood;
   
-  start = clock();
   UpdateLatent();
-  end = clock();
-  std::cout << "latent spending " << (end-start)/1000 << std::endl;
-  start = clock();
   UpdateMean();
-  end = clock();
-  std::cout << "mean spending " << (end-start)/1000 << std::endl;
-  start = clock();
   UpdateCovariance();
-  end = clock();
-  std::cout << "covariance spending " << (end-start)/1000 << std::endl;
   if (m_setPriorFlag == 0)
     {
-    start = clock();
     UpdateWeight();
-    end = clock();
-    std::cout << "weight spending " << (end-start)/1000 << std::endl;
     }
 
   std::cout << std::endl <<"=====================" << std::endl;
@@ -196,13 +231,19 @@ double ** EMGaussianMixtures::UpdateOnce(void)
 
 void EMGaussianMixtures::EvaluatePDF(void)
 {
-  for (int i = 0; i < m_numOfData; i++)
+  ParallelizeBlocks([this](SampleBlock &block)
     {
+    int n = block.size;
+    std::vector<double> log_pdf(n), scratch((m_dimOfGaussian + 1) * n);
     for (int j = 0; j < m_numOfGaussian; j++)
       {
-      m_log_pdf[i][j] = m_gmm->EvaluateLogPDF(j, m_x[i]);
+      m_gmm->GetGaussian(j)->EvaluateLogPDF(
+            &m_xsoa[block.first], m_numOfData, n, log_pdf.data(), scratch.data());
+      for (int s = 0; s < n; s++)
+        m_log_pdf[block.first + s][j] = log_pdf[s];
       }
-    }
+    });
+
   if (m_setPriorFlag == 0)
     {
     for (int j = 0; j < m_numOfGaussian; j++)
@@ -266,72 +307,47 @@ double EMGaussianMixtures::ComputePosterior(int nGauss, double *log_pdf, double
 
 void EMGaussianMixtures::UpdateLatent(void)
 {
-  double sum = 0;
-  for (int i = 0; i < m_numOfGaussian; i++)
-    {
-    m_sum[i] = 0;
-    }
+  int K = m_numOfGaussian, d = m_dimOfGaussian;
 
   // Compute log of the weights and store in logw
   vnl_vector<double> logw(m_numOfGaussian);
   for(int i = 0; i < m_numOfGaussian; i++)
     logw(i) = log(m_weight[i]);
-  
-  if (m_setPriorFlag == 0)
+
+  // Compute the posteriors, and accumulate their sums and the posterior
+  // weighted sums of the samples, which are used by UpdateMean()
+  ParallelizeBlocks([&](SampleBlock &block)
     {
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_latent[i][j] = ComputePosterior(m_numOfGaussian, m_log_pdf[i], m_weight, logw.data_block(), j);
-        m_sum[j] += m_latent[i][j];
-        }
+    block.sum.assign(K, 0.0);
+    block.sumX.assign(K * d, 0.0);
 
+    // The prior is not used
+    if (m_setPriorFlag != 0)
+      return;
 
-      /*
-      sum = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_tmp1[j] = m_weight[j] * m_pdf[i][j];
-        sum += m_tmp1[j];
-        }
-      if(sum == 0)
-        {
-        for (int j = 0; j < m_numOfGaussian; j++)
-          {
-          m_latent[i][j] = 1.0 / m_numOfGaussian;
-          m_sum[j] += m_latent[i][j];
-          }
-        }
-      else
-        {
-        for (int j = 0; j < m_numOfGaussian; j++)
-          {
-          m_latent[i][j] = m_tmp1[j] / sum;
-          m_sum[j] += m_latent[i][j];
-          }
-        }
-        */
-      }
-    }
-  else
-    {
-    /**= THIS IS NOT USED
-    for (int i = 0; i < m_numOfData; i++)
+    int n = block.size;
+    std::vector<double> latent(n);
+    for (int j = 0; j < K; j++)
       {
-      sum = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_tmp1[j] = m_prior[i][j] * m_pdf[i][j];
-        sum += m_tmp1[j];
-        }
-      for (int j = 0; j < m_numOfGaussian; j++)
+      for (int s = 0; s < n; s++)
         {
-        m_latent[i][j] = m_tmp1[j] / sum;
-        m_sum[j] += m_latent[i][j];
+        int i = block.first + s;
+        latent[s] = m_latent[i][j] =
+            ComputePosterior(K, m_log_pdf[i], m_weight, logw.data_block(), j);
+        block.sum[j] += latent[s];
         }
+
+      for (int k = 0; k < d; k++)
+        block.sumX[j * d + k] = BlockDotProduct(
+              latent.data(), &m_xsoa[(size_t) k * m_numOfData + block.first], n);
       }
-      */
+    });
+
+  for (int j = 0; j < K; j++)
+    {
+    m_sum[j] = 0;
+    for (size_t b = 0; b < m_blocks.size(); b++)
+      m_sum[j] += m_blocks[b].sum[j];
     }
 }
 
@@ -342,14 +358,8 @@ void EMGaussianMixtures::UpdateMean(void)
     for (int j = 0; j < m_dimOfGaussian; j++)
       {
       m_tmp2[j] = 0;
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
-      {
-      for (int k = 0; k < m_dimOfGaussian; k++)
-        {
-        m_tmp2[k] += m_latent[j][i] * m_x[j][k];
-        }
+      for (size_t b = 0; b < m_blocks.size(); b++)
+        m_tmp2[j] += m_blocks[b].sumX[i * m_dimOfGaussian + j];
       }
 
     // This can lead to a possible divide by zero situation. In case the sum
@@ -377,50 +387,68 @@ void EMGaussianMixtures::UpdateMean(void)
 
 void EMGaussianMixtures::UpdateCovariance(void)
 {
-  for (int i = 0; i < m_numOfGaussian; i++)
+  int K = m_numOfGaussian, d = m_dimOfGaussian;
+
+  std::vector<VectorType> means(K);
+  for (int i = 0; i < K; i++)
+    means[i] = m_gmm->GetMean(i);
+
+  // Accumulate the posterior weighted scatter matrices of each block
+  ParallelizeBlocks([&](SampleBlock &block)
     {
-    const VectorType &current_mean = m_gmm->GetMean(i);
-    
-    for (int j = 0; j < m_dimOfGaussian; j++)
-      {
-      for (int k = 0; k < m_dimOfGaussian; k++)
-        {
-        m_tmp3[j*m_dimOfGaussian+k] = 0;
-        }
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
+    int n = block.size;
+    std::vector<double> latent(n), diff(d * n), wdiff(n);
+    block.sumXX.assign(K * d * d, 0.0);
+    for (int i = 0; i < K; i++)
       {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      for (int s = 0; s < n; s++)
+        latent[s] = m_latent[block.first + s][i];
+
+      for (int k = 0; k < d; k++)
         {
-        m_tmp2[k] = m_x[j][k] - current_mean[k];
+        const double *xk = &m_xsoa[(size_t) k * m_numOfData + block.first];
+        double *dk = &diff[k * n], mk = means[i][k];
+        for (int s = 0; s < n; s++)
+          dk[s] = xk[s] - mk;
         }
-      for (int k = 0; k < m_dimOfGaussian; k++)
+
+      double *sxx = &block.sumXX[i * d * d];
+      for (int k = 0; k < d; k++)
         {
-        for (int l = 0; l < m_dimOfGaussian; l++)
-          {
-          m_tmp3[k*m_dimOfGaussian+l] += m_tmp2[k] * m_tmp2[l] * m_latent[j][i];
-          }
+        for (int s = 0; s < n; s++)
+          wdiff[s] = latent[s] * diff[k * n + s];
+        for (int l = k; l < d; l++)
+          sxx[k * d + l] = sxx[l * d + k] = BlockDotProduct(wdiff.data(), &diff[l * n], n);
         }
       }
+    });
+
+  for (int i = 0; i < K; i++)
+    {
+    for (int j = 0; j < d * d; j++)
+      {
+      m_tmp3[j] = 0;
+      for (size_t b = 0; b < m_blocks.size(); b++)
+        m_tmp3[j] += m_blocks[b].sumXX[i * d * d + j];
+      }
 
     if(m_sum[i] > 0)
       {
-      for (int j = 0; j < m_dimOfGaussian*m_dimOfGaussian; j++)
+      for (int j = 0; j < d * d; j++)
         {
         m_tmp3[j] = m_tmp3[j] / m_sum[i];
         }
       }
     else
       {
-      for (int j = 0; j < m_dimOfGaussian*m_dimOfGaussian; j++)
+      for (int j = 0; j < d * d; j++)
         {
         m_tmp3[j] = 0.0;
         }
       }
 
 
-    m_gmm->SetCovariance(i, MatrixType(m_tmp3, m_dimOfGaussian, m_dimOfGaussian));
+    m_gmm->SetCovariance(i, MatrixType(m_tmp3, d, d));
     }
 }
 
@@ -434,35 +462,31 @@ void EMGaussianMixtures::UpdateWeight(void)
 
 double EMGaussianMixtures::EvaluateLogLikelihood(void)
 {
-  double tmp1 = 0;
-  double tmp2 = 0;
-  if (m_setPriorFlag == 0)
-    {
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      tmp1 = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        if(!m_gmm->GetGaussian(j)->isDeltaFunction())
-          tmp1 += m_weight[j] * exp(m_log_pdf[i][j]);
-        }
-      tmp2 += log(tmp1);
-      }
-    }
-  else
+  // Delta functions are left out of the likelihood
+  std::vector<char> is_delta(m_numOfGaussian);
+  for (int j = 0; j < m_numOfGaussian; j++)
+    is_delta[j] = m_gmm->GetGaussian(j)->isDeltaFunction();
+
+  ParallelizeBlocks([&](SampleBlock &block)
     {
-    for (int i = 0; i < m_numOfData; i++)
+    block.logLikelihood = 0;
+    for (int i = block.first; i < block.first + block.size; i++)
       {
-      tmp1 = 0;
+      double tmp1 = 0;
       for (int j = 0; j < m_numOfGaussian; j++)
         {
-        if(!m_gmm->GetGaussian(j)->isDeltaFunction())
-          tmp1 += m_prior[i][j] * exp(m_log_pdf[i][j]);
+        double w = (m_setPriorFlag == 0) ? m_weight[j] : m_prior[i][j];
+        if(!is_delta[j])
+          tmp1 += w * exp(m_log_pdf[i][j]);
         }
-      tmp2 += log(tmp1);
+      block.logLikelihood += log(tmp1);
       }
-    }
-  return tmp1;
+    });
+
+  double tmp2 = 0;
+  for (size_t b = 0; b < m_blocks.size(); b++)
+    tmp2 += m_blocks[b].logLikelihood;
+  return tmp2;
 }
 
 void EMGaussianMixtures::PrintParameters(void)
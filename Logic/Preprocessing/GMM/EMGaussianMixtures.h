@@ -3,6 +3,7 @@
 
 #include "GaussianMixtureModel.h"
 #include "SNAPCommon.h"
+#include <vector>
 
 class EMGaussianMixtures
 {
@@ -15,6 +16,11 @@ public:
 
   void Reset(void);
   void SetMaxIteration(int maxIteration);
+
+  /**
+   * Set the convergence tolerance. EM stops when the total log-likelihood
+   * changes by less than this fraction of its magnitude (default 1e-6)
+   */
   void SetPrecision(double precision);
   void SetParameters(int index,
                      const VectorType &mean,
@@ -37,6 +43,7 @@ public:
   static double ComputePosterior(int nGauss, double *log_pdf, double *w, double *log_w, int j);
 
 private:
+  bool IsConverged(double oldLogLikelihood, double newLogLikelihood) const;
   void EvaluatePDF(void);
   void UpdateLatent(void);
   void UpdateMean(void);
@@ -65,6 +72,24 @@ private:
   double m_precision;
 
   SmartPtr<GaussianMixtureModel> m_gmm;
+
+  // Copy of the data with the samples stored one component after another,
+  // i.e., component k of sample i is m_xsoa[k * m_numOfData + i]
+  std::vector<double> m_xsoa;
+
+  // The samples are processed in blocks, in parallel. Each block accumulates
+  // its own statistics, which are added up in block order so that the
+  // result does not depend on the number of threads
+  struct SampleBlock
+  {
+    int first, size;
+    double logLikelihood;
+    std::vector<double> sum, sumX, sumXX;
+  };
+  std::vector<SampleBlock> m_blocks;
+
+  // Perform an operation on all the blocks in parallel
+  template <class TFunction> void ParallelizeBlocks(TFunction f);
 };
 
 #endif
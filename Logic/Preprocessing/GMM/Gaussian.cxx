@@ -5,6 +5,57 @@
 #include <vnl/algo/vnl_symmetric_eigensystem.h>
 #include <limits>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Add v * d[s] to z[s] for a block of n samples
+static inline void BlockAddScaled(double v, const double *d, double *z, int n)
+{
+  int s = 0;
+#if defined(__AVX__)
+  __m256d v4 = _mm256_set1_pd(v);
+  for(; s + 4 <= n; s += 4)
+    _mm256_storeu_pd(z + s, _mm256_add_pd(_mm256_loadu_pd(z + s),
+                                          _mm256_mul_pd(v4, _mm256_loadu_pd(d + s))));
+#elif defined(__SSE2__) || defined(_M_X64)
+  __m128d v2 = _mm_set1_pd(v);
+  for(; s + 2 <= n; s += 2)
+    _mm_storeu_pd(z + s, _mm_add_pd(_mm_loadu_pd(z + s),
+                                    _mm_mul_pd(v2, _mm_loadu_pd(d + s))));
+#endif
+  for(; s < n; s++)
+    z[s] += v * d[s];
+}
+
+// Subtract nf + z[s]^2 / lambda from log_pdf[s] for a block of n samples
+static inline void BlockSubtractNormalized(double nf, double lambda, const double *z,
+                                           double *log_pdf, int n)
+{
+  int s = 0;
+#if defined(__AVX__)
+  __m256d nf4 = _mm256_set1_pd(nf), lambda4 = _mm256_set1_pd(lambda);
+  for(; s + 4 <= n; s += 4)
+    {
+    __m256d z4 = _mm256_loadu_pd(z + s);
+    __m256d t = _mm256_add_pd(nf4, _mm256_div_pd(_mm256_mul_pd(z4, z4), lambda4));
+    _mm256_storeu_pd(log_pdf + s, _mm256_sub_pd(_mm256_loadu_pd(log_pdf + s), t));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+  __m128d nf2 = _mm_set1_pd(nf), lambda2 = _mm_set1_pd(lambda);
+  for(; s + 2 <= n; s += 2)
+    {
+    __m128d z2 = _mm_loadu_pd(z + s);
+    __m128d t = _mm_add_pd(nf2, _mm_div_pd(_mm_mul_pd(z2, z2), lambda2));
+    _mm_storeu_pd(log_pdf + s, _mm_sub_pd(_mm_loadu_pd(log_pdf + s), t));
+    }
+#endif
+  for(; s < n; s++)
+    log_pdf[s] -= nf + (z[s] * z[s] / lambda);
+}
+
 Gaussian::Gaussian(int dimension)
   :m_dimension(dimension)
 {
@@ -95,6 +146,50 @@ double Gaussian::EvaluateLogPDF(VectorType &x, VectorType &xscratch)
   return 0.5 * logz;
 }
 
+void Gaussian::EvaluateLogPDF(const double *x, long stride, int n,
+                              double *log_pdf, double *scratch) const
+{
+  // This computes the same expression as above, but for a block of samples
+  // at a time, with the inner loops running over the samples using SIMD
+  // instructions where available
+  double *xdiff = scratch, *z = scratch + m_dimension * n;
+
+  // Subtract the mean from x
+  for(int k = 0; k < m_dimension; k++)
+    {
+    const double *xk = x + k * stride;
+    double *dk = xdiff + k * n, mk = m_mean_vector[k];
+    for(int s = 0; s < n; s++)
+      dk[s] = xk[s] - mk;
+    }
+
+  for(int s = 0; s < n; s++)
+    log_pdf[s] = 0.0;
+
+  for(int i = 0; i < m_dimension; i++)
+    {
+    // Project on the i-th eigenvector of the covariance matrix
+    for(int s = 0; s < n; s++)
+      z[s] = 0.0;
+    for(int k = 0; k < m_dimension; k++)
+      BlockAddScaled(m_Vt(i,k), xdiff + k * n, z, n);
+
+    if(m_Lambda[i] == 0)
+      {
+      for(int s = 0; s < n; s++)
+        if(z[s] != 0)
+          log_pdf[s] = -std::numeric_limits<double>::infinity();
+      }
+    else
+      {
+      BlockSubtractNormalized(m_DiagNormFac[i], m_Lambda[i], z, log_pdf, n);
+      }
+    }
+
+  for(int s = 0; s < n; s++)
+    log_pdf[s] *= 0.5;
+}
+
 double Gaussian::EvaluatePDF(double *x)
 {
   // We got to exponentiate somewhere, so might as well do it here
@@ -26,6 +26,12 @@ public:
   // Evaluate log PDF with user-provided scratch buffer
   double EvaluateLogPDF(VectorType &x, VectorType &xscratch);
 
+  // Evaluate log PDF for n samples stored one component after another, i.e.,
+  // component k of sample s is x[k * stride + s]. The scratch buffer must hold
+  // (dimension + 1) * n values. This is safe to call from multiple threads.
+  void EvaluateLogPDF(const double *x, long stride, int n,
+                      double *log_pdf, double *scratch) const;
+
   void PrintParameters();
 
   // Tests whether the Gaussian is a delta function (i.e., has zero total variance)
@@ -44,8 +44,9 @@ void UnsupervisedClustering::SetDataSource(SNAPImageData *imageData)
     m_DataSource = imageData;
     m_SamplesDirty = true;
 
+    // The EM iterations are multi-threaded, so a large sample is affordable
     int nvox = m_DataSource->GetMain()->GetNumberOfVoxels();
-    m_NumberOfSamples = (nvox > 10000) ? 10000 : nvox;
+    m_NumberOfSamples = (nvox > 100000) ? 100000 : nvox;
     }
 }
 
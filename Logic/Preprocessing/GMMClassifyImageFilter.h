@@ -3,10 +3,17 @@
 
 #include "itkImageToImageFilter.h"
 #include "GaussianMixtureModel.h"
+#include <vector>
 
 /**
  * @brief A class that takes multiple multi-component images and uses a
  * Gaussian mixture model to combine them into a single probability map.
+ *
+ * The output only depends on the intensities of the voxel, so when the
+ * inputs have integral components that span a small range (e.g., a single
+ * short-valued channel, or two or three channels with narrow ranges), the
+ * output is precomputed for every combination of intensities in the range
+ * and the image is mapped through this table.
  */
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
 class GMMClassifyImageFilter :
@@ -51,6 +58,15 @@ public:
   /** Set the mixture model */
   void SetMixtureModel(GaussianMixtureModel *model);
 
+  /**
+   * Maximum number of entries in the lookup table of precomputed outputs.
+   * The table is only used if it has fewer entries than a quarter of the
+   * voxels in the requested region. Set to zero to always evaluate the
+   * mixture model at each voxel.
+   */
+  itkSetMacro(MaximumLookupTableSize, unsigned long)
+  itkGetMacro(MaximumLookupTableSize, unsigned long)
+
   /** We need to override this method because of multiple input types */
   void GenerateInputRequestedRegion() ITK_OVERRIDE;
 
@@ -61,9 +77,29 @@ protected:
 
   void PrintSelf(std::ostream& os, itk::Indent indent) const ITK_OVERRIDE;
 
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
   void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
 
+  /** Compute the output for a vector of intensities */
+  OutputPixelType ComputeOutput(vnl_vector<double> &x, vnl_vector<double> &x_scratch,
+                                vnl_vector<double> &log_pdf);
+
+  /** Build the lookup table if the inputs allow it */
+  void ComputeLookupTable();
+
   GaussianMixtureModel *m_MixtureModel;
+
+  // Weights of the Gaussians and the sign of their contribution to the output
+  vnl_vector<double> m_Weights, m_LogWeights, m_PFactor;
+
+  // Table of outputs indexed by the offsets of the intensities from the
+  // minimum of each component, empty if not used
+  std::vector<OutputPixelType> m_LookupTable;
+  std::vector<long> m_LookupMinimum;
+  std::vector<size_t> m_LookupStride;
+
+  unsigned long m_MaximumLookupTableSize;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -5,12 +5,17 @@
 #include "itkImageRegionConstIterator.h"
 #include "EMGaussianMixtures.h"
 #include "ImageCollectionToImageFilter.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+#include <limits>
+#include <mutex>
 
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
 GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
 ::GMMClassifyImageFilter()
 {
   m_MixtureModel = NULL;
+  m_MaximumLookupTableSize = 1ul << 22;
 }
 
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
@@ -81,6 +86,160 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
   os << indent << "GMMClassifyImageFilter" << std::endl;
 }
 
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+typename GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>::OutputPixelType
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::ComputeOutput(vnl_vector<double> &x, vnl_vector<double> &x_scratch,
+                vnl_vector<double> &log_pdf)
+{
+  int nGauss = m_MixtureModel->GetNumberOfGaussians();
+
+  // Evaluate the posterior probability robustly
+  for(int k = 0; k < nGauss; k++)
+    {
+    log_pdf[k] = m_MixtureModel->EvaluateLogPDF(k, x, x_scratch);
+    }
+
+  // Evaluate the GMM for each of the clusters
+  double pdiff = 0;
+  for(int k = 0; k < nGauss; k++)
+    {
+    double p = EMGaussianMixtures::ComputePosterior(
+          nGauss, log_pdf.data_block(),
+          m_Weights.data_block(), m_LogWeights.data_block(), k);
+
+    pdiff += p * m_PFactor[k];
+    }
+
+  return (OutputPixelType)(pdiff * 0x7fff);
+}
+
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+void
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::BeforeThreadedGenerateData()
+{
+  assert(m_MixtureModel);
+
+  // Create a multiplier vector (1 for foreground, -1 for background)
+  int nGauss = m_MixtureModel->GetNumberOfGaussians();
+  m_PFactor.set_size(nGauss);
+  m_LogWeights.set_size(nGauss);
+  m_Weights.set_size(nGauss);
+  for(int i = 0; i < nGauss; i++)
+    {
+    m_PFactor[i] = m_MixtureModel->IsForeground(i) ? 1.0 : -1.0;
+    m_LogWeights[i] = log(m_MixtureModel->GetWeight(i));
+    m_Weights[i] = m_MixtureModel->GetWeight(i);
+    }
+
+  this->ComputeLookupTable();
+}
+
+template <class TInputImage, class TInputVectorImage, class TOutputImage>
+void
+GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
+::ComputeLookupTable()
+{
+  typedef ImageCollectionConstRegionIteratorWithIndex<
+      TInputImage, TInputVectorImage> CollectionIter;
+
+  m_LookupTable.clear();
+  m_LookupMinimum.clear();
+  m_LookupStride.clear();
+
+  // The table only works for integral intensities
+  if(!std::numeric_limits<InputComponentType>::is_integer
+     || m_MaximumLookupTableSize == 0)
+    return;
+
+  OutputImageRegionType region = this->GetOutput()->GetRequestedRegion();
+  if(region.GetNumberOfPixels() == 0)
+    return;
+
+  // Get the number of components
+  CollectionIter cit_region(region);
+  for( itk::InputDataObjectIterator it( this ); !it.IsAtEnd(); it++ )
+    cit_region.AddImage(it.GetInput());
+  int nComp = cit_region.GetTotalComponents();
+
+  // Find the range of each component in the requested region
+  std::vector<long> cmin(nComp, std::numeric_limits<long>::max());
+  std::vector<long> cmax(nComp, std::numeric_limits<long>::min());
+  std::mutex range_mutex;
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeImageRegion<ImageDimension>(
+        region, [this, nComp, &cmin, &cmax, &range_mutex](const OutputImageRegionType &thread_region)
+    {
+    CollectionIter cit(thread_region);
+    for( itk::InputDataObjectIterator it( this ); !it.IsAtEnd(); it++ )
+      cit.AddImage(it.GetInput());
+
+    std::vector<InputComponentType> tmin(nComp, std::numeric_limits<InputComponentType>::max());
+    std::vector<InputComponentType> tmax(nComp, std::numeric_limits<InputComponentType>::min());
+    for(; !cit.IsAtEnd(); ++cit)
+      {
+      for(int i = 0; i < nComp; i++)
+        {
+        InputComponentType v = cit.Value(i);
+        tmin[i] = std::min(tmin[i], v);
+        tmax[i] = std::max(tmax[i], v);
+        }
+      }
+
+    std::lock_guard<std::mutex> guard(range_mutex);
+    for(int i = 0; i < nComp; i++)
+      {
+      cmin[i] = std::min(cmin[i], (long) tmin[i]);
+      cmax[i] = std::max(cmax[i], (long) tmax[i]);
+      }
+    }, nullptr);
+
+  // Check that the table is small enough, and enough smaller than the
+  // region for it to save work
+  double n_entries = 1.0;
+  for(int i = 0; i < nComp; i++)
+    n_entries *= (double) (cmax[i] - cmin[i] + 1);
+
+  if(nComp == 0
+     || n_entries > (double) m_MaximumLookupTableSize
+     || n_entries > 0.25 * (double) region.GetNumberOfPixels())
+    return;
+
+  m_LookupMinimum = cmin;
+  m_LookupStride.resize(nComp);
+  size_t stride = 1;
+  for(int i = 0; i < nComp; i++)
+    {
+    m_LookupStride[i] = stride;
+    stride *= (size_t) (cmax[i] - cmin[i] + 1);
+    }
+
+  // Evaluate the mixture model for every entry, using the same code as for
+  // individual voxels so that the output does not depend on the table
+  m_LookupTable.resize(stride);
+  const size_t block_size = 4096;
+  size_t n_blocks = (stride + block_size - 1) / block_size;
+  mt->ParallelizeArray(
+        0, n_blocks, [this, nComp, stride, block_size, &cmin, &cmax](itk::SizeValueType b)
+    {
+    vnl_vector<double> x(nComp), x_scratch(nComp);
+    vnl_vector<double> log_pdf(m_MixtureModel->GetNumberOfGaussians());
+
+    size_t end = std::min(stride, (size_t) (b + 1) * block_size);
+    for(size_t pos = (size_t) b * block_size; pos < end; pos++)
+      {
+      for(int i = 0; i < nComp; i++)
+        {
+        long size = cmax[i] - cmin[i] + 1;
+        x[i] = (double) (cmin[i] + (long) ((pos / m_LookupStride[i]) % size));
+        }
+      m_LookupTable[pos] = this->ComputeOutput(x, x_scratch, log_pdf);
+      }
+    }, nullptr);
+}
+
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
 void
 GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
@@ -97,23 +256,6 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
   typedef itk::ImageRegionIterator<TOutputImage> OutputIter;
   OutputIter it_out(outputPtr, outputRegionForThread);
 
-  vnl_vector<double> x(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> x_scratch(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> z_scratch(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> log_pdf(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> log_w(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> w(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> p(m_MixtureModel->GetNumberOfGaussians());
-
-  // Create a multiplier vector (1 for foreground, -1 for background)
-  vnl_vector<double> pfactor(m_MixtureModel->GetNumberOfGaussians());
-  for(int i = 0; i < m_MixtureModel->GetNumberOfGaussians(); i++)
-    {
-    pfactor[i] = m_MixtureModel->IsForeground(i) ? 1.0 : -1.0;
-    log_w[i] = log(m_MixtureModel->GetWeight(i));
-    w[i] = m_MixtureModel->GetWeight(i);
-    }
-
   // Configure the input collection iterator
   CollectionIter cit(outputRegionForThread);
   for( itk::InputDataObjectIterator it( this ); !it.IsAtEnd(); it++ )
@@ -122,33 +264,38 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
   // Get the number of components
   int nComp = cit.GetTotalComponents();
 
-  // Iterate through all the voxels
-  while ( !it_out.IsAtEnd() )
+  // Map the intensities through the table of precomputed outputs
+  if(!m_LookupTable.empty())
     {
-    for(int i = 0; i < nComp; i++)
+    const OutputPixelType *table = &m_LookupTable[0];
+    while ( !it_out.IsAtEnd() )
       {
-      x[i] = cit.Value(i);
-      }
+      size_t pos = 0;
+      for(int i = 0; i < nComp; i++)
+        pos += (size_t) (cit.Value(i) - m_LookupMinimum[i]) * m_LookupStride[i];
 
-    // Evaluate the posterior probability robustly
-    for(int k = 0; k < m_MixtureModel->GetNumberOfGaussians(); k++)
-      {
-      log_pdf[k] = m_MixtureModel->EvaluateLogPDF(k, x, x_scratch);
+      it_out.Set(table[pos]);
+
+      ++it_out;
+      ++cit;
       }
+    return;
+    }
 
-    // Evaluate the GMM for each of the clusters
-    double pdiff = 0;
-    for(int k = 0; k < m_MixtureModel->GetNumberOfGaussians(); k++)
-      {
-      p[k] = EMGaussianMixtures::ComputePosterior(
-            m_MixtureModel->GetNumberOfGaussians(),
-            log_pdf.data_block(), w.data_block(), log_w.data_block(), k);
+  vnl_vector<double> x(nComp);
+  vnl_vector<double> x_scratch(nComp);
+  vnl_vector<double> log_pdf(m_MixtureModel->GetNumberOfGaussians());
 
-      pdiff += p[k] * pfactor[k];
+  // Iterate through all the voxels
+  while ( !it_out.IsAtEnd() )
+    {
+    for(int i = 0; i < nComp; i++)
+      {
+      x[i] = cit.Value(i);
       }
 
     // Store the value
-    it_out.Set((OutputPixelType)(pdiff * 0x7fff));
+    it_out.Set(this->ComputeOutput(x, x_scratch, log_pdf));
 
     ++it_out;
     ++cit;
@@ -159,6 +159,9 @@ public:
   void GoToBegin() { m_InternalIter.GoToBegin(); }
   void GoToEnd() { m_InternalIter.GoToEnd(); }
 
+  /** Move the iterator to a voxel, which must lie in the region */
+  void SetIndex(const IndexType &index) { m_InternalIter.SetIndex(index); }
+
   /** Get a pointer to a component */
   InternalPixelType &Value(unsigned int comp)
   {
@@ -5,11 +5,82 @@
 #include "ImageWrapper.h"
 #include "ImageCollectionToImageFilter.h"
 #include "RLEImageRegionIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
 
 // Includes from the random forest library
 #include "Library/classification.h"
 #include "Library/data.h"
 
+typedef std::map<LabelType, unsigned long> LabelVoxelCountMap;
+
+/**
+ * Visit the voxels in a region of the segmentation image that have non-zero
+ * labels by walking the runs of each line, skipping the background runs.
+ * The number of voxels with each label is added to count. If the output
+ * vectors are given, every n-th voxel of each label (in scan order) is
+ * recorded, where n is the stride given for that label.
+ */
+static void
+CollectLabeledVoxels(const LabelImageWrapper::ImageType *image,
+                     const itk::ImageRegion<3> &region,
+                     LabelVoxelCountMap &count, const LabelVoxelCountMap *stride,
+                     std::vector<itk::Index<3> > *index, std::vector<LabelType> *label)
+{
+  typedef LabelImageWrapper::ImageType::BufferType BufferType;
+  typedef LabelImageWrapper::ImageType::RLLine RLLine;
+
+  // The lines of the buffer that cross the region
+  BufferType::RegionType line_region;
+  for(unsigned int d = 0; d < 2; d++)
+    {
+    line_region.SetIndex(d, region.GetIndex(d+1));
+    line_region.SetSize(d, region.GetSize(d+1));
+    }
+
+  // The extent of the region along each line
+  long x_origin = image->GetBufferedRegion().GetIndex(0);
+  long x_begin = region.GetIndex(0) - x_origin;
+  long x_end = x_begin + (long) region.GetSize(0);
+
+  const BufferType *buffer = image->GetBuffer();
+  itk::ImageRegionConstIteratorWithIndex<BufferType> it(buffer, line_region);
+  for(; !it.IsAtEnd(); ++it)
+    {
+    const RLLine &line = it.Get();
+    long x = 0;
+    for(size_t i = 0; i < line.size() && x < x_end; i++)
+      {
+      long run_end = x + line[i].first;
+      long a = std::max(x, x_begin), b = std::min(run_end, x_end);
+      if(line[i].second != 0 && a < b)
+        {
+        unsigned long &n_labeled = count[line[i].second];
+        if(index)
+          {
+          // Skip to the next voxel of this label that falls on its stride
+          unsigned long n = stride->find(line[i].second)->second;
+          long first = a + (long) ((n - n_labeled % n) % n);
+          for(long xi = first; xi < b; xi += n)
+            {
+            itk::Index<3> idx;
+            idx[0] = x_origin + xi;
+            idx[1] = it.GetIndex()[0];
+            idx[2] = it.GetIndex()[1];
+            index->push_back(idx);
+            label->push_back(line[i].second);
+            }
+          }
+        n_labeled += (unsigned long) (b - a);
+        }
+      x = run_end;
+      }
+    }
+}
+
 template <class TPixel, class TLabel, int VDim>
 RFClassificationEngine<TPixel,TLabel,VDim>::RFClassificationEngine()
 {
@@ -20,6 +91,7 @@ RFClassificationEngine<TPixel,TLabel,VDim>::RFClassificationEngine()
   m_TreeDepth = 30;
   m_PatchRadius.Fill(0);
   m_UseCoordinateFeatures = false;
+  m_MaximumSampleSize = 200000;
 }
 
 template <class TPixel, class TLabel, int VDim>
@@ -69,30 +141,72 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   // TODO: this is defaulting to the first image - is this correct?
   LabelImageWrapper *wrpSeg = m_DataSource->GetFirstSegmentationLayer();
   const LabelImageWrapper::ImageType *imgSeg = wrpSeg->GetImage();
-  typedef itk::ImageRegionConstIteratorWithIndex<LabelImageWrapper::ImageType> LabelIter;
 
   // Shrink the buffered region by radius because we can't handle BCs
   itk::ImageRegion<3> reg = imgSeg->GetBufferedRegion();
   reg.ShrinkByRadius(m_PatchRadius);
 
-  // We need to iterate throught the label image once to determine the
-  // number of samples to allocate.
-  unsigned long nSamples = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit)
-    if(lit.Value())
-      nSamples++;
+  // Count the voxels with each label. If there are too many labeled voxels,
+  // the maximum sample size is shared between the labels, so that labels
+  // with few voxels keep all of them, and only every n-th voxel of the
+  // larger labels is used
+  LabelVoxelCountMap labelCount, labelStride;
+  CollectLabeledVoxels(imgSeg, reg, labelCount, NULL, NULL, NULL);
 
-  // Create an iterator for going over all the anatomical image data
-  CollectionIter cit(reg);
-  cit.SetRadius(m_PatchRadius);
+  unsigned long nLabeled = 0;
+  std::vector<std::pair<unsigned long, LabelType> > bySize;
+  for(LabelVoxelCountMap::const_iterator it = labelCount.begin(); it != labelCount.end(); ++it)
+    {
+    nLabeled += it->second;
+    bySize.push_back(std::make_pair(it->second, it->first));
+    labelStride[it->first] = 1;
+    }
 
-  // Add all the anatomical images to this iterator
+  if(m_MaximumSampleSize > 0 && nLabeled > m_MaximumSampleSize)
+    {
+    // Visit the labels from the smallest up, giving each its share of what
+    // is left of the sample
+    std::sort(bySize.begin(), bySize.end());
+    unsigned long nLeft = m_MaximumSampleSize;
+    for(size_t i = 0; i < bySize.size(); i++)
+      {
+      unsigned long share = std::max(nLeft / (bySize.size() - i), 1ul);
+      unsigned long quota = std::min(bySize[i].first, share);
+      labelStride[bySize[i].second] = (bySize[i].first + quota - 1) / quota;
+      nLeft -= std::min(quota, nLeft);
+      }
+
+    std::cout << "Classifier training: " << nLabeled << " labeled voxels exceed the "
+              << "maximum sample size of " << m_MaximumSampleSize
+              << ", sampling the voxels of each label" << std::endl;
+    }
+
+  unsigned long nExpected = 0;
+  for(LabelVoxelCountMap::const_iterator it = labelCount.begin(); it != labelCount.end(); ++it)
+    nExpected += (it->second + labelStride[it->first] - 1) / labelStride[it->first];
+
+  std::vector<itk::Index<3> > sampleIndex;
+  std::vector<LabelType> sampleLabel;
+  sampleIndex.reserve(nExpected);
+  sampleLabel.reserve(nExpected);
+  LabelVoxelCountMap sampledCount;
+  CollectLabeledVoxels(imgSeg, reg, sampledCount, &labelStride, &sampleIndex, &sampleLabel);
+  unsigned long nSamples = sampleIndex.size();
+
+  // Collect all the anatomical image data
+  std::vector<itk::DataObject *> images;
   for(LayerIterator it = m_DataSource->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
       !it.IsAtEnd(); ++it)
     {
-    cit.AddImage(it.GetLayer()->GetImageBase());
+    images.push_back(it.GetLayer()->GetImageBase());
     }
 
+  // Create an iterator to determine the number of features
+  CollectionIter cit(reg);
+  cit.SetRadius(m_PatchRadius);
+  for(size_t i = 0; i < images.size(); i++)
+    cit.AddImage(images[i]);
+
   // Get the number of components
   int nComp = cit.GetTotalComponents();
   int nPatch = cit.GetNeighborhoodSize();
@@ -105,31 +219,41 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   // Create a new sample
   m_Sample = new SampleType(nSamples, nColumns);
 
-  // Now fill out the samples
-  int iSample = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit, ++cit)
+  // Now fill out the samples, with each thread handling blocks of samples
+  const unsigned long block_size = 1024;
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(
+        0, (nSamples + block_size - 1) / block_size,
+        [this, &reg, &images, &sampleIndex, &sampleLabel, nSamples, nComp, nPatch, block_size]
+        (itk::SizeValueType block)
     {
-    LabelType label = lit.Value();
-    if(label)
+    CollectionIter bit(reg);
+    bit.SetRadius(m_PatchRadius);
+    for(size_t i = 0; i < images.size(); i++)
+      bit.AddImage(images[i]);
+
+    unsigned long iEnd = std::min(nSamples, (unsigned long) (block + 1) * block_size);
+    for(unsigned long iSample = block * block_size; iSample < iEnd; iSample++)
       {
+      const itk::Index<3> &idx = sampleIndex[iSample];
+      bit.SetIndex(idx);
+
       // Fill in the data
       std::vector<GreyType> &column = m_Sample->data[iSample];
       int k = 0;
       for(int i = 0; i < nComp; i++)
         for(int j = 0; j < nPatch; j++)
-          column[k++] = cit.NeighborValue(i,j);
+          column[k++] = bit.NeighborValue(i,j);
 
       // Add the coordinate features if used
       if(m_UseCoordinateFeatures)
         for(int d = 0; d < 3; d++)
-          column[k++] = lit.GetIndex()[d];
+          column[k++] = idx[d];
 
       // Fill in the label
-      m_Sample->label[iSample] = label;
-
-      ++iSample;
+      m_Sample->label[iSample] = sampleLabel[iSample];
       }
-    }
+    }, nullptr);
 
   // Check that the sample has at least two distinct labels
   bool isValidSample = false;
@@ -59,6 +59,17 @@ public:
   itkGetMacro(UseCoordinateFeatures, bool)
   itkSetMacro(UseCoordinateFeatures, bool)
 
+  /**
+   * Maximum number of labeled voxels extracted for training (200000 by
+   * default). If there are more labeled voxels, the limit is shared between
+   * the labels: labels with few voxels keep all of them, and every n-th voxel
+   * (in scan order) of each larger label is used. A message is printed when
+   * this happens. Set to zero to train on all labeled voxels, as was always
+   * done before this limit was introduced.
+   */
+  itkGetMacro(MaximumSampleSize, unsigned long)
+  itkSetMacro(MaximumSampleSize, unsigned long)
+
   /** Get the number of components passed to the classifier */
   int GetNumberOfComponents() const;
 
@@ -89,6 +100,9 @@ protected:
   // Are coordinates included as features
   bool m_UseCoordinateFeatures;
 
+  // Maximum number of samples extracted from the segmentation
+  unsigned long m_MaximumSampleSize;
+
   // Cached samples used to train the classifier
   typedef MLData<GreyType, LabelType> SampleType;
   SampleType *m_Sample;
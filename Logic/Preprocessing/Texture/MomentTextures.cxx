@@ -3,6 +3,10 @@
 #include "itkVectorImage.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkNeighborhoodIterator.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -11,10 +15,247 @@ const int MAX_VAL=100000;
 
 namespace bilwaj {
 
+// Replace each value on a line by the sum of the 2r+1 values centered on it.
+// Only the values at least r away from the ends of the line are computed.
+template <class T>
+static void BoxSumLine(T *line, long stride, long n, long r, std::vector<T> &tmp)
+{
+  tmp.resize(n);
+  for(long i = 0; i < n; i++)
+    tmp[i] = line[i * stride];
+
+  T sum = 0;
+  for(long i = 0; i <= 2 * r; i++)
+    sum += tmp[i];
+  line[r * stride] = sum;
+
+  for(long i = r + 1; i < n - r; i++)
+    {
+    sum += tmp[i + r] - tmp[i - r - 1];
+    line[i * stride] = sum;
+    }
+}
+
+// Replace each value on a line by the minimum (or maximum, depending on the
+// comparison) of the 2r+1 values centered on it, using the van Herk/Gil-Werman
+// algorithm. Only the values at least r away from the ends are computed.
+template <class T, class TCompare>
+static void BoxExtremumLine(T *line, long stride, long n, long r,
+                            std::vector<T> &g, std::vector<T> &h, TCompare better)
+{
+  // Running extrema from the start (g) and from the end (h) of each block
+  // of 2r+1 values
+  long w = 2 * r + 1;
+  g.resize(n);
+  h.resize(n);
+  for(long i = 0; i < n; i++)
+    {
+    T v = line[i * stride];
+    g[i] = (i % w == 0 || better(v, g[i-1])) ? v : g[i-1];
+    }
+  for(long i = n - 1; i >= 0; i--)
+    {
+    T v = line[i * stride];
+    h[i] = (i == n - 1 || (i + 1) % w == 0 || better(v, h[i+1])) ? v : h[i+1];
+    }
+
+  // Each window consists of the end of one block and the start of the next
+  for(long i = r; i < n - r; i++)
+    {
+    T a = h[i - r], b = g[i + r];
+    line[i * stride] = better(a, b) ? a : b;
+    }
+}
+
 template <class TInputImage, class TOutputImage>
 void
 MomentTextureFilter<TInputImage, TOutputImage>
 ::DynamicThreadedGenerateData(const RegionType & outputRegionForThread)
+{
+  if(m_UseRunningSums && ImageDimension == 3)
+    this->GenerateDataWithRunningSums(outputRegionForThread);
+  else
+    this->GenerateDataWithNeighborhoods(outputRegionForThread);
+}
+
+template <class TInputImage, class TOutputImage>
+void
+MomentTextureFilter<TInputImage, TOutputImage>
+::GenerateDataWithRunningSums(const RegionType & outputRegionForThread)
+{
+  typedef itk::ImageRegionIteratorWithIndex<OutputImageType> OutputIteratorType;
+  typedef typename RegionType::IndexType IndexType;
+
+  const InputImageType *input = this->GetInput();
+  const RegionType &inRegion = input->GetBufferedRegion();
+  const InputPixelType *inBuffer = input->GetBufferPointer();
+
+  // The neighborhood size
+  long r[3], nbr_size = 1;
+  for(int d = 0; d < 3; d++)
+    {
+    r[d] = m_Radius[d];
+    nbr_size *= 2 * r[d] + 1;
+    }
+
+  // The region is processed in tiles. Each tile is padded by the radius, and
+  // the padded block is kept to about 1M voxels, so that the memory used by
+  // each thread is bounded. Tiles are halved along their longest side, but
+  // are not made thinner than the neighborhood, where the padding would
+  // dominate the work
+  long size[3], tile[3], n_tiles[3], n_total = 1;
+  for(int d = 0; d < 3; d++)
+    size[d] = tile[d] = outputRegionForThread.GetSize(d);
+
+  while((tile[0] + 2 * r[0]) * (tile[1] + 2 * r[1]) * (tile[2] + 2 * r[2]) > (1l << 20))
+    {
+    int d_split = -1;
+    for(int d = 0; d < 3; d++)
+      if(tile[d] > 2 * r[d] + 1 && (d_split < 0 || tile[d] > tile[d_split]))
+        d_split = d;
+    if(d_split < 0)
+      break;
+    tile[d_split] = std::max(2 * r[d_split] + 1, (tile[d_split] + 1) / 2);
+    }
+
+  for(int d = 0; d < 3; d++)
+    {
+    n_tiles[d] = (size[d] + tile[d] - 1) / tile[d];
+    n_total *= n_tiles[d];
+    }
+
+  // Running sums of the powers of the intensity, and running extrema
+  unsigned int degree = m_HighestDegree;
+  std::vector< std::vector<double> > sums(degree);
+  std::vector<InputPixelType> vmin, vmax;
+  std::vector<double> tmp;
+  std::vector<InputPixelType> g, h;
+  std::vector<long> clamp[3];
+
+  vnl_vector<float> accumX(degree);
+  OutputPixelType out_pix(degree);
+
+  for(long t = 0; t < n_total; t++)
+    {
+    RegionType tileRegion = outputRegionForThread;
+    long t_rest = t;
+    for(int d = 0; d < 3; d++)
+      {
+      long first = (t_rest % n_tiles[d]) * tile[d];
+      tileRegion.SetIndex(d, outputRegionForThread.GetIndex(d) + first);
+      tileRegion.SetSize(d, std::min(tile[d], size[d] - first));
+      t_rest /= n_tiles[d];
+      }
+
+    // Size of the padded block, and the input voxel for each of its rows.
+    // Voxels outside of the image are replaced by the nearest voxel in the
+    // image, as with the zero flux Neumann boundary condition
+    long nb[3];
+    for(int d = 0; d < 3; d++)
+      {
+      nb[d] = tileRegion.GetSize(d) + 2 * r[d];
+      clamp[d].resize(nb[d]);
+      long in_first = inRegion.GetIndex(d);
+      long in_last = in_first + (long) inRegion.GetSize(d) - 1;
+      for(long i = 0; i < nb[d]; i++)
+        {
+        long x = tileRegion.GetIndex(d) - r[d] + i;
+        clamp[d][i] = std::min(std::max(x, in_first), in_last) - in_first;
+        }
+      }
+
+    // Load the powers of the intensity into the block
+    size_t n_vox = nb[0] * nb[1] * nb[2];
+    for(unsigned int k = 0; k < degree; k++)
+      sums[k].resize(n_vox);
+    vmin.resize(n_vox);
+    vmax.resize(n_vox);
+
+    size_t p = 0;
+    for(long z = 0; z < nb[2]; z++)
+      {
+      for(long y = 0; y < nb[1]; y++)
+        {
+        const InputPixelType *row = inBuffer
+            + (clamp[2][z] * inRegion.GetSize(1) + clamp[1][y]) * inRegion.GetSize(0);
+        for(long x = 0; x < nb[0]; x++, p++)
+          {
+          InputPixelType v = row[clamp[0][x]];
+          vmin[p] = vmax[p] = v;
+          double xk = v;
+          for(unsigned int k = 0; k < degree; k++)
+            {
+            sums[k][p] = xk;
+            xk *= v;
+            }
+          }
+        }
+      }
+
+    // Apply the box filters along each axis in turn
+    long stride[3] = { 1, nb[0], nb[0] * nb[1] };
+    for(int d = 0; d < 3; d++)
+      {
+      long n_lines = n_vox / nb[d];
+      for(long line = 0; line < n_lines; line++)
+        {
+        long start = line % stride[d] + (line / stride[d]) * stride[d] * nb[d];
+        for(unsigned int k = 0; k < degree; k++)
+          BoxSumLine(&sums[k][start], stride[d], nb[d], r[d], tmp);
+        BoxExtremumLine(&vmin[start], stride[d], nb[d], r[d], g, h, std::less<InputPixelType>());
+        BoxExtremumLine(&vmax[start], stride[d], nb[d], r[d], g, h, std::greater<InputPixelType>());
+        }
+      }
+
+    // Compute the moments from the sums
+    for(OutputIteratorType TexIt(this->GetOutput(), tileRegion); !TexIt.IsAtEnd(); ++TexIt)
+      {
+      const IndexType &idx = TexIt.GetIndex();
+      size_t q = ((idx[2] - tileRegion.GetIndex(2) + r[2]) * nb[1]
+          + (idx[1] - tileRegion.GetIndex(1) + r[1])) * nb[0]
+          + (idx[0] - tileRegion.GetIndex(0) + r[0]);
+
+      // As in the neighborhood code, the range always includes zero
+      float min = MIN(0, vmin[q]);
+      float max = MAX(0, vmax[q]);
+      float range = max - min;
+      float mean = (float) sums[0][q] / nbr_size;
+
+      // The sum of (x - mean)^j is expanded as a sum of binomial terms
+      // C(j,i) (-mean)^(j-i) sum(x^i)
+      for(unsigned int k = 1; k < degree; k++)
+        {
+        int j = k + 1;
+        double c = 0.0, binom = 1.0, mean_pow = 1.0;
+        for(int i = j; i >= 0; i--)
+          {
+          double sum_i = (i == 0) ? (double) nbr_size : sums[i-1][q];
+          c += binom * mean_pow * sum_i;
+          binom = binom * i / (j - i + 1);
+          mean_pow *= -mean;
+          }
+        accumX[k] = c / (nbr_size * std::pow((double) range, j));
+        }
+
+      // The first moment should just be the mean
+      if(degree > 0)
+        accumX[0] = mean / range;
+
+      // Assign to the output voxel
+      for(unsigned int k = 0; k < degree; k++)
+        {
+        out_pix[k] = static_cast<OutputComponentType>(1000 * accumX[k]);
+        }
+
+      TexIt.Set(out_pix);
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+MomentTextureFilter<TInputImage, TOutputImage>
+::GenerateDataWithNeighborhoods(const RegionType & outputRegionForThread)
 {
   // Iterator for the output region
   typedef itk::ImageRegionIteratorWithIndex<OutputImageType> OutputIteratorType;
@@ -45,18 +45,35 @@ public:
   itkSetMacro(HighestDegree, unsigned int)
   itkGetMacro(HighestDegree, unsigned int)
 
+  /**
+   * Compute the moments from running sums of the powers of the intensity
+   * along each axis, so that the cost per voxel does not depend on the
+   * radius (default). Otherwise, the neighborhood of each voxel is visited.
+   */
+  itkSetMacro(UseRunningSums, bool)
+  itkGetMacro(UseRunningSums, bool)
+
 protected:
 
-  MomentTextureFilter() : m_HighestDegree(2) { m_Radius.Fill(1); }
+  MomentTextureFilter() : m_HighestDegree(2), m_UseRunningSums(true) { m_Radius.Fill(1); }
   ~MomentTextureFilter() {}
 
   virtual void DynamicThreadedGenerateData(const RegionType & outputRegionForThread) ITK_OVERRIDE;
 
   virtual void UpdateOutputInformation() ITK_OVERRIDE;
 
+  // Visit the neighborhood of each voxel
+  void GenerateDataWithNeighborhoods(const RegionType & outputRegionForThread);
+
+  // Use running sums along each axis
+  void GenerateDataWithRunningSums(const RegionType & outputRegionForThread);
+
   // Highest degree for which to generate the textures
   unsigned int m_HighestDegree;
 
+  // Whether running sums are used
+  bool m_UseRunningSums;
+
   // Radius of the neighborhood for texture generation
   SizeType m_Radius;
 
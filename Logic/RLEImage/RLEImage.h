@@ -6,6 +6,10 @@
 #include <itkImageBase.h>
 #include <itkImage.h>
 
+#ifdef SNAP_RLE_POOLED_LINES
+#include "RLESegmentPool.h"
+#endif
+
 /** Run-Length Encoded image.
 * It saves memory for label images at the expense of processing times.
 * Unsuitable for ordinary images (in which case it is counterproductive).
@@ -47,8 +51,14 @@ public:
     * second element is the pixel value. */
     typedef std::pair<CounterType, PixelType> RLSegment;
 
-    /** A Run-Length encoded line of pixels. */
+    /** A Run-Length encoded line of pixels. When SNAP_RLE_POOLED_LINES is
+    * defined, the segments of all lines are allocated from a shared slab
+    * pool (see RLESegmentPool) instead of individually from the heap. */
+#ifdef SNAP_RLE_POOLED_LINES
+    typedef std::vector<RLSegment, RLEPoolAllocator<RLSegment> > RLLine;
+#else
     typedef std::vector<RLSegment> RLLine;
+#endif
 
     /** Internal Pixel representation. Used to maintain a uniform API
     * with Image Adaptors and allow to keep a particular internal
@@ -250,6 +260,9 @@ protected:
     /** Merges adjacent segments with duplicate values in a single line. */
     void CleanUpLine(RLLine & line) const;
 
+    /** Sets every line of the buffer to a copy of the given line. */
+    void FillLines(const RLLine & line);
+
 private:
     bool m_OnTheFlyCleanup; //should same-valued segments be merged on the fly
 
@@ -3,6 +3,8 @@
 
 #include "RLEImage.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkMultiThreaderBase.h"
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 inline typename RLEImage<TPixel, VImageDimension, CounterType>::BufferType::IndexType
@@ -54,7 +56,7 @@ void RLEImage<TPixel, VImageDimension, CounterType>::Allocate(bool initialize)
         RLSegment segment(CounterType(this->GetBufferedRegion().GetSize(0)), TPixel());
         RLLine line(1);
         line[0] = segment;
-        myBuffer->FillBuffer(line);
+        FillLines(line);
     }
 }
 
@@ -65,7 +67,34 @@ void RLEImage<TPixel, VImageDimension, CounterType>
     RLSegment segment(CounterType(this->GetBufferedRegion().GetSize(0)), value);
     RLLine line(1);
     line[0] = segment;
-    myBuffer->FillBuffer(line);
+    FillLines(line);
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>
+::FillLines(const RLLine & line)
+{
+    // Every line is a separate heap allocation, so for large images the
+    // fill is split into slabs of lines across threads
+    typedef typename BufferType::RegionType BufferRegionType;
+    const BufferRegionType &region = myBuffer->GetBufferedRegion();
+    if (region.GetNumberOfPixels() < 4096)
+    {
+        myBuffer->FillBuffer(line);
+        return;
+    }
+
+    BufferType *buffer = myBuffer.GetPointer();
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeImageRegion<VImageDimension - 1>(
+        region,
+        [buffer, &line](const BufferRegionType &lines)
+        {
+            itk::ImageRegionIterator<BufferType> it(buffer, lines);
+            for (; !it.IsAtEnd(); ++it)
+                it.Value() = line;
+        },
+        nullptr);
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -4,6 +4,7 @@
 #include "itkImageToImageFilter.h"
 #include "itkSmartPointer.h"
 #include "itkRegionOfInterestImageFilter.h"
+#include "itkImageRegionSplitterDirection.h"
 #include "RLEImage.h"
 
 namespace itk
@@ -69,7 +70,11 @@ public:
 #endif
 
 protected:
-  RegionOfInterestImageFilter() {}
+  RegionOfInterestImageFilter()
+  {
+    m_LineSplitter = ImageRegionSplitterDirection::New();
+    m_LineSplitter->SetDirection(0);
+  }
   ~RegionOfInterestImageFilter() {}
   void PrintSelf(std::ostream & os, Indent indent) const ITK_OVERRIDE;
 
@@ -90,11 +95,17 @@ protected:
   /** RegionOfInterestImageFilter can be implemented as a multithreaded filter.  */
   void DynamicThreadedGenerateData(const RegionType & outputRegionForThread) ITK_OVERRIDE;
 
+  /** Work is split into slabs of complete run-length lines (never along X). */
+  virtual const ImageRegionSplitterBase *GetImageRegionSplitter() const ITK_OVERRIDE
+  { return m_LineSplitter; }
+
 private:
   RegionOfInterestImageFilter(const Self &); //purposely not implemented
   void operator=(const Self &);              //purposely not implemented
 
   RegionType m_RegionOfInterest;
+
+  ImageRegionSplitterDirection::Pointer m_LineSplitter;
 };
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -144,7 +155,11 @@ public:
 #endif
 
 protected:
-    RegionOfInterestImageFilter() {}
+    RegionOfInterestImageFilter()
+    {
+        m_LineSplitter = ImageRegionSplitterDirection::New();
+        m_LineSplitter->SetDirection(0);
+    }
     ~RegionOfInterestImageFilter() {}
     void PrintSelf(std::ostream & os, Indent indent) const ITK_OVERRIDE;
 
@@ -165,11 +180,17 @@ protected:
     /** RegionOfInterestImageFilter can be implemented as a multithreaded filter. */
     void DynamicThreadedGenerateData(const RegionType & outputRegionForThread) ITK_OVERRIDE;
 
+    /** Work is split into slabs of complete run-length lines (never along X). */
+    virtual const ImageRegionSplitterBase *GetImageRegionSplitter() const ITK_OVERRIDE
+    { return m_LineSplitter; }
+
 private:
     RegionOfInterestImageFilter(const Self &); //purposely not implemented
     void operator=(const Self &);              //purposely not implemented
 
     RegionType m_RegionOfInterest;
+
+    ImageRegionSplitterDirection::Pointer m_LineSplitter;
 };
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -219,7 +240,11 @@ public:
 #endif
 
 protected:
-    RegionOfInterestImageFilter() {}
+    RegionOfInterestImageFilter()
+    {
+        m_LineSplitter = ImageRegionSplitterDirection::New();
+        m_LineSplitter->SetDirection(0);
+    }
     ~RegionOfInterestImageFilter() {}
     void PrintSelf(std::ostream & os, Indent indent) const ITK_OVERRIDE;
 
@@ -240,11 +265,17 @@ protected:
     /** RegionOfInterestImageFilter can be implemented as a multithreaded filter. */
     void DynamicThreadedGenerateData(const RegionType & outputRegionForThread) ITK_OVERRIDE;
 
+    /** Work is split into slabs of complete run-length lines (never along X). */
+    virtual const ImageRegionSplitterBase *GetImageRegionSplitter() const ITK_OVERRIDE
+    { return m_LineSplitter; }
+
 private:
     RegionOfInterestImageFilter(const Self &); //purposely not implemented
     void operator=(const Self &);              //purposely not implemented
 
     RegionType m_RegionOfInterest;
+
+    ImageRegionSplitterDirection::Pointer m_LineSplitter;
 };
 } // end namespace itk
 
@@ -6,6 +6,7 @@
 #include "itkObjectFactory.h"
 #include "itkProgressReporter.h"
 #include "itkImage.h"
+#include "itkImageScanlineConstIterator.h"
 
 namespace itk
 {
@@ -295,7 +296,7 @@ void RegionOfInterestImageFilter<Image<TPixel, VImageDimension>,
     inputRegionForThread.SetIndex(start);
 
     typename RLEImageType::BufferType::RegionType oReg = RLEImageType::truncateRegion(outputRegionForThread);
-    ImageRegionConstIterator<ImageType> iIt(in, inputRegionForThread);
+    ImageScanlineConstIterator<ImageType> iIt(in, inputRegionForThread);
     ImageRegionIterator<typename RLEImageType::BufferType> oIt(out->GetBuffer(), oReg);
     SizeValueType size0 = outputRegionForThread.GetSize(0);
     typename RLEImageType::RLLine temp;
@@ -303,20 +304,21 @@ void RegionOfInterestImageFilter<Image<TPixel, VImageDimension>,
 
     while (!oIt.IsAtEnd())
     {
-        SizeValueType x = 0;
+        // Encode the scanline directly from the input buffer
+        const TPixel *p = in->GetBufferPointer() + in->ComputeOffset(iIt.GetIndex());
+        const TPixel *pEnd = p + size0;
         temp.clear();
-        while (x < size0)
+        while (p < pEnd)
         {
-            typename RLEImageType::RLSegment s(0, iIt.Value());
-            while (x < size0 && iIt.Value() == s.second)
-            {
-                x++;
+            typename RLEImageType::RLSegment s(1, *p);
+            for (++p; p < pEnd && *p == s.second; ++p)
                 s.first++;
-                ++(iIt);
-            }
             temp.push_back(s);
         }
-        oIt.Value() = temp;
+
+        // Copy into the output line, allocating exactly once
+        oIt.Value().assign(temp.begin(), temp.end());
+        iIt.NextLine();
         ++oIt;
     }
 }
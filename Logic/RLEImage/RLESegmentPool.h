@@ -0,0 +1,389 @@
+#ifndef RLESegmentPool_h
+#define RLESegmentPool_h
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/** Slab pool backing the run-length lines of RLEImage.
+* Each line of an RLEImage is a small vector, so a large segmentation
+* consists of millions of tiny heap blocks that are constantly resized
+* while painting. The pool hands out blocks from large slabs, grouped
+* into power-of-two size classes. Lines allocated together (e.g. when
+* an image is filled or converted) end up next to each other in memory,
+* and freed blocks are recycled without going back to the system allocator.
+*
+* Each thread keeps its own free lists and exchanges blocks with a shared
+* list in batches, so allocation from parallel filters is mostly lock-free.
+* The pool counts the free blocks of each slab. Once the slabs whose blocks
+* are all back in the shared lists add up to TrimSize bytes (and to at least
+* half of the shared lists), they are returned to the system, so that the
+* memory held by the pool stays close to what is in use after large images
+* are released.
+*/
+class RLESegmentPool
+{
+public:
+    /** Blocks up to this size (in bytes) come from the pool; larger ones
+    * go to the system allocator. */
+    static const size_t MaxPooledSize = 4096;
+
+    static void *Allocate(size_t bytes)
+    {
+        int cls = GetSizeClass(bytes);
+        if (cls < 0)
+            return ::operator new(bytes);
+
+        // After the thread cache has been flushed (thread exit), blocks come
+        // straight from the shared list, since nothing would flush them again
+        ThreadCache &cache = GetThreadCache();
+        if (cache.flushed)
+            return AllocateShared(cls);
+
+        if (!cache.head[cls])
+            Refill(cache, cls);
+
+        FreeBlock *block = cache.head[cls];
+        cache.head[cls] = block->next;
+        cache.count[cls]--;
+        return block;
+    }
+
+    static void Deallocate(void *p, size_t bytes)
+    {
+        if (!p)
+            return;
+
+        int cls = GetSizeClass(bytes);
+        if (cls < 0)
+        {
+            ::operator delete(p);
+            return;
+        }
+
+        // After the thread cache has been flushed (thread exit), blocks go
+        // straight back to the shared list
+        ThreadCache &cache = GetThreadCache();
+        FreeBlock *block = static_cast<FreeBlock *>(p);
+        if (cache.flushed)
+        {
+            SharedPool &shared = GetSharedPool();
+            std::lock_guard<std::mutex> guard(shared.mutex);
+            PushShared(shared, cls, block);
+            TrimIfNeeded(shared);
+            return;
+        }
+
+        block->next = cache.head[cls];
+        cache.head[cls] = block;
+
+        // Keep the per-thread lists bounded
+        if (++cache.count[cls] > 4 * BatchSize)
+            Release(cache, cls, cache.count[cls] - BatchSize);
+    }
+
+    /** Return the slabs whose blocks are all in the shared lists to the
+    * system now, rather than waiting for them to add up to TrimSize. Blocks
+    * held in the caches of live threads keep their slabs in the pool. */
+    static void ReleaseUnusedSlabs()
+    {
+        SharedPool &shared = GetSharedPool();
+        std::lock_guard<std::mutex> guard(shared.mutex);
+        Trim(shared);
+    }
+
+    /** Number of slabs currently allocated by the pool */
+    static size_t GetNumberOfSlabs()
+    {
+        SharedPool &shared = GetSharedPool();
+        std::lock_guard<std::mutex> guard(shared.mutex);
+        return shared.slabs.size();
+    }
+
+private:
+    static const int NumberOfClasses = 9; // 16, 32, ..., 4096 bytes
+    static const size_t MinBlockSize = 16;
+    static const size_t SlabSize = 1 << 16;
+    static const size_t BatchSize = 64;
+    static const size_t TrimSize = 32 << 20;
+
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    // Trivially destructible, so that it remains usable from destructors
+    // of static objects that run after the thread cache has been flushed
+    struct ThreadCache
+    {
+        FreeBlock *head[NumberOfClasses];
+        size_t count[NumberOfClasses];
+        bool flushed;
+    };
+
+    struct Slab
+    {
+        char *begin;
+        int cls;
+
+        // Number of blocks of this slab that are in the shared lists
+        size_t n_free;
+
+        bool operator<(const Slab &other) const { return begin < other.begin; }
+    };
+
+    struct SharedPool
+    {
+        std::mutex mutex;
+        FreeBlock *head[NumberOfClasses];
+
+        // All slabs, sorted by address
+        std::vector<Slab> slabs;
+
+        // Bytes in the shared lists, and bytes of the slabs that are all free
+        size_t free_bytes, unused_bytes;
+    };
+
+    // Returns the cached blocks of an exiting thread to the shared pool
+    struct ThreadCacheFlusher
+    {
+        ThreadCache *cache;
+        ~ThreadCacheFlusher()
+        {
+            for (int cls = 0; cls < NumberOfClasses; cls++)
+                Release(*cache, cls, cache->count[cls]);
+            cache->flushed = true;
+        }
+    };
+
+    static int GetSizeClass(size_t bytes)
+    {
+        if (bytes > MaxPooledSize)
+            return -1;
+        int cls = 0;
+        for (size_t sz = MinBlockSize; sz < bytes; sz <<= 1)
+            cls++;
+        return cls;
+    }
+
+    static size_t GetBlocksPerSlab(int cls)
+    {
+        return SlabSize / (MinBlockSize << cls);
+    }
+
+    static SharedPool &GetSharedPool()
+    {
+        // Never destroyed: blocks may be released during static destruction
+        static SharedPool *pool = CreateSharedPool();
+        return *pool;
+    }
+
+    static SharedPool *CreateSharedPool()
+    {
+        SharedPool *pool = new SharedPool;
+        for (int cls = 0; cls < NumberOfClasses; cls++)
+            pool->head[cls] = NULL;
+        pool->free_bytes = 0;
+        pool->unused_bytes = 0;
+        return pool;
+    }
+
+    static ThreadCache &GetThreadCache()
+    {
+        static thread_local ThreadCache cache = ThreadCache();
+        static thread_local ThreadCacheFlusher flusher = { &cache };
+        (void) flusher;
+        return cache;
+    }
+
+    // Move up to n blocks from the thread cache to the shared pool
+    static void Release(ThreadCache &cache, int cls, size_t n)
+    {
+        if (n == 0 || !cache.head[cls])
+            return;
+
+        SharedPool &shared = GetSharedPool();
+        std::lock_guard<std::mutex> guard(shared.mutex);
+        for (size_t i = 0; i < n && cache.head[cls]; i++)
+        {
+            FreeBlock *block = cache.head[cls];
+            cache.head[cls] = block->next;
+            cache.count[cls]--;
+            PushShared(shared, cls, block);
+        }
+        TrimIfNeeded(shared);
+    }
+
+    // Get a batch of blocks from the shared pool, or carve a new slab
+    static void Refill(ThreadCache &cache, int cls)
+    {
+        SharedPool &shared = GetSharedPool();
+        std::lock_guard<std::mutex> guard(shared.mutex);
+
+        if (shared.head[cls])
+        {
+            for (size_t i = 0; i < BatchSize && shared.head[cls]; i++)
+            {
+                FreeBlock *block = PopShared(shared, cls);
+                block->next = cache.head[cls];
+                cache.head[cls] = block;
+                cache.count[cls]++;
+            }
+            return;
+        }
+
+        cache.count[cls] += CarveSlab(shared, cls, cache.head[cls]);
+    }
+
+    // Allocate a single block from the shared pool
+    static void *AllocateShared(int cls)
+    {
+        SharedPool &shared = GetSharedPool();
+        std::lock_guard<std::mutex> guard(shared.mutex);
+        if (!shared.head[cls])
+        {
+            FreeBlock *carved = NULL;
+            CarveSlab(shared, cls, carved);
+            while (carved)
+            {
+                FreeBlock *block = carved;
+                carved = carved->next;
+                PushShared(shared, cls, block);
+            }
+        }
+        return PopShared(shared, cls);
+    }
+
+    // Allocate a new slab and push its blocks onto a free list. The slab is
+    // carved back to front, so that blocks are handed out in increasing
+    // address order. Must be called with the shared pool locked
+    static size_t CarveSlab(SharedPool &shared, int cls, FreeBlock *&head)
+    {
+        size_t block_size = MinBlockSize << cls;
+        Slab slab = { static_cast<char *>(::operator new(SlabSize)), cls, 0 };
+        shared.slabs.insert(
+            std::upper_bound(shared.slabs.begin(), shared.slabs.end(), slab), slab);
+
+        for (size_t offset = SlabSize; offset >= block_size; offset -= block_size)
+        {
+            FreeBlock *block = reinterpret_cast<FreeBlock *>(slab.begin + offset - block_size);
+            block->next = head;
+            head = block;
+        }
+        return GetBlocksPerSlab(cls);
+    }
+
+    // The slab that contains a block
+    static Slab &FindSlab(SharedPool &shared, FreeBlock *block)
+    {
+        Slab key = { reinterpret_cast<char *>(block), 0, 0 };
+        return *(std::upper_bound(shared.slabs.begin(), shared.slabs.end(), key) - 1);
+    }
+
+    // Put a block on the shared list, and count it against its slab. Must be
+    // called with the shared pool locked
+    static void PushShared(SharedPool &shared, int cls, FreeBlock *block)
+    {
+        block->next = shared.head[cls];
+        shared.head[cls] = block;
+        shared.free_bytes += MinBlockSize << cls;
+        if (++FindSlab(shared, block).n_free == GetBlocksPerSlab(cls))
+            shared.unused_bytes += SlabSize;
+    }
+
+    // Take a block off the shared list. Must be called with the shared pool
+    // locked
+    static FreeBlock *PopShared(SharedPool &shared, int cls)
+    {
+        FreeBlock *block = shared.head[cls];
+        shared.head[cls] = block->next;
+        shared.free_bytes -= MinBlockSize << cls;
+        if (FindSlab(shared, block).n_free-- == GetBlocksPerSlab(cls))
+            shared.unused_bytes -= SlabSize;
+        return block;
+    }
+
+    // Trimming walks all of the shared lists, so it is only done once the
+    // unused slabs are worth it. Must be called with the shared pool locked
+    static void TrimIfNeeded(SharedPool &shared)
+    {
+        if (shared.unused_bytes >= TrimSize && 2 * shared.unused_bytes >= shared.free_bytes)
+            Trim(shared);
+    }
+
+    // Return the slabs whose blocks are all in the shared lists to the system.
+    // Must be called with the shared pool locked
+    static void Trim(SharedPool &shared)
+    {
+        // Unlink the blocks of the unused slabs
+        for (int cls = 0; cls < NumberOfClasses; cls++)
+        {
+            FreeBlock **link = &shared.head[cls];
+            while (*link)
+            {
+                if (FindSlab(shared, *link).n_free == GetBlocksPerSlab(cls))
+                    *link = (*link)->next;
+                else
+                    link = &(*link)->next;
+            }
+        }
+
+        // Free the unused slabs
+        size_t kept = 0;
+        for (size_t i = 0; i < shared.slabs.size(); i++)
+        {
+            if (shared.slabs[i].n_free == GetBlocksPerSlab(shared.slabs[i].cls))
+                ::operator delete(shared.slabs[i].begin);
+            else
+                shared.slabs[kept++] = shared.slabs[i];
+        }
+        shared.slabs.resize(kept);
+        shared.free_bytes -= shared.unused_bytes;
+        shared.unused_bytes = 0;
+    }
+};
+
+/** Standard allocator that draws memory from RLESegmentPool. */
+template< typename T >
+class RLEPoolAllocator
+{
+public:
+    typedef T value_type;
+
+    template< typename U >
+    struct rebind
+    {
+        typedef RLEPoolAllocator<U> other;
+    };
+
+    RLEPoolAllocator() {}
+
+    template< typename U >
+    RLEPoolAllocator(const RLEPoolAllocator<U> &) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(RLESegmentPool::Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        RLESegmentPool::Deallocate(p, n * sizeof(T));
+    }
+};
+
+template< typename T, typename U >
+inline bool operator==(const RLEPoolAllocator<T> &, const RLEPoolAllocator<U> &)
+{
+    return true;
+}
+
+template< typename T, typename U >
+inline bool operator!=(const RLEPoolAllocator<T> &, const RLEPoolAllocator<U> &)
+{
+    return false;
+}
+
+#endif //RLESegmentPool_h
@@ -49,6 +49,7 @@
 #include "IRISSlicer.h"
 #include "NonOrthogonalSlicer.h"
 #include "SNAPCommon.h"
+#include <list>
 
 class ImageCoordinateTransform;
 
@@ -62,6 +63,38 @@ template<typename TParametersValueType,
 }
 
 
+/**
+ * Non-templated interface to the slicing pipeline. It allows downstream
+ * code (e.g., DisplaySliceCacheFilter) to tell changes to the slice index
+ * apart from changes to the data being sliced.
+ */
+class SlicingPipelineBase
+{
+public:
+  virtual ~SlicingPipelineBase() {}
+
+  /** Whether the output is an orthogonal slice, i.e., identified by an index */
+  virtual bool IsOrthogonalSlice() const = 0;
+
+  /** The image axis along which the orthogonal slice is taken */
+  virtual unsigned int GetSliceAxis() const = 0;
+
+  /** The position of the orthogonal slice along the slice axis */
+  virtual long GetSlicePosition() const = 0;
+
+  /** Like GetMTime(), but not affected by changes to the slice index */
+  virtual itk::ModifiedTimeType GetContentMTime() const = 0;
+
+  /**
+   * Compute the orthogonal slice at another position along the slice axis
+   * ahead of time, without changing the state of the pipeline. When the
+   * slice index later moves to that position, the slice is used instead of
+   * being computed. Returns false if the slice was already computed or the
+   * pipeline is not slicing orthogonally.
+   */
+  virtual bool PrefetchSlice(long position) = 0;
+};
+
 /**
  * This filter encapsulates the ITK-SNAP slicing pipeline. It includes both
  * the straight (orthogonal) slicer and the oblique slicer. The input to this
@@ -69,7 +102,8 @@ template<typename TParametersValueType,
  */
 template <typename TInputImage, typename TOutputImage, typename TPreviewImage>
 class AdaptiveSlicingPipeline
-    : public itk::ImageToImageFilter<TInputImage, TOutputImage>
+    : public itk::ImageToImageFilter<TInputImage, TOutputImage>,
+      public SlicingPipelineBase
 {
 public:
   /** Standard class typedefs. */
@@ -145,7 +179,30 @@ public:
 
   /** Set the slice index for the orthogonal slicer */
   itkGetMacro(SliceIndex, IndexType)
-  itkSetMacro(SliceIndex, IndexType)
+  void SetSliceIndex(IndexType index);
+
+  /** Slicing pipeline interface */
+  virtual bool IsOrthogonalSlice() const ITK_OVERRIDE
+    { return m_UseOrthogonalSlicing; }
+
+  virtual unsigned int GetSliceAxis() const ITK_OVERRIDE
+    { return m_OrthogonalSlicer->GetSliceDirectionImageAxis(); }
+
+  virtual long GetSlicePosition() const ITK_OVERRIDE
+    { return m_SliceIndex[this->GetSliceAxis()]; }
+
+  virtual itk::ModifiedTimeType GetContentMTime() const ITK_OVERRIDE
+    { return m_ContentMTime.GetMTime(); }
+
+  /** Modified() also updates the content time, except from SetSliceIndex() */
+  virtual void Modified() const ITK_OVERRIDE;
+
+  /** Compute a slice ahead of time with a separate slicer */
+  virtual bool PrefetchSlice(long position) ITK_OVERRIDE;
+
+  /** Maximum number of prefetched slices kept (default 8) */
+  itkSetMacro(MaximumPrefetchedSlices, unsigned int)
+  itkGetMacro(MaximumPrefetchedSlices, unsigned int)
 
   /** Interpolation type */
   void SetUseNearestNeighbor(bool flag);
@@ -175,7 +232,33 @@ protected:
 
   IndexType m_SliceIndex;
 
+  // Time of the last modification other than a change of slice index
+  mutable itk::TimeStamp m_ContentMTime;
+  bool m_ChangingSliceIndex;
+
+  // Slicer used for prefetching, so that the slicer that feeds the output
+  // is never moved away from the current slice
+  itk::SmartPointer<OrthogonalSlicerType> m_PrefetchSlicer;
+
+  // Prefetched slices, most recent first. The stamp is the content time of
+  // the pipeline and its inputs when the slice was computed
+  struct PrefetchedSlice
+  {
+    long Position;
+    itk::ModifiedTimeType Stamp;
+    OutputImagePointer Image;
+  };
+  std::list<PrefetchedSlice> m_PrefetchedSlices;
+  unsigned int m_MaximumPrefetchedSlices;
+
   void MapInputsToSlicers();  
+
+  // Point an orthogonal slicer to the inputs and slicing directions
+  void ConfigureOrthogonalSlicer(OrthogonalSlicerType *slicer, long position);
+
+  // Content time of the pipeline and its inputs, and removal of prefetched
+  // slices that are older than it
+  itk::ModifiedTimeType ComputeContentStamp();
 };
 
 
@@ -45,6 +45,7 @@
 
 #include "AdaptiveSlicingPipeline.h"
 #include "IRISVectorTypesToITKConversion.h"
+#include <algorithm>
 
 template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
 AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
@@ -53,9 +54,39 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
   // Create the two slicer types
   m_OrthogonalSlicer = OrthogonalSlicerType::New();
   m_ObliqueSlicer = NonOrthogonalSlicerType::New();
+  m_PrefetchSlicer = OrthogonalSlicerType::New();
+  m_MaximumPrefetchedSlices = 8;
 
   // Initially use the ortho
   m_UseOrthogonalSlicing = true;
+
+  m_ChangingSliceIndex = false;
+  m_SliceIndex.Fill(0);
+  m_ContentMTime.Modified();
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::SetSliceIndex(IndexType index)
+{
+  if(index != m_SliceIndex)
+    {
+    m_SliceIndex = index;
+    m_ChangingSliceIndex = true;
+    this->Modified();
+    m_ChangingSliceIndex = false;
+    }
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::Modified() const
+{
+  Superclass::Modified();
+  if(!m_ChangingSliceIndex)
+    m_ContentMTime.Modified();
 }
 
 template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
@@ -74,40 +105,109 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
 {
   if(m_UseOrthogonalSlicing)
     {
-    m_OrthogonalSlicer->SetInput(this->GetInput());
-    m_OrthogonalSlicer->SetPreviewInput(
-          const_cast<PreviewImageType *>(this->GetPreviewImage()));
+    this->ConfigureOrthogonalSlicer(m_OrthogonalSlicer, -1);
+    }
+  else
+    {
+    m_ObliqueSlicer->SetInput(this->GetInput());
+    m_ObliqueSlicer->SetTransform(this->GetObliqueTransform());
+    m_ObliqueSlicer->SetReferenceImage(this->GetObliqueReferenceImage());
+    }
+}
 
-    // Inverse transform
-    ImageCoordinateTransform::Pointer tinv = ImageCoordinateTransform::New();
-    this->GetOrthogonalTransform()->ComputeInverse(tinv);
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::ConfigureOrthogonalSlicer(OrthogonalSlicerType *slicer, long position)
+{
+  slicer->SetInput(this->GetInput());
+  slicer->SetPreviewInput(
+        const_cast<PreviewImageType *>(this->GetPreviewImage()));
 
-    // Tell slicer in which directions to slice
-    m_OrthogonalSlicer->SetSliceDirectionImageAxis(
-          tinv->GetCoordinateIndexZeroBased(2));
+  // Inverse transform
+  ImageCoordinateTransform::Pointer tinv = ImageCoordinateTransform::New();
+  this->GetOrthogonalTransform()->ComputeInverse(tinv);
 
-    m_OrthogonalSlicer->SetLineDirectionImageAxis(
-          tinv->GetCoordinateIndexZeroBased(1));
+  // Tell slicer in which directions to slice
+  slicer->SetSliceDirectionImageAxis(
+        tinv->GetCoordinateIndexZeroBased(2));
 
-    m_OrthogonalSlicer->SetPixelDirectionImageAxis(
-          tinv->GetCoordinateIndexZeroBased(0));
+  slicer->SetLineDirectionImageAxis(
+        tinv->GetCoordinateIndexZeroBased(1));
 
-    m_OrthogonalSlicer->SetPixelTraverseForward(
-          tinv->GetCoordinateOrientation(0) > 0);
+  slicer->SetPixelDirectionImageAxis(
+        tinv->GetCoordinateIndexZeroBased(0));
 
-    m_OrthogonalSlicer->SetLineTraverseForward(
-          tinv->GetCoordinateOrientation(1) > 0);
+  slicer->SetPixelTraverseForward(
+        tinv->GetCoordinateOrientation(0) > 0);
 
-    // Set the slice index
-    m_OrthogonalSlicer->SetSliceIndex(
-          m_SliceIndex[m_OrthogonalSlicer->GetSliceDirectionImageAxis()]);
-    }
-  else
+  slicer->SetLineTraverseForward(
+        tinv->GetCoordinateOrientation(1) > 0);
+
+  // Set the slice index, by default the current one
+  if(position < 0)
+    position = m_SliceIndex[slicer->GetSliceDirectionImageAxis()];
+  slicer->SetSliceIndex(position);
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+itk::ModifiedTimeType
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::ComputeContentStamp()
+{
+  // Painting and other in-place changes modify the input images, not this
+  // filter, so their times are included
+  itk::ModifiedTimeType stamp = m_ContentMTime.GetMTime();
+  typename Superclass::DataObjectPointerArray inputs = this->GetInputs();
+  for(unsigned int i = 0; i < inputs.size(); i++)
+    if(inputs[i])
+      stamp = std::max(stamp, inputs[i]->GetMTime());
+
+  for(auto it = m_PrefetchedSlices.begin(); it != m_PrefetchedSlices.end(); )
     {
-    m_ObliqueSlicer->SetInput(this->GetInput());
-    m_ObliqueSlicer->SetTransform(this->GetObliqueTransform());
-    m_ObliqueSlicer->SetReferenceImage(this->GetObliqueReferenceImage());
+    if(it->Stamp != stamp)
+      it = m_PrefetchedSlices.erase(it);
+    else ++it;
     }
+
+  return stamp;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+bool
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::PrefetchSlice(long position)
+{
+  if(!m_UseOrthogonalSlicing || !this->GetInput() || !this->GetOrthogonalTransform())
+    return false;
+
+  // Nothing to do for the current slice or a slice that is already there
+  this->ConfigureOrthogonalSlicer(m_PrefetchSlicer, position);
+  if(position == m_SliceIndex[m_PrefetchSlicer->GetSliceDirectionImageAxis()])
+    return false;
+
+  itk::ModifiedTimeType stamp = this->ComputeContentStamp();
+  for(auto it = m_PrefetchedSlices.begin(); it != m_PrefetchedSlices.end(); ++it)
+    if(it->Position == position)
+      return false;
+
+  // Compute the slice with the prefetch slicer. This brings the inputs up to
+  // date, so the stamp is computed again afterwards
+  m_PrefetchSlicer->UpdateLargestPossibleRegion();
+  stamp = this->ComputeContentStamp();
+
+  // Take the output away from the slicer, which makes a new one next time
+  PrefetchedSlice ps;
+  ps.Position = position;
+  ps.Stamp = stamp;
+  ps.Image = m_PrefetchSlicer->GetOutput();
+  ps.Image->DisconnectPipeline();
+
+  m_PrefetchedSlices.push_front(ps);
+  while(m_PrefetchedSlices.size() > m_MaximumPrefetchedSlices)
+    m_PrefetchedSlices.pop_back();
+
+  return true;
 }
 
 template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
@@ -177,6 +277,18 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
   // Use appropriate sub-pipeline
   if(m_UseOrthogonalSlicing)
     {
+    // Use a prefetched slice if there is one
+    long position = m_SliceIndex[m_OrthogonalSlicer->GetSliceDirectionImageAxis()];
+    itk::ModifiedTimeType stamp = this->ComputeContentStamp();
+    for(auto it = m_PrefetchedSlices.begin(); it != m_PrefetchedSlices.end(); ++it)
+      {
+      if(it->Position == position && it->Stamp == stamp)
+        {
+        output->Graft(it->Image);
+        return;
+        }
+      }
+
     m_OrthogonalSlicer->Update();
     output->Graft(m_OrthogonalSlicer->GetOutput());
     }
@@ -0,0 +1,231 @@
+#include "DisplaySliceCacheFilter.h"
+#include "AdaptiveSlicingPipeline.h"
+#include <algorithm>
+#include <cstring>
+
+DisplaySliceCacheFilter::DisplaySliceCacheFilter()
+{
+  m_CacheSize = 0;
+  m_MaximumCacheSize = 32 * 1024 * 1024;
+  m_KeyValid = false;
+  m_KeySlice = 0;
+  m_KeyStamp = 0;
+}
+
+void
+DisplaySliceCacheFilter::ClearCache()
+{
+  m_Entries.clear();
+  m_CacheSize = 0;
+}
+
+bool
+DisplaySliceCacheFilter
+::ComputeUpstreamStamp(
+    itk::DataObject *data, itk::ModifiedTimeType &stamp,
+    std::vector<SlicingPipelineBase *> &slicers)
+{
+  // Does this data object depend on the slice index of a slicer?
+  bool sliced = false;
+
+  itk::ProcessObject *source = data->GetSource();
+  if(source)
+    {
+    SlicingPipelineBase *slicer = dynamic_cast<SlicingPipelineBase *>(source);
+    if(slicer)
+      {
+      slicers.push_back(slicer);
+      stamp = std::max(stamp, slicer->GetContentMTime());
+      sliced = true;
+      }
+    else
+      {
+      stamp = std::max(stamp, source->GetMTime());
+      }
+
+    itk::ProcessObject::DataObjectPointerArray inputs = source->GetInputs();
+    for(unsigned int i = 0; i < inputs.size(); i++)
+      if(inputs[i])
+        sliced |= ComputeUpstreamStamp(inputs[i], stamp, slicers);
+    }
+
+  // Data produced from a slice is regenerated (and modified) for every
+  // slice, so its own MTime says nothing about its content
+  if(!sliced)
+    stamp = std::max(stamp, data->GetMTime());
+
+  return sliced;
+}
+
+bool
+DisplaySliceCacheFilter
+::ComputeCacheKey(long &slice, itk::ModifiedTimeType &stamp)
+{
+  ImageType *input = const_cast<ImageType *>(this->GetInput());
+  if(!input)
+    return false;
+
+  stamp = this->GetMTime();
+  std::vector<SlicingPipelineBase *> slicers;
+  ComputeUpstreamStamp(input, stamp, slicers);
+
+  // Drop the entries that no longer reflect the upstream data
+  for(EntryList::iterator it = m_Entries.begin(); it != m_Entries.end(); )
+    {
+    if(it->Stamp != stamp)
+      {
+      m_CacheSize -= it->Pixels->Size() * sizeof(ImageType::PixelType);
+      it = m_Entries.erase(it);
+      }
+    else ++it;
+    }
+
+  // The slice must come from orthogonal slicers that agree on the position
+  if(slicers.empty())
+    return false;
+
+  for(unsigned int i = 0; i < slicers.size(); i++)
+    {
+    if(!slicers[i]->IsOrthogonalSlice()
+       || slicers[i]->GetSliceAxis() != slicers[0]->GetSliceAxis()
+       || slicers[i]->GetSlicePosition() != slicers[0]->GetSlicePosition())
+      return false;
+    }
+
+  slice = slicers[0]->GetSlicePosition();
+  return true;
+}
+
+DisplaySliceCacheFilter::EntryList::iterator
+DisplaySliceCacheFilter
+::FindEntry(long slice, itk::ModifiedTimeType stamp)
+{
+  for(EntryList::iterator it = m_Entries.begin(); it != m_Entries.end(); ++it)
+    if(it->Slice == slice && it->Stamp == stamp)
+      return it;
+  return m_Entries.end();
+}
+
+DisplaySliceCacheFilter::EntryList::iterator
+DisplaySliceCacheFilter
+::StoreEntry(const ImageType *image, long slice, itk::ModifiedTimeType stamp)
+{
+  Entry entry;
+  entry.Slice = slice;
+  entry.Stamp = stamp;
+  entry.Region = image->GetBufferedRegion();
+
+  size_t n = entry.Region.GetNumberOfPixels();
+  entry.Pixels = PixelContainer::New();
+  entry.Pixels->Reserve(n);
+  if(n)
+    std::memcpy(entry.Pixels->GetBufferPointer(), image->GetBufferPointer(),
+                n * sizeof(ImageType::PixelType));
+
+  m_Entries.push_front(entry);
+  m_CacheSize += n * sizeof(ImageType::PixelType);
+
+  // Evict least recently used slices, but always keep the new one
+  while(m_CacheSize > m_MaximumCacheSize && m_Entries.size() > 1)
+    {
+    m_CacheSize -= m_Entries.back().Pixels->Size() * sizeof(ImageType::PixelType);
+    m_Entries.pop_back();
+    }
+
+  return m_Entries.begin();
+}
+
+void
+DisplaySliceCacheFilter
+::UpdateOutputData(itk::DataObject *output)
+{
+  m_KeyValid = this->ComputeCacheKey(m_KeySlice, m_KeyStamp);
+  if(m_KeyValid)
+    {
+    EntryList::iterator it = this->FindEntry(m_KeySlice, m_KeyStamp);
+    if(it != m_Entries.end())
+      {
+      // Move the entry to the front of the list
+      m_Entries.splice(m_Entries.begin(), m_Entries, it);
+
+      // Share the cached pixels with the output; nothing downstream writes
+      // into the display slice
+      ImageType *out = this->GetOutput();
+      out->SetBufferedRegion(m_Entries.front().Region);
+      out->SetPixelContainer(m_Entries.front().Pixels);
+      out->DataHasBeenGenerated();
+      return;
+      }
+    }
+
+  // Not cached: run the upstream pipeline and GenerateData()
+  Superclass::UpdateOutputData(output);
+}
+
+void
+DisplaySliceCacheFilter
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+  ImageType *input = const_cast<ImageType *>(this->GetInput());
+  if(input)
+    input->SetRequestedRegionToLargestPossibleRegion();
+}
+
+void
+DisplaySliceCacheFilter
+::EnlargeOutputRequestedRegion(itk::DataObject *output)
+{
+  Superclass::EnlargeOutputRequestedRegion(output);
+  output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+void
+DisplaySliceCacheFilter
+::GenerateData()
+{
+  const ImageType *input = this->GetInput();
+  ImageType *out = this->GetOutput();
+
+  // The output may be sharing its buffer with a cache entry, so it always
+  // gets a new pixel container rather than being reallocated in place
+  SmartPtr<PixelContainer> pixels;
+  if(m_KeyValid)
+    {
+    pixels = this->StoreEntry(input, m_KeySlice, m_KeyStamp)->Pixels;
+    }
+  else
+    {
+    size_t n = input->GetBufferedRegion().GetNumberOfPixels();
+    pixels = PixelContainer::New();
+    pixels->Reserve(n);
+    if(n)
+      std::memcpy(pixels->GetBufferPointer(), input->GetBufferPointer(),
+                  n * sizeof(ImageType::PixelType));
+    }
+
+  out->SetBufferedRegion(input->GetBufferedRegion());
+  out->SetPixelContainer(pixels);
+}
+
+bool
+DisplaySliceCacheFilter
+::Prefetch(long position)
+{
+  ImageType *input = const_cast<ImageType *>(this->GetInput());
+  if(!input)
+    return false;
+
+  // Bring the upstream information (including the slicer axes) up to date
+  input->UpdateOutputInformation();
+
+  itk::ModifiedTimeType stamp = 0;
+  std::vector<SlicingPipelineBase *> slicers;
+  ComputeUpstreamStamp(input, stamp, slicers);
+
+  bool computed = false;
+  for(unsigned int i = 0; i < slicers.size(); i++)
+    computed |= slicers[i]->PrefetchSlice(position);
+
+  return computed;
+}
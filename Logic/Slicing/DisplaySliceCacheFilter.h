@@ -0,0 +1,117 @@
+#ifndef DISPLAYSLICECACHEFILTER_H
+#define DISPLAYSLICECACHEFILTER_H
+
+#include "SNAPCommon.h"
+#include <itkImageToImageFilter.h>
+#include <itkRGBAPixel.h>
+#include <list>
+#include <vector>
+
+class SlicingPipelineBase;
+
+/**
+  This filter sits at the end of the display slice pipeline of an image
+  wrapper and keeps a least-recently-used cache of the RGBA slices it has
+  produced, keyed by the position of the orthogonal slice. When the slice
+  index changes to a slice that is already in the cache, the upstream
+  slicing and intensity mapping pipeline is not executed at all.
+
+  The cache is invalidated when anything upstream changes other than the
+  slice index (the image, the display mapping, the transforms, etc.). This
+  is detected by walking the upstream pipeline and using the content time
+  of the slicing pipeline (see SlicingPipelineBase) in place of its MTime.
+
+  Slices that are not orthogonal, or that are produced from several slicers
+  that disagree on the slice position, are passed through without caching.
+
+  Slices ahead of the user's scrolling are prefetched by the slicers
+  themselves (see SlicingPipelineBase::PrefetchSlice), which compute them
+  with their own slicers and leave the displayed pipeline untouched.
+  */
+class DisplaySliceCacheFilter :
+    public itk::ImageToImageFilter<
+      itk::Image<itk::RGBAPixel<unsigned char>, 2>,
+      itk::Image<itk::RGBAPixel<unsigned char>, 2> >
+{
+public:
+
+  typedef itk::Image<itk::RGBAPixel<unsigned char>, 2>              ImageType;
+  typedef itk::ImageToImageFilter<ImageType, ImageType>            Superclass;
+
+  irisITKObjectMacro(DisplaySliceCacheFilter, Superclass)
+
+  typedef ImageType::PixelContainer                           PixelContainer;
+  typedef ImageType::RegionType                                   RegionType;
+
+  /** Maximum number of bytes held by the cached slices (default 32MB) */
+  itkSetMacro(MaximumCacheSize, size_t)
+  itkGetConstMacro(MaximumCacheSize, size_t)
+
+  /** Number of bytes currently held by the cached slices */
+  itkGetConstMacro(CacheSize, size_t)
+
+  /**
+    Have all the slicers upstream of this filter (e.g., one per component of
+    a multi-channel image) compute the slice at the given position along the
+    slice axis ahead of time. The state of the pipeline does not change. This
+    is used to prepare slices ahead of the user's scrolling. Returns false if
+    there was nothing to compute.
+    */
+  bool Prefetch(long position);
+
+  /** Drop all cached slices */
+  void ClearCache();
+
+protected:
+
+  DisplaySliceCacheFilter();
+  virtual ~DisplaySliceCacheFilter() {}
+
+  /** Serve the output from the cache, if possible, before running upstream */
+  virtual void UpdateOutputData(itk::DataObject *output) ITK_OVERRIDE;
+
+  virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  virtual void EnlargeOutputRequestedRegion(itk::DataObject *output) ITK_OVERRIDE;
+
+  virtual void GenerateData() ITK_OVERRIDE;
+
+  struct Entry
+  {
+    long Slice;
+    itk::ModifiedTimeType Stamp;
+    RegionType Region;
+    SmartPtr<PixelContainer> Pixels;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  // Cached slices, most recently used first
+  EntryList m_Entries;
+  size_t m_CacheSize, m_MaximumCacheSize;
+
+  // Key of the slice currently being generated
+  bool m_KeyValid;
+  long m_KeySlice;
+  itk::ModifiedTimeType m_KeyStamp;
+
+  /**
+    Compute the cache key for the current state of the upstream pipeline.
+    Returns false if the current slice cannot be cached. Entries made stale
+    by upstream changes are removed.
+    */
+  bool ComputeCacheKey(long &slice, itk::ModifiedTimeType &stamp);
+
+  /** Walk the pipeline upstream of a data object, see ComputeCacheKey */
+  static bool ComputeUpstreamStamp(
+      itk::DataObject *data, itk::ModifiedTimeType &stamp,
+      std::vector<SlicingPipelineBase *> &slicers);
+
+  /** Find a cache entry */
+  EntryList::iterator FindEntry(long slice, itk::ModifiedTimeType stamp);
+
+  /** Copy the pixels of an image into a new cache entry */
+  EntryList::iterator StoreEntry(const ImageType *image, long slice, itk::ModifiedTimeType stamp);
+};
+
+#endif // DISPLAYSLICECACHEFILTER_H
@@ -29,6 +29,14 @@
 
 #include "itkVectorImage.h"
 #include "itkNumericTraits.h"
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 template <class TFloat, class TInputComponentType>
 struct FastLinearInterpolatorOutputTraits
@@ -68,6 +76,163 @@ struct FastWarpCompositeImageFilterInputImageTraits< itk::VectorImage<TPixel, VD
 };
 
 
+/**
+ * Helper for FastLinearInterpolator::InterpolateRow(). It processes a block of
+ * consecutive samples along a row: ComputeBlock() finds the linear index of
+ * the lower corner voxel and the fractional offsets of each sample and checks
+ * whether the whole block lies inside the image; Blend() performs trilinear
+ * interpolation given the eight corner values of each sample. Corner values
+ * are indexed as c[x + 2y + 4z].
+ *
+ * The generic version is scalar. The double precision version uses AVX or
+ * SSE2, whichever the compiler targets.
+ */
+template <class TFloat>
+struct FastLinearInterpolatorRowKernel
+{
+  enum { BlockSize = 4 };
+
+  static bool ComputeBlock(const TFloat *pos, const TFloat *step,
+                           const TFloat *vmax, const TFloat *stride,
+                           TFloat *voxel, TFloat f[3][BlockSize])
+  {
+    bool inside = true;
+    for(int k = 0; k < BlockSize; k++)
+      {
+      voxel[k] = 0;
+      for(int d = 0; d < 3; d++)
+        {
+        TFloat p = pos[d] + k * step[d], p0 = floor(p);
+        f[d][k] = p - p0;
+        inside = inside && p0 >= 0 && p0 <= vmax[d];
+        voxel[k] += p0 * stride[d];
+        }
+      }
+    return inside;
+  }
+
+  static void Blend(const TFloat c[8][BlockSize], const TFloat f[3][BlockSize], TFloat *out)
+  {
+    for(int k = 0; k < BlockSize; k++)
+      {
+      TFloat dx00 = c[0][k] + (c[1][k] - c[0][k]) * f[0][k];
+      TFloat dx10 = c[2][k] + (c[3][k] - c[2][k]) * f[0][k];
+      TFloat dx01 = c[4][k] + (c[5][k] - c[4][k]) * f[0][k];
+      TFloat dx11 = c[6][k] + (c[7][k] - c[6][k]) * f[0][k];
+      TFloat dxy0 = dx00 + (dx10 - dx00) * f[1][k];
+      TFloat dxy1 = dx01 + (dx11 - dx01) * f[1][k];
+      out[k] = dxy0 + (dxy1 - dxy0) * f[2][k];
+      }
+  }
+};
+
+#if defined(__AVX__)
+
+template <>
+struct FastLinearInterpolatorRowKernel<double>
+{
+  enum { BlockSize = 4 };
+
+  static inline __m256d lerp(__m256d a, __m256d l, __m256d h)
+  {
+    return _mm256_add_pd(l, _mm256_mul_pd(_mm256_sub_pd(h, l), a));
+  }
+
+  static bool ComputeBlock(const double *pos, const double *step,
+                           const double *vmax, const double *stride,
+                           double *voxel, double f[3][BlockSize])
+  {
+    const __m256d k = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+    const __m256d zero = _mm256_setzero_pd();
+    __m256d vox = zero;
+    __m256d inside = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+    for(int d = 0; d < 3; d++)
+      {
+      __m256d p = _mm256_add_pd(_mm256_set1_pd(pos[d]), _mm256_mul_pd(k, _mm256_set1_pd(step[d])));
+      __m256d p0 = _mm256_floor_pd(p);
+      _mm256_storeu_pd(f[d], _mm256_sub_pd(p, p0));
+      inside = _mm256_and_pd(inside, _mm256_cmp_pd(p0, zero, _CMP_GE_OQ));
+      inside = _mm256_and_pd(inside, _mm256_cmp_pd(p0, _mm256_set1_pd(vmax[d]), _CMP_LE_OQ));
+      vox = _mm256_add_pd(vox, _mm256_mul_pd(p0, _mm256_set1_pd(stride[d])));
+      }
+    _mm256_storeu_pd(voxel, vox);
+    return _mm256_movemask_pd(inside) == 0xF;
+  }
+
+  static void Blend(const double c[8][BlockSize], const double f[3][BlockSize], double *out)
+  {
+    __m256d fx = _mm256_loadu_pd(f[0]), fy = _mm256_loadu_pd(f[1]), fz = _mm256_loadu_pd(f[2]);
+    __m256d dx00 = lerp(fx, _mm256_loadu_pd(c[0]), _mm256_loadu_pd(c[1]));
+    __m256d dx10 = lerp(fx, _mm256_loadu_pd(c[2]), _mm256_loadu_pd(c[3]));
+    __m256d dx01 = lerp(fx, _mm256_loadu_pd(c[4]), _mm256_loadu_pd(c[5]));
+    __m256d dx11 = lerp(fx, _mm256_loadu_pd(c[6]), _mm256_loadu_pd(c[7]));
+    _mm256_storeu_pd(out, lerp(fz, lerp(fy, dx00, dx10), lerp(fy, dx01, dx11)));
+  }
+};
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+template <>
+struct FastLinearInterpolatorRowKernel<double>
+{
+  enum { BlockSize = 4 };
+
+  static inline __m128d lerp(__m128d a, __m128d l, __m128d h)
+  {
+    return _mm_add_pd(l, _mm_mul_pd(_mm_sub_pd(h, l), a));
+  }
+
+  // SSE2 has no floor instruction; the block has already been clipped to the
+  // image, so the coordinates are well within the range of int
+  static inline __m128d floor_pd(__m128d p)
+  {
+    __m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(p));
+    return _mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, p), _mm_set1_pd(1.0)));
+  }
+
+  static bool ComputeBlock(const double *pos, const double *step,
+                           const double *vmax, const double *stride,
+                           double *voxel, double f[3][BlockSize])
+  {
+    const __m128d zero = _mm_setzero_pd();
+    int mask = 0x3;
+    for(int h = 0; h < BlockSize; h += 2)
+      {
+      const __m128d k = _mm_set_pd(h + 1.0, h + 0.0);
+      __m128d vox = zero;
+      __m128d inside = _mm_cmpeq_pd(zero, zero);
+      for(int d = 0; d < 3; d++)
+        {
+        __m128d p = _mm_add_pd(_mm_set1_pd(pos[d]), _mm_mul_pd(k, _mm_set1_pd(step[d])));
+        __m128d p0 = floor_pd(p);
+        _mm_storeu_pd(f[d] + h, _mm_sub_pd(p, p0));
+        inside = _mm_and_pd(inside, _mm_cmpge_pd(p0, zero));
+        inside = _mm_and_pd(inside, _mm_cmple_pd(p0, _mm_set1_pd(vmax[d])));
+        vox = _mm_add_pd(vox, _mm_mul_pd(p0, _mm_set1_pd(stride[d])));
+        }
+      _mm_storeu_pd(voxel + h, vox);
+      mask &= _mm_movemask_pd(inside);
+      }
+    return mask == 0x3;
+  }
+
+  static void Blend(const double c[8][BlockSize], const double f[3][BlockSize], double *out)
+  {
+    for(int h = 0; h < BlockSize; h += 2)
+      {
+      __m128d fx = _mm_loadu_pd(f[0] + h), fy = _mm_loadu_pd(f[1] + h), fz = _mm_loadu_pd(f[2] + h);
+      __m128d dx00 = lerp(fx, _mm_loadu_pd(c[0] + h), _mm_loadu_pd(c[1] + h));
+      __m128d dx10 = lerp(fx, _mm_loadu_pd(c[2] + h), _mm_loadu_pd(c[3] + h));
+      __m128d dx01 = lerp(fx, _mm_loadu_pd(c[4] + h), _mm_loadu_pd(c[5] + h));
+      __m128d dx11 = lerp(fx, _mm_loadu_pd(c[6] + h), _mm_loadu_pd(c[7] + h));
+      _mm_storeu_pd(out + h, lerp(fz, lerp(fy, dx00, dx10), lerp(fy, dx01, dx11)));
+      }
+  }
+};
+
+#endif
+
+
 /**
  * Base class for the fast linear interpolators
  */
@@ -188,6 +353,10 @@ public:
   InOut InterpolateNearestNeighbor(RealType *cix, OutputComponentType *out)
     { return Superclass::INSIDE; }
 
+  void InterpolateRow(const RealType *cix, const RealType *step, int n,
+                      OutputComponentType *out, InOut *status)
+    { for(int i = 0; i < n; i++) status[i] = Superclass::INSIDE; }
+
   TFloat GetMask() { return 0.0; }
 
   TFloat GetMaskAndGradient(RealType *mask_gradient) { return 0.0; }
@@ -384,6 +553,80 @@ public:
     return this->status;
   }
 
+  /**
+   * Interpolate n samples along a row, starting at cix and advancing by step
+   * from one sample to the next. The components of each sample are written
+   * consecutively to out (nSampled values per sample, left untouched for
+   * samples outside of the image) and the status of each sample to status.
+   *
+   * This gives the same result as calling Interpolate() for each sample,
+   * but blocks of samples that lie fully inside of the image are processed
+   * together using SIMD instructions where available.
+   */
+  void InterpolateRow(const RealType *cix, const RealType *step, int n,
+                      OutputComponentType *out, InOut *status)
+  {
+    typedef FastLinearInterpolatorRowKernel<RealType> Kernel;
+    const int B = Kernel::BlockSize;
+
+    // Lower corners beyond these bounds are not fully inside
+    RealType vmax[3] = { xsize - 2.0, ysize - 2.0, zsize - 2.0 };
+    RealType stride[3] = { 1.0, (RealType) xsize, (RealType) xsize * ysize };
+
+    // Offsets from the lower corner to the other corners
+    const ptrdiff_t ox = this->nComp, oy = ox * xsize, oz = oy * ysize;
+
+    RealType pos[3], voxel[B], f[3][B], c[8][B], v[B];
+    int i = 0;
+    for(; i + B <= n; i += B)
+      {
+      for(int d = 0; d < 3; d++)
+        pos[d] = cix[d] + i * step[d];
+
+      if(Kernel::ComputeBlock(pos, step, vmax, stride, voxel, f))
+        {
+        const InputComponentType *dp[B];
+        for(int k = 0; k < B; k++)
+          dp[k] = this->buffer + this->nComp * (ptrdiff_t) voxel[k];
+
+        for(int iComp = 0; iComp < this->nSampled; iComp++)
+          {
+          for(int k = 0; k < B; k++)
+            {
+            const InputComponentType *p = dp[k] + iComp;
+            c[0][k] = p[0];       c[1][k] = p[ox];
+            c[2][k] = p[oy];      c[3][k] = p[ox + oy];
+            c[4][k] = p[oz];      c[5][k] = p[ox + oz];
+            c[6][k] = p[oy + oz]; c[7][k] = p[ox + oy + oz];
+            }
+
+          Kernel::Blend(c, f, v);
+          for(int k = 0; k < B; k++)
+            out[k * this->nSampled + iComp] = static_cast<OutputComponentType>(v[k]);
+          }
+
+        for(int k = 0; k < B; k++)
+          status[i + k] = Superclass::INSIDE;
+        out += B * this->nSampled;
+        }
+      else
+        {
+        // Near the border, fall back to sample by sample interpolation
+        for(int k = 0; k < B; k++, out += this->nSampled)
+          {
+          RealType x[3] = { pos[0] + k * step[0], pos[1] + k * step[1], pos[2] + k * step[2] };
+          status[i + k] = this->Interpolate(x, out);
+          }
+        }
+      }
+
+    for(; i < n; i++, out += this->nSampled)
+      {
+      RealType x[3] = { cix[0] + i * step[0], cix[1] + i * step[1], cix[2] + i * step[2] };
+      status[i] = this->Interpolate(x, out);
+      }
+  }
+
   InOut InterpolateNearestNeighbor(RealType *cix, OutputComponentType *out)
   {
     x0 = (int) floor(cix[0] + 0.5);
@@ -726,6 +969,17 @@ public:
     return this->status;
   }
 
+  /** Interpolate n samples along a row, see the 3D version */
+  void InterpolateRow(const RealType *cix, const RealType *step, int n,
+                      OutputComponentType *out, InOut *status)
+  {
+    for(int i = 0; i < n; i++, out += this->nSampled)
+      {
+      RealType x[2] = { cix[0] + i * step[0], cix[1] + i * step[1] };
+      status[i] = this->Interpolate(x, out);
+      }
+  }
+
   InOut InterpolateNearestNeighbor(RealType *cix, OutputComponentType *out)
   {
     x0 = (int) floor(cix[0] + 0.5);
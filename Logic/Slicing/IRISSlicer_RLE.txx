@@ -38,6 +38,7 @@
 #include "itkImage.h"
 #include "itkVectorImage.h"
 #include "itkVectorImageToImageAdaptor.h"
+#include "itkMultiThreaderBase.h"
 
 //now goes version specialized for RLEImage
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
@@ -239,79 +240,78 @@ void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
   typename OutputImageType::PixelType *outSlice = &outputPtr->GetPixel(oStartInd);
 
+  // Check the axis configuration up front, the threaded loops below do not throw
+  if (m_LineDirectionImageAxis == m_SliceDirectionImageAxis
+      || m_PixelDirectionImageAxis == m_SliceDirectionImageAxis
+      || m_PixelDirectionImageAxis == m_LineDirectionImageAxis)
+    throw itk::ExceptionObject(__FILE__, __LINE__, "Slice, line and pixel image axes must be distinct!", __FUNCTION__);
+
+  //complete Run-Length Lines have to be buffered
+  itkAssertOrThrowMacro(inputPtr->GetBufferedRegion().GetSize(0)
+                        == inputPtr->GetLargestPossibleRegion().GetSize(0),
+                        "BufferedRegion must contain complete run-length lines!");
+
+  // Each RLE line that intersects the slice is decoded independently, so the
+  // lines are distributed across threads. The output pointer arithmetic for
+  // different lines never overlaps.
+  typedef typename InputImageType::BufferType BufferType;
+  const BufferType *buffer = inputPtr->GetBuffer();
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+
   if (m_SliceDirectionImageAxis == 2) //slicing along z
     {
-#pragma omp parallel for
-    for (int y = 0; y < szVol[1]; y++)
+    long stride_line = (m_LineDirectionImageAxis == 1) ? s_line * szVol[0] : s_pixel;
+    long stride_pixel = (m_LineDirectionImageAxis == 1) ? s_pixel : s_line * szVol[1];
+    long z = m_SliceIndex;
+    mt->ParallelizeArray(0, szVol[1], [&](itk::SizeValueType y)
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { y, (int) m_SliceIndex } };
-      const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-      if (m_LineDirectionImageAxis == 1) //y is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*y*szVol[0], s_pixel * 1);
-        }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*y, s_line*szVol[1]);
-        }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 2!", __FUNCTION__);
-      }
+      // y is either the line coordinate (x is pixel) or the pixel coordinate
+      typename BufferType::IndexType lineIndex = { { (long) y, z } };
+      uncompressLine(buffer->GetPixel(lineIndex), outSlice + stride_line * (long) y, stride_pixel);
+      }, nullptr);
     }
   else if (m_SliceDirectionImageAxis == 1) //slicing along y
     {
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
+    long stride_line = (m_LineDirectionImageAxis == 2) ? s_line * szVol[0] : s_pixel;
+    long stride_pixel = (m_LineDirectionImageAxis == 2) ? s_pixel : s_line * szVol[2];
+    long y = m_SliceIndex;
+    mt->ParallelizeArray(0, szVol[2], [&](itk::SizeValueType z)
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { (int) m_SliceIndex, z } };
-      const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-      if (m_LineDirectionImageAxis == 2) //z is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*z*szVol[0], s_pixel * 1);
-        }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*z, s_line*szVol[2]);
-        }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 1!", __FUNCTION__);
-      }
+      // z is either the line coordinate (x is pixel) or the pixel coordinate
+      typename BufferType::IndexType lineIndex = { { y, (long) z } };
+      uncompressLine(buffer->GetPixel(lineIndex), outSlice + stride_line * (long) z, stride_pixel);
+      }, nullptr);
     }
   else //slicing along x, the low-preformance case
     {
     assert(m_SliceDirectionImageAxis == 0);
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
-      for (int y = 0; y < szVol[1]; y++)
+
+    // Offsets in the output slice for a unit step in y and z
+    long step_y = (m_LineDirectionImageAxis == 1) ? s_line * szVol[2] : s_pixel;
+    long step_z = (m_LineDirectionImageAxis == 1) ? s_pixel : s_line * szVol[1];
+    long x_slice = m_SliceIndex;
+
+    // Each thread handles a range of z slabs
+    mt->ParallelizeArray(0, szVol[2], [&](itk::SizeValueType z)
+      {
+      typename OutputImageType::PixelType *outRow = outSlice + step_z * (long) z;
+      typename BufferType::IndexType lineIndex = { { 0, (long) z } };
+      for (long y = 0; y < szVol[1]; y++)
         {
-        typename InputImageType::BufferType::IndexType lineIndex = { { y, z } };
-        const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-        int t = 0;
-        for (int x = 0; x < line.size(); x++)
+        lineIndex[0] = y;
+        const typename InputImageType::RLLine & line = buffer->GetPixel(lineIndex);
+        long t = 0;
+        for (size_t i = 0; i < line.size(); i++)
           {
-          t += line[x].first;
-          if (t > m_SliceIndex)
+          t += line[i].first;
+          if (t > x_slice)
             {
-            if (m_LineDirectionImageAxis == 2) //z is line coordinate
-              {
-              assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-              *(outSlice + s_line*z*szVol[1] + s_pixel *y) = line[x].second;;
-              }
-            else if (m_LineDirectionImageAxis == 1) //y is line coordinate
-              {
-              assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-              *(outSlice + s_pixel*z + s_line *y*szVol[2]) = line[x].second;
-              }
-            else
-              throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 0!", __FUNCTION__);
+            *(outRow + step_y * y) = line[i].second;
             break;
             }
           }
         }
+      }, nullptr);
     }
 }
 
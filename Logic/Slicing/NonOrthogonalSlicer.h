@@ -48,6 +48,7 @@
 #include "itkDataObjectDecorator.h"
 #include "itkVectorImage.h"
 #include "itkImageAdaptor.h"
+#include <vector>
 
 using itk::DataObjectDecorator;
 using itk::ProcessObject;
@@ -75,6 +76,9 @@ public:
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
 
+  /** Process n voxels along a line, starting at cix and advancing by step */
+  inline void ProcessRow(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr);
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -88,6 +92,10 @@ protected:
 
   // Temporary buffer
   double *m_Buffer;
+
+  // Temporary buffers for interpolating a row of voxels
+  std::vector<typename Interpolator::OutputComponentType> m_RowBuffer;
+  std::vector<typename Interpolator::InOut> m_RowStatus;
 };
 
 
@@ -108,6 +116,7 @@ public:
   ~DefaultNonOrthogonalSlicerWorkerTraits();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessRow(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -124,6 +133,10 @@ protected:
 
   // Temporary buffer
   double m_BufferValue;
+
+  // Temporary buffers for interpolating a row of voxels
+  std::vector<typename Interpolator::OutputComponentType> m_RowBuffer;
+  std::vector<typename Interpolator::InOut> m_RowStatus;
 };
 
 
@@ -146,6 +159,7 @@ public:
   ~DefaultNonOrthogonalSlicerWorkerTraits();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessRow(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -188,6 +202,8 @@ public:
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
 
+  inline void ProcessRow(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr);
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
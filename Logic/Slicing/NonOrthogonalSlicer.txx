@@ -241,14 +241,8 @@ NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
         }
 
       // Process the voxels that cross the image cube
-      for(int i = kStart; i <= kEnd; i++)
-        {
-        worker.ProcessVoxel(cixSample.GetDataPointer(), use_nn, &outPixelPtr);
-
-        // Update the sample location
-        for(int d = 0; d < InputImageDimension; d++)
-          cixSample[d] += cixStep[d];
-        }
+      worker.ProcessRow(cixSample.GetDataPointer(), cixStep.GetDataPointer(),
+                        kEnd - kStart + 1, use_nn, &outPixelPtr);
 
       // Process the rest
       if(kEnd < line_len - 1)
@@ -303,6 +297,43 @@ DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
     }
 }
 
+template <class TInputImage, class TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
+::ProcessRow(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  if(use_nn)
+    {
+    double x[TInputImage::ImageDimension];
+    for(int i = 0; i < n; i++)
+      {
+      for(unsigned int d = 0; d < TInputImage::ImageDimension; d++)
+        x[d] = cix[d] + i * step[d];
+      ProcessVoxel(x, true, out_ptr);
+      }
+    return;
+    }
+
+  // Interpolate the whole row at once
+  m_RowBuffer.resize(n * m_NumComponents);
+  m_RowStatus.resize(n);
+  m_Interpolator.InterpolateRow(cix, step, n, m_RowBuffer.data(), m_RowStatus.data());
+
+  const typename Interpolator::OutputComponentType *p = m_RowBuffer.data();
+  for(int i = 0; i < n; i++, p += m_NumComponents)
+    {
+    if(m_RowStatus[i] == Interpolator::INSIDE || m_RowStatus[i] == Interpolator::BORDER)
+      {
+      for(int k = 0; k < m_NumComponents; k++)
+        *(*out_ptr)++ = static_cast<OutputComponentType>(p[k]);
+      }
+    else
+      {
+      SkipVoxels(1, out_ptr);
+      }
+    }
+}
+
 template <class TInputImage, class TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
@@ -363,6 +394,39 @@ DefaultNonOrthogonalSlicerWorkerTraits<
     *(*out_ptr)++ = 0;
 }
 
+template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<
+  itk::VectorImageToImageAdaptor<TPixelType, Dimension>,
+  TOutputImage>
+::ProcessRow(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  if(use_nn)
+    {
+    double x[Dimension];
+    for(int i = 0; i < n; i++)
+      {
+      for(unsigned int d = 0; d < Dimension; d++)
+        x[d] = cix[d] + i * step[d];
+      ProcessVoxel(x, true, out_ptr);
+      }
+    return;
+    }
+
+  // Interpolate the whole row at once - only one component is sampled
+  m_RowBuffer.resize(n);
+  m_RowStatus.resize(n);
+  m_Interpolator.InterpolateRow(cix, step, n, m_RowBuffer.data(), m_RowStatus.data());
+
+  for(int i = 0; i < n; i++)
+    {
+    if(m_RowStatus[i] == Interpolator::INSIDE)
+      *(*out_ptr)++ = static_cast<OutputComponentType>(m_RowBuffer[i]);
+    else
+      *(*out_ptr)++ = 0;
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<
@@ -431,6 +495,23 @@ DefaultNonOrthogonalSlicerWorkerTraits<
     }
 }
 
+template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<
+  itk::ImageAdaptor<itk::VectorImage<TPixelType, Dimension>, TAccessor>,
+  TOutputImage>
+::ProcessRow(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  // The accessor is applied voxel by voxel
+  double x[Dimension];
+  for(int i = 0; i < n; i++)
+    {
+    for(unsigned int d = 0; d < Dimension; d++)
+      x[d] = cix[d] + i * step[d];
+    ProcessVoxel(x, use_nn, out_ptr);
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<
@@ -480,6 +561,20 @@ DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TO
     }
 }
 
+template <typename TPixel, unsigned int Dimension, typename TCounter, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TOutputImage>
+::ProcessRow(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  double x[Dimension];
+  for(int i = 0; i < n; i++)
+    {
+    for(unsigned int d = 0; d < Dimension; d++)
+      x[d] = cix[d] + i * step[d];
+    ProcessVoxel(x, use_nn, out_ptr);
+    }
+}
+
 template <typename TPixel, unsigned int Dimension, typename TCounter, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TOutputImage>
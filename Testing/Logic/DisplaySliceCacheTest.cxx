@@ -0,0 +1,201 @@
+#include "DisplaySliceCacheFilter.h"
+#include "AdaptiveSlicingPipeline.h"
+#include "ImageCoordinateTransform.h"
+#include "InputSelectionImageFilter.h"
+#include <itkImage.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkUnaryFunctorImageFilter.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * Checks that the display slice cache never serves stale slices. A slicing
+ * pipeline with a time point selector and an intensity mapping filter is
+ * built in the same way as in ImageWrapper. The test scrolls between slices
+ * and prefetches ahead. It then paints into the image, changes the display
+ * mapping and switches the time point. After each step, every displayed
+ * pixel must match a slice computed directly from the image.
+ */
+
+typedef itk::Image<short, 3> ImageType;
+typedef itk::Image<short, 2> SliceType;
+typedef DisplaySliceCacheFilter::ImageType DisplaySliceType;
+typedef DisplaySliceType::PixelType DisplayPixelType;
+
+typedef InputSelectionImageFilter<ImageType, unsigned int> TimePointSelectFilter;
+typedef AdaptiveSlicingPipeline<ImageType, SliceType, ImageType> SlicerType;
+
+// Number of times the intensity mapping has been evaluated
+static unsigned long g_MappedPixels = 0;
+
+// A stand-in for the display mapping: scales the intensity into gray
+class GainFunctor
+{
+public:
+  GainFunctor() : m_Gain(1) {}
+  void SetGain(int gain) { m_Gain = gain; }
+
+  DisplayPixelType operator()(short x) const
+    {
+    g_MappedPixels++;
+    DisplayPixelType p;
+    p.Fill(Map(x));
+    p[3] = 255;
+    return p;
+    }
+
+  unsigned char Map(short x) const
+    { return (unsigned char) std::min(255, x * m_Gain); }
+
+  bool operator != (const GainFunctor &other) const
+    { return m_Gain != other.m_Gain; }
+  bool operator == (const GainFunctor &other) const
+    { return m_Gain == other.m_Gain; }
+
+protected:
+  int m_Gain;
+};
+
+typedef itk::UnaryFunctorImageFilter<SliceType, DisplaySliceType, GainFunctor> MappingFilter;
+
+ImageType::Pointer MakeTimePoint(int t)
+{
+  ImageType::SizeType size = {{ 16, 12, 10 }};
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(size);
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> it(image, image->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    ImageType::IndexType idx = it.GetIndex();
+    it.Set((short) ((idx[0] + 3 * idx[1] + 7 * idx[2] + 50 * t) % 120));
+    }
+  return image;
+}
+
+struct TestPipeline
+{
+  ImageType::Pointer TimePoints[2];
+  SmartPtr<TimePointSelectFilter> Selector;
+  SlicerType::Pointer Slicer;
+  MappingFilter::Pointer Mapping;
+  SmartPtr<DisplaySliceCacheFilter> Cache;
+  unsigned int TimePoint;
+  int Gain;
+};
+
+// Display slice z and compare it to the image of the current time point
+bool CheckSlice(TestPipeline &p, long z, const char *what)
+{
+  SlicerType::IndexType index = {{ 0, 0, z }};
+  p.Slicer->SetSliceIndex(index);
+  p.Cache->Update();
+
+  DisplaySliceType *slice = p.Cache->GetOutput();
+  ImageType *image = p.TimePoints[p.TimePoint];
+  ImageType::SizeType size = image->GetBufferedRegion().GetSize();
+  if(slice->GetBufferedRegion().GetSize()[0] != size[0]
+     || slice->GetBufferedRegion().GetSize()[1] != size[1])
+    {
+    std::cerr << what << ": slice " << z << " has the wrong size" << std::endl;
+    return false;
+    }
+
+  GainFunctor f;
+  f.SetGain(p.Gain);
+  for(long y = 0; y < (long) size[1]; y++)
+    {
+    for(long x = 0; x < (long) size[0]; x++)
+      {
+      ImageType::IndexType i3 = {{ x, y, z }};
+      DisplaySliceType::IndexType i2 = {{ x, y }};
+      unsigned char expected = f.Map(image->GetPixel(i3));
+      if(slice->GetPixel(i2)[0] != expected)
+        {
+        std::cerr << what << ": slice " << z << " pixel (" << x << "," << y << ") is "
+                  << (int) slice->GetPixel(i2)[0] << ", expected " << (int) expected << std::endl;
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  TestPipeline p;
+  p.TimePoint = 0;
+  p.Gain = 1;
+
+  // Build the pipeline as ImageWrapper does
+  p.Selector = TimePointSelectFilter::New();
+  for(unsigned int t = 0; t < 2; t++)
+    {
+    p.TimePoints[t] = MakeTimePoint(t);
+    p.Selector->AddSelectableInput(t, p.TimePoints[t]);
+    }
+
+  p.Slicer = SlicerType::New();
+  p.Slicer->SetInput(p.Selector->GetOutput());
+  p.Slicer->SetOrthogonalTransform(ImageCoordinateTransform::New());
+
+  p.Mapping = MappingFilter::New();
+  p.Mapping->SetInput(p.Slicer->GetOutput());
+
+  p.Cache = DisplaySliceCacheFilter::New();
+  p.Cache->SetInput(p.Mapping->GetOutput());
+
+  // Scrolling back to a slice is served from the cache
+  if(!CheckSlice(p, 2, "Initial") || !CheckSlice(p, 5, "Initial"))
+    return EXIT_FAILURE;
+
+  unsigned long n_mapped = g_MappedPixels;
+  if(!CheckSlice(p, 2, "Revisit"))
+    return EXIT_FAILURE;
+  if(g_MappedPixels != n_mapped)
+    {
+    std::cerr << "Revisited slice was not served from the cache" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Prefetched slices are displayed correctly
+  p.Cache->Prefetch(6);
+  p.Cache->Prefetch(7);
+  if(!CheckSlice(p, 6, "Prefetch") || !CheckSlice(p, 7, "Prefetch"))
+    return EXIT_FAILURE;
+
+  // Paint into the image, including into a slice that has been prefetched
+  p.Cache->Prefetch(8);
+  for(long z = 0; z < 10; z++)
+    {
+    ImageType::IndexType idx = {{ 4, 3, z }};
+    p.TimePoints[0]->SetPixel(idx, 119);
+    }
+  p.TimePoints[0]->Modified();
+  if(!CheckSlice(p, 2, "Paint") || !CheckSlice(p, 5, "Paint") || !CheckSlice(p, 8, "Paint"))
+    return EXIT_FAILURE;
+
+  // Change the display mapping
+  GainFunctor f;
+  f.SetGain(p.Gain = 2);
+  p.Mapping->SetFunctor(f);
+  if(!CheckSlice(p, 7, "Mapping") || !CheckSlice(p, 2, "Mapping"))
+    return EXIT_FAILURE;
+
+  // Switch to another time point, then back
+  p.Cache->Prefetch(3);
+  p.TimePoint = 1;
+  p.Selector->SetSelectedInput(p.TimePoint);
+  if(!CheckSlice(p, 2, "Time point") || !CheckSlice(p, 3, "Time point")
+     || !CheckSlice(p, 5, "Time point"))
+    return EXIT_FAILURE;
+
+  p.TimePoint = 0;
+  p.Selector->SetSelectedInput(p.TimePoint);
+  if(!CheckSlice(p, 2, "Time point") || !CheckSlice(p, 8, "Time point"))
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+#include "FastLinearInterpolator.h"
+#include <itkImage.h>
+#include <itkVectorImage.h>
+#include <itkImageRegionIterator.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/**
+ * Checks that FastLinearInterpolator::InterpolateRow(), which processes
+ * blocks of samples with SIMD instructions when they are available, gives
+ * the same values and status as calling Interpolate() for each sample. Rows
+ * are placed at random, so that some lie fully inside of the image and some
+ * cross the border or leave the image.
+ */
+
+// Random number in [a, b]
+double RandomUniform(double a, double b)
+{
+  return a + (b - a) * (rand() / (double) RAND_MAX);
+}
+
+// Round to a multiple of 1/64, so that the sample positions are exact in
+// single precision no matter how they are accumulated
+double Quantize(double x)
+{
+  return std::floor(x * 64.0 + 0.5) / 64.0;
+}
+
+template <class TInterpolator>
+bool TestRows(TInterpolator &interp, int n_sampled, const int size[3], const char *what)
+{
+  typedef typename TInterpolator::RealType RealType;
+  typedef typename TInterpolator::OutputComponentType OutputComponentType;
+  typedef typename TInterpolator::InOut InOut;
+
+  const int max_n = 40;
+  std::vector<OutputComponentType> out_row(max_n * n_sampled), out_voxel(max_n * n_sampled);
+  std::vector<InOut> status_row(max_n);
+
+  int n_inside = 0;
+  for(int trial = 0; trial < 2000; trial++)
+    {
+    // Half of the rows start well inside of the image
+    RealType cix[3], step[3];
+    double margin = (trial % 2) ? 1.0 : -3.0;
+    for(int d = 0; d < 3; d++)
+      {
+      cix[d] = (RealType) Quantize(RandomUniform(margin, size[d] - 1 - margin));
+      step[d] = (RealType) Quantize(RandomUniform(-0.6, 0.6));
+      }
+    int n = 1 + rand() % max_n;
+
+    // Samples outside of the image leave the output untouched
+    std::fill(out_row.begin(), out_row.end(), (OutputComponentType) -1);
+    std::fill(out_voxel.begin(), out_voxel.end(), (OutputComponentType) -1);
+
+    interp.InterpolateRow(cix, step, n, &out_row[0], &status_row[0]);
+
+    for(int i = 0; i < n; i++)
+      {
+      RealType x[3];
+      for(int d = 0; d < 3; d++)
+        x[d] = cix[d] + i * step[d];
+
+      InOut status = interp.Interpolate(x, &out_voxel[i * n_sampled]);
+      if(status != status_row[i])
+        {
+        std::cerr << what << ": status mismatch at sample " << i << " of trial " << trial << std::endl;
+        return false;
+        }
+      if(status == TInterpolator::INSIDE)
+        n_inside++;
+
+      for(int k = 0; k < n_sampled; k++)
+        {
+        double a = out_row[i * n_sampled + k], b = out_voxel[i * n_sampled + k];
+        if(std::fabs(a - b) > 1e-4 * (1.0 + std::fabs(b)))
+          {
+          std::cerr << what << ": value mismatch at sample " << i << " of trial " << trial
+                    << ": " << a << " vs. " << b << std::endl;
+          return false;
+          }
+        }
+      }
+    }
+
+  if(n_inside == 0)
+    {
+    std::cerr << what << ": no samples inside of the image" << std::endl;
+    return false;
+    }
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  const int size[3] = { 23, 17, 11 };
+  itk::Size<3> sz = {{ 23, 17, 11 }};
+  srand(1234);
+
+  // Scalar image
+  typedef itk::Image<short, 3> ImageType;
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(sz);
+  image->Allocate();
+  for(itk::ImageRegionIterator<ImageType> it(image, image->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+    it.Set((short) (rand() % 2000 - 1000));
+
+  // Multi-component image
+  typedef itk::VectorImage<unsigned char, 3> VectorImageType;
+  VectorImageType::Pointer vimage = VectorImageType::New();
+  vimage->SetRegions(sz);
+  vimage->SetNumberOfComponentsPerPixel(3);
+  vimage->Allocate();
+  unsigned char *vbuf = vimage->GetBufferPointer();
+  for(size_t i = 0; i < 3 * vimage->GetBufferedRegion().GetNumberOfPixels(); i++)
+    vbuf[i] = (unsigned char) (rand() % 256);
+
+  // The double precision interpolator is the one with SIMD kernels
+  FastLinearInterpolator<ImageType, double, 3> fli_double(image);
+  if(!TestRows(fli_double, 1, size, "Scalar image, double"))
+    return EXIT_FAILURE;
+
+  FastLinearInterpolator<ImageType, float, 3> fli_float(image);
+  if(!TestRows(fli_float, 1, size, "Scalar image, float"))
+    return EXIT_FAILURE;
+
+  FastLinearInterpolator<VectorImageType, double, 3> fli_vector(vimage);
+  if(!TestRows(fli_vector, 3, size, "Vector image"))
+    return EXIT_FAILURE;
+
+  // A single component sampled from a vector image
+  FastLinearInterpolator<VectorImageType, double, 3> fli_comp(vimage, vbuf + 1, 3, 1);
+  if(!TestRows(fli_comp, 1, size, "Vector image component"))
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
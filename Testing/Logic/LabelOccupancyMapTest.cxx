@@ -0,0 +1,150 @@
+#include "LabelOccupancyMap.h"
+#include "ImageRayIntersectionFinder.h"
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * Checks the occupancy map of a segmentation and its use in ray casting. The
+ * map must only report bricks that contain nothing but the clear label as
+ * empty, and casting rays with the map, which passes over the empty bricks,
+ * must find exactly the same voxels as casting them without it.
+ */
+
+typedef LabelOccupancyMap::ImageType LabelImageType;
+
+// Hits every non-zero label
+class NonZeroHitTester
+{
+public:
+  int operator()(LabelType label) const
+    { return label != 0 ? 1 : 0; }
+};
+
+typedef ImageRayIntersectionFinder<LabelImageType, NonZeroHitTester> FinderType;
+
+// Random number in [a, b]
+double RandomUniform(double a, double b)
+{
+  return a + (b - a) * (rand() / (double) RAND_MAX);
+}
+
+int main(int argc, char *argv[])
+{
+  const long size[3] = { 90, 70, 50 };
+  srand(4321);
+
+  // A segmentation with a few small blobs, leaving most of the image empty
+  LabelImageType::Pointer image = LabelImageType::New();
+  LabelImageType::SizeType sz = {{ 90, 70, 50 }};
+  image->SetRegions(sz);
+  image->Allocate();
+  image->FillBuffer(0);
+
+  for(int blob = 0; blob < 6; blob++)
+    {
+    double c[3] = { RandomUniform(0, size[0]), RandomUniform(0, size[1]), RandomUniform(0, size[2]) };
+    double r = RandomUniform(2, 6);
+    for(long z = 0; z < size[2]; z++)
+      for(long y = 0; y < size[1]; y++)
+        for(long x = 0; x < size[0]; x++)
+          {
+          double dx = x - c[0], dy = y - c[1], dz = z - c[2];
+          if(dx * dx + dy * dy + dz * dz < r * r)
+            {
+            LabelImageType::IndexType idx = {{ x, y, z }};
+            image->SetPixel(idx, (LabelType) (blob + 1));
+            }
+          }
+    }
+
+  LabelOccupancyMap map;
+  map.Compute(image);
+
+  // Empty bricks must contain only the clear label, at every level
+  long n_empty = 0;
+  for(unsigned int level = 0; level < map.GetNumberOfLevels(); level++)
+    for(long z = 0; z < size[2]; z++)
+      for(long y = 0; y < size[1]; y++)
+        for(long x = 0; x < size[0]; x++)
+          {
+          if(map.IsBrickEmpty(level, x, y, z))
+            {
+            LabelImageType::IndexType idx = {{ x, y, z }};
+            if(image->GetPixel(idx) != 0)
+              {
+              std::cerr << "Voxel " << x << "," << y << "," << z << " is labeled but its brick "
+                        << "at level " << level << " is empty" << std::endl;
+              return EXIT_FAILURE;
+              }
+            n_empty++;
+            }
+          }
+
+  if(n_empty == 0 || map.GetNumberOfLevels() < 2)
+    {
+    std::cerr << "No empty bricks in a mostly empty image" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Cast rays from outside and inside the image, including axis-aligned rays
+  // and diagonal rays through voxel corners, which cross several voxel
+  // borders at the same time
+  int n_hits = 0;
+  for(int trial = 0; trial < 20000; trial++)
+    {
+    Vector3d point, ray;
+    if(trial % 4 == 0)
+      {
+      for(int d = 0; d < 3; d++)
+        {
+        point[d] = RandomUniform(0, size[d] - 1);
+        ray[d] = 0;
+        }
+      ray[rand() % 3] = (rand() % 2) ? 1 : -1;
+      }
+    else if(trial % 4 == 1)
+      {
+      for(int d = 0; d < 3; d++)
+        {
+        point[d] = rand() % size[d] - 0.5;
+        ray[d] = rand() % 3 - 1;
+        }
+      if(ray[0] == 0 && ray[1] == 0 && ray[2] == 0)
+        ray[0] = 1;
+      }
+    else
+      {
+      for(int d = 0; d < 3; d++)
+        {
+        point[d] = RandomUniform(-20, size[d] + 20);
+        ray[d] = RandomUniform(0, size[d] - 1) - point[d];
+        }
+      }
+
+    FinderType brute, fast;
+    fast.SetOccupancyMap(&map);
+
+    Vector3i hit_brute(0), hit_fast(0);
+    int res_brute = brute.FindIntersection(image, point, ray, hit_brute);
+    int res_fast = fast.FindIntersection(image, point, ray, hit_fast);
+
+    if(res_brute != res_fast || (res_brute == 1 && hit_brute != hit_fast))
+      {
+      std::cerr << "Ray " << trial << " from " << point << " along " << ray
+                << " hits " << hit_fast << " (" << res_fast << ") with the map and "
+                << hit_brute << " (" << res_brute << ") without" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    if(res_brute == 1)
+      n_hits++;
+    }
+
+  if(n_hits == 0)
+    {
+    std::cerr << "No rays hit the segmentation" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include "MomentTextures.h"
+#include <itkImage.h>
+#include <itkVectorImage.h>
+#include <itkImageRegionIterator.h>
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * Checks that the moment textures computed from running sums match those
+ * computed by visiting the neighborhood of each voxel. The image is small
+ * compared to the radius, so that many neighborhoods cross the border of the
+ * image, and its size is odd, so that the threads get uneven regions.
+ */
+
+typedef itk::Image<short, 3> ImageType;
+typedef itk::VectorImage<short, 3> TextureImageType;
+typedef bilwaj::MomentTextureFilter<ImageType, TextureImageType> FilterType;
+
+TextureImageType::Pointer ComputeTextures(
+    ImageType *image, const FilterType::SizeType &radius, unsigned int degree, bool running)
+{
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->SetRadius(radius);
+  filter->SetHighestDegree(degree);
+  filter->SetUseRunningSums(running);
+  filter->Update();
+
+  TextureImageType::Pointer result = filter->GetOutput();
+  result->DisconnectPipeline();
+  return result;
+}
+
+bool TestRadius(ImageType *image, const FilterType::SizeType &radius, unsigned int degree)
+{
+  TextureImageType::Pointer direct = ComputeTextures(image, radius, degree, false);
+  TextureImageType::Pointer running = ComputeTextures(image, radius, degree, true);
+
+  if(running->GetNumberOfComponentsPerPixel() != degree
+     || running->GetBufferedRegion() != direct->GetBufferedRegion())
+    {
+    std::cerr << "Radius " << radius << ": output has the wrong size" << std::endl;
+    return false;
+    }
+
+  // The moments are scaled by 1000 and truncated. The two methods sum in a
+  // different order, so a value that falls just at an integer may round
+  // either way
+  const short *p_direct = direct->GetBufferPointer();
+  const short *p_running = running->GetBufferPointer();
+  size_t n = degree * direct->GetBufferedRegion().GetNumberOfPixels();
+  for(size_t i = 0; i < n; i++)
+    {
+    if(std::abs(p_direct[i] - p_running[i]) > 1)
+      {
+      std::cerr << "Radius " << radius << ": moment " << i % degree + 1
+                << " of voxel " << i / degree << " is " << p_running[i]
+                << " with running sums, " << p_direct[i] << " directly" << std::endl;
+      return false;
+      }
+    }
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  srand(2468);
+
+  ImageType::Pointer image = ImageType::New();
+  ImageType::SizeType size = {{ 23, 17, 9 }};
+  image->SetRegions(size);
+  image->Allocate();
+  for(itk::ImageRegionIterator<ImageType> it(image, image->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+    it.Set((short) (rand() % 2000 - 300));
+
+  FilterType::SizeType r1 = {{ 1, 1, 1 }};
+  FilterType::SizeType r2 = {{ 2, 1, 3 }};
+  FilterType::SizeType r3 = {{ 4, 4, 4 }};
+
+  if(!TestRadius(image, r1, 2) || !TestRadius(image, r2, 4) || !TestRadius(image, r3, 3))
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
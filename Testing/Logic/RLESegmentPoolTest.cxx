@@ -0,0 +1,316 @@
+#include "RLEImage.h"
+#include "RLERegionOfInterestImageFilter.h"
+#include "UndoDataManager.h"
+#include "IRISException.h"
+#include <itkImage.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/**
+ * Exercises the slab pool behind the run-length lines of RLEImage, and must
+ * be built with SNAP_RLE_POOLED_LINES. Threads fill lines and free lines that
+ * other threads allocated, and once the threads have exited the pool must
+ * give all of its slabs back. A segmentation is then converted to and from
+ * RLEImage, painted, trimmed while in use, and stored to and restored from
+ * the undo system through a spill file.
+ */
+
+#ifndef SNAP_RLE_POOLED_LINES
+#error "RLESegmentPoolTest must be built with SNAP_RLE_POOLED_LINES"
+#endif
+
+typedef RLEImage<LabelType> RLEImageType;
+typedef RLEImageType::RLLine RLLine;
+typedef RLEImageType::RLSegment RLSegment;
+typedef RLEImageType::BufferType BufferType;
+typedef itk::Image<LabelType, 3> ImageType;
+typedef UndoDataManager<LabelType> UndoManagerType;
+
+// Fill a line with runs determined by the seed. The line grows one run at a
+// time, so that its storage moves through several size classes
+void FillLine(RLLine &line, unsigned int seed)
+{
+  line.clear();
+  unsigned int n = 1 + (seed * 7919u) % 200;
+  for(unsigned int i = 0; i < n; i++)
+    line.push_back(RLSegment((unsigned short) (1 + i), (LabelType) (seed + i)));
+}
+
+bool CheckLine(const RLLine &line, unsigned int seed)
+{
+  unsigned int n = 1 + (seed * 7919u) % 200;
+  if(line.size() != n)
+    return false;
+  for(unsigned int i = 0; i < n; i++)
+    if(line[i].first != 1 + i || line[i].second != (LabelType) (seed + i))
+      return false;
+  return true;
+}
+
+bool TestThreads()
+{
+  const unsigned int n_threads = 8, n_lines = 20000;
+  std::vector<RLLine> lines(n_threads * n_lines);
+  std::vector<int> ok(n_threads, 1);
+
+  // Each thread fills its own lines, replacing some of them along the way
+  std::vector<std::thread> workers;
+  for(unsigned int t = 0; t < n_threads; t++)
+    workers.push_back(std::thread([&lines, &ok, t]()
+      {
+      for(unsigned int i = t * n_lines; i < (t + 1) * n_lines; i++)
+        {
+        FillLine(lines[i], i + 1);
+        if(i % 3 == 0)
+          FillLine(lines[i], i);
+        }
+      for(unsigned int i = t * n_lines; i < (t + 1) * n_lines; i++)
+        if(!CheckLine(lines[i], i % 3 == 0 ? i : i + 1))
+          ok[t] = 0;
+      }));
+  for(unsigned int t = 0; t < n_threads; t++)
+    workers[t].join();
+
+  size_t n_slabs = RLESegmentPool::GetNumberOfSlabs();
+
+  // Each thread then frees the lines filled by another thread, allocating
+  // short-lived lines in between
+  workers.clear();
+  for(unsigned int t = 0; t < n_threads; t++)
+    workers.push_back(std::thread([&lines, &ok, t]()
+      {
+      unsigned int u = (t + 1) % n_threads;
+      for(unsigned int i = u * n_lines; i < (u + 1) * n_lines; i++)
+        {
+        if(!CheckLine(lines[i], i % 3 == 0 ? i : i + 1))
+          ok[t] = 0;
+        RLLine temp;
+        FillLine(temp, i * 13);
+        RLLine().swap(lines[i]);
+        }
+      }));
+  for(unsigned int t = 0; t < n_threads; t++)
+    workers[t].join();
+
+  for(unsigned int t = 0; t < n_threads; t++)
+    {
+    if(!ok[t])
+      {
+      std::cerr << "Thread " << t << " found a corrupted line" << std::endl;
+      return false;
+      }
+    }
+
+  if(n_slabs == 0)
+    {
+    std::cerr << "The lines were not allocated from the pool" << std::endl;
+    return false;
+    }
+
+  // The exited threads have returned their caches, so every slab is unused
+  RLESegmentPool::ReleaseUnusedSlabs();
+  if(RLESegmentPool::GetNumberOfSlabs() != 0)
+    {
+    std::cerr << RLESegmentPool::GetNumberOfSlabs() << " of " << n_slabs
+              << " slabs were not released" << std::endl;
+    return false;
+    }
+
+  return true;
+}
+
+// Compare an RLE image to a regular image voxel by voxel
+bool SameImage(const RLEImageType *rle, const ImageType *image, const char *what)
+{
+  itk::ImageRegionConstIteratorWithIndex<ImageType> it(image, image->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    if(rle->GetPixel(it.GetIndex()) != it.Get())
+      {
+      std::cerr << what << ": voxel " << it.GetIndex() << " is "
+                << rle->GetPixel(it.GetIndex()) << ", expected " << it.Get() << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+RLEImageType::Pointer ToRLE(ImageType *image)
+{
+  typedef itk::RegionOfInterestImageFilter<ImageType, RLEImageType> FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(image);
+  filter->SetRegionOfInterest(image->GetBufferedRegion());
+  filter->Update();
+  return filter->GetOutput();
+}
+
+ImageType::Pointer FromRLE(RLEImageType *rle)
+{
+  typedef itk::RegionOfInterestImageFilter<RLEImageType, ImageType> FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(rle);
+  filter->SetRegionOfInterest(rle->GetBufferedRegion());
+  filter->Update();
+  return filter->GetOutput();
+}
+
+// Paint random voxels into both images
+void Paint(RLEImageType *rle, ImageType *image, int n_voxels)
+{
+  ImageType::SizeType size = image->GetBufferedRegion().GetSize();
+  for(int i = 0; i < n_voxels; i++)
+    {
+    ImageType::IndexType idx;
+    for(int d = 0; d < 3; d++)
+      idx[d] = rand() % size[d];
+    LabelType label = (LabelType) (rand() % 5);
+    rle->SetPixel(idx, label);
+    image->SetPixel(idx, label);
+    }
+}
+
+// Store the lines of an RLE image in an undo delta
+UndoManagerType::Delta *Encode(RLEImageType *rle)
+{
+  UndoManagerType::Delta *delta = new UndoManagerType::Delta();
+  delta->SetRegion(rle->GetBufferedRegion());
+  itk::ImageRegionIterator<BufferType> it(rle->GetBuffer(), rle->GetBuffer()->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    for(size_t i = 0; i < it.Value().size(); i++)
+      delta->Encode(it.Value()[i].second, it.Value()[i].first);
+  delta->FinishEncoding();
+  return delta;
+}
+
+// Rebuild the lines of an RLE image from an undo delta. Runs of the delta
+// may span several lines
+RLEImageType::Pointer Decode(UndoManagerType::Delta *delta, const ImageType *reference)
+{
+  RLEImageType::Pointer rle = RLEImageType::New();
+  rle->SetRegions(reference->GetBufferedRegion());
+  rle->Allocate();
+
+  size_t line_length = reference->GetBufferedRegion().GetSize()[0];
+  size_t run = 0, run_left = delta->GetNumberOfRLEs() ? delta->GetRLELength(0) : 0;
+  itk::ImageRegionIterator<BufferType> it(rle->GetBuffer(), rle->GetBuffer()->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    RLLine line;
+    for(size_t x = 0; x < line_length && run < delta->GetNumberOfRLEs(); )
+      {
+      size_t n = std::min(run_left, line_length - x);
+      line.push_back(RLSegment((unsigned short) n, delta->GetRLEValue(run)));
+      x += n;
+      run_left -= n;
+      if(run_left == 0 && ++run < delta->GetNumberOfRLEs())
+        run_left = delta->GetRLELength(run);
+      }
+    it.Value().swap(line);
+    }
+  return rle;
+}
+
+bool TestImages()
+{
+  srand(97531);
+
+  // A segmentation with a few spheres of labels
+  ImageType::Pointer image = ImageType::New();
+  ImageType::SizeType size = {{ 120, 90, 60 }};
+  image->SetRegions(size);
+  image->Allocate();
+  image->FillBuffer(0);
+  for(int blob = 0; blob < 12; blob++)
+    {
+    long c[3] = { rand() % 120, rand() % 90, rand() % 60 }, r = 3 + rand() % 10;
+    itk::ImageRegionIteratorWithIndex<ImageType> it(image, image->GetBufferedRegion());
+    for(; !it.IsAtEnd(); ++it)
+      {
+      long d2 = 0;
+      for(int d = 0; d < 3; d++)
+        d2 += (it.GetIndex()[d] - c[d]) * (it.GetIndex()[d] - c[d]);
+      if(d2 < r * r)
+        it.Set((LabelType) (1 + blob % 4));
+      }
+    }
+
+  // Conversion to RLE fills the lines on the ITK threads
+  RLEImageType::Pointer rle = ToRLE(image);
+  if(!SameImage(rle, image, "Conversion"))
+    return false;
+
+  // Painting splits and merges runs, reallocating the lines
+  Paint(rle, image, 20000);
+  if(!SameImage(rle, image, "Paint"))
+    return false;
+
+  // Releasing a copy leaves unused slabs, which are trimmed while the lines
+  // of the painted image are still in use
+  RLEImageType::Pointer copy = ToRLE(image);
+  copy = NULL;
+  RLESegmentPool::ReleaseUnusedSlabs();
+  if(!SameImage(rle, image, "Trim"))
+    return false;
+
+  ImageType::Pointer back = FromRLE(rle);
+  if(!SameImage(rle, back, "Conversion from RLE"))
+    return false;
+
+  // Store the painted image in the undo system, followed by more commits so
+  // that it is compressed and spilled, then undo back to it and rebuild it
+  SmartPtr<UndoSpillFile> spill = UndoSpillFile::New();
+  UndoManagerType undo(4, 100000000);
+  undo.SetNumberOfHotCommits(1);
+  undo.SetSpillFile(spill);
+
+  undo.AddDeltaToStaging(Encode(rle));
+  undo.CommitStaging("snapshot");
+  for(int c = 0; c < 3; c++)
+    {
+    Paint(rle, back, 5000);
+    undo.AddDeltaToStaging(Encode(rle));
+    undo.CommitStaging("paint");
+    }
+
+  for(int c = 0; c < 3; c++)
+    undo.GetCommitForUndo();
+
+  const UndoManagerType::DList &deltas = undo.GetCommitForUndo().GetDeltas();
+  if(deltas.size() != 1)
+    {
+    std::cerr << "Undo returned " << deltas.size() << " deltas" << std::endl;
+    return false;
+    }
+
+  RLEImageType::Pointer restored = Decode(deltas.front(), image);
+  if(!SameImage(restored, image, "Undo"))
+    return false;
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  try
+    {
+    if(!TestThreads())
+      return EXIT_FAILURE;
+
+    if(!TestImages())
+      return EXIT_FAILURE;
+    }
+  catch(IRISException &exc)
+    {
+    std::cerr << "Exception: " << exc.what() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+#include "UndoDataManager.h"
+#include "SNAPCommon.h"
+#include "IRISException.h"
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+/**
+ * Round trip of undo data through the storage tiers. A series of commits is
+ * made with a single hot commit and a spill file, so that older commits are
+ * compressed and moved to disk. The history is then undone and redone, and
+ * every delta must come back with the runs it was encoded with.
+ */
+
+typedef UndoDataManager<LabelType> UndoManagerType;
+typedef UndoManagerType::Delta DeltaType;
+typedef UndoManagerType::Commit CommitType;
+typedef std::vector<std::pair<size_t, LabelType> > RunList;
+
+// Fill a delta with pseudo-random runs, recording them in the run list
+DeltaType *MakeDelta(unsigned int seed, RunList &runs)
+{
+  DeltaType *delta = new DeltaType();
+  srand(seed);
+  runs.clear();
+  for(int i = 0; i < 2000; i++)
+    {
+    size_t length = 1 + rand() % 300;
+    LabelType value = (LabelType) (rand() % 8);
+
+    // Runs of the same value are merged by the encoder
+    if(runs.size() && runs.back().second == value)
+      runs.back().first += length;
+    else
+      runs.push_back(std::make_pair(length, value));
+
+    delta->Encode(value, length);
+    }
+  delta->FinishEncoding();
+  return delta;
+}
+
+bool CheckCommit(const CommitType &commit, const std::vector<RunList> &expected, const char *what)
+{
+  const UndoManagerType::DList &deltas = commit.GetDeltas();
+  if(deltas.size() != expected.size())
+    {
+    std::cerr << what << ": wrong number of deltas" << std::endl;
+    return false;
+    }
+
+  size_t k = 0;
+  for(UndoManagerType::DConstIterator it = deltas.begin(); it != deltas.end(); ++it, ++k)
+    {
+    DeltaType *delta = *it;
+    const RunList &runs = expected[k];
+    if(delta->IsCompressed())
+      {
+      std::cerr << what << ": delta is still compressed" << std::endl;
+      return false;
+      }
+    if(delta->GetNumberOfRLEs() != runs.size())
+      {
+      std::cerr << what << ": expected " << runs.size() << " runs, got "
+                << delta->GetNumberOfRLEs() << std::endl;
+      return false;
+      }
+    for(size_t i = 0; i < runs.size(); i++)
+      {
+      if(delta->GetRLELength(i) != runs[i].first || delta->GetRLEValue(i) != runs[i].second)
+        {
+        std::cerr << what << ": run " << i << " does not match" << std::endl;
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  const unsigned int n_commits = 10, n_deltas = 3;
+
+  try
+    {
+    SmartPtr<UndoSpillFile> spill = UndoSpillFile::New();
+
+    UndoManagerType undo(4, 10000000);
+    undo.SetNumberOfHotCommits(1);
+    undo.SetSpillFile(spill);
+
+    // Make the commits
+    std::vector<std::vector<RunList> > expected(n_commits, std::vector<RunList>(n_deltas));
+    std::vector<DeltaType *> first_deltas;
+    for(unsigned int c = 0; c < n_commits; c++)
+      {
+      for(unsigned int d = 0; d < n_deltas; d++)
+        {
+        DeltaType *delta = MakeDelta(c * n_deltas + d + 1, expected[c][d]);
+        if(d == 0)
+          first_deltas.push_back(delta);
+        undo.AddDeltaToStaging(delta);
+        }
+      undo.CommitStaging("test");
+      }
+
+    if(undo.GetNumberOfCommits() != n_commits)
+      {
+      std::cerr << "Commits were pruned unexpectedly" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // All but the last commit should have been moved to the spill file
+    for(unsigned int c = 0; c < n_commits - 1; c++)
+      {
+      if(!first_deltas[c]->IsSpilled())
+        {
+        std::cerr << "Commit " << c << " was not spilled" << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    if(first_deltas[n_commits - 1]->IsCompressed())
+      {
+      std::cerr << "The last commit is not hot" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if(spill->GetUsedSize() == 0)
+      {
+      std::cerr << "Spill file is empty" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // Undo everything, checking the data of each commit
+    for(int c = n_commits - 1; c >= 0; c--)
+      {
+      if(!undo.IsUndoPossible())
+        {
+        std::cerr << "Undo is not possible at commit " << c << std::endl;
+        return EXIT_FAILURE;
+        }
+      if(!CheckCommit(undo.GetCommitForUndo(), expected[c], "Undo"))
+        return EXIT_FAILURE;
+      }
+
+    // Redo everything. By now the later commits have been spilled again
+    for(unsigned int c = 0; c < n_commits; c++)
+      {
+      if(!undo.IsRedoPossible())
+        {
+        std::cerr << "Redo is not possible at commit " << c << std::endl;
+        return EXIT_FAILURE;
+        }
+      if(!CheckCommit(undo.GetCommitForRedo(), expected[c], "Redo"))
+        return EXIT_FAILURE;
+      }
+
+    // Clearing the history gives all of the space in the file back
+    undo.Clear();
+    if(spill->GetUsedSize() != 0 || spill->GetFileSize() != 0)
+      {
+      std::cerr << "Spill file space was not released" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // A spill file that is too small leaves the commits compressed in memory
+    spill->SetMaximumSize(1);
+    for(unsigned int c = 0; c < n_commits; c++)
+      {
+      RunList runs;
+      undo.AddDeltaToStaging(MakeDelta(c + 1, runs));
+      undo.CommitStaging("test");
+      }
+    for(int c = n_commits - 1; c >= 0; c--)
+      {
+      std::vector<RunList> runs(1);
+      delete MakeDelta(c + 1, runs[0]);
+      if(!CheckCommit(undo.GetCommitForUndo(), runs, "Undo (in memory)"))
+        return EXIT_FAILURE;
+      }
+    }
+  catch(IRISException &exc)
+    {
+    std::cerr << "Exception: " << exc.what() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}